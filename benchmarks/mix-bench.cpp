@@ -0,0 +1,414 @@
+//
+//  mix-bench.cpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+// the benchmark suite: every opTable handler but the I/O ones (which wait
+// on host files), each called on its own as the engines call it, over
+// representative field specifications; then whole TAOCP programs on each
+// engine: Program P (the first 500 primes, without printing them), Program
+// M (the maximum of 1000 words, 100 times), Program S (straight insertion
+// of 500 keys) and a long loop of arithmetic. each program's result is
+// checked before it is timed.
+//
+// every benchmark is timed --repeat times (5 if not given) and the fastest
+// taken, which other work on the host can only make slower; the output is
+// one JSON object a line, with the instructions run, the ns an instruction,
+// instructions a second, the median and the spread of the repeats
+// ((slowest - fastest) / median). --baseline=file compares with an
+// earlier output and exits 1 if anything is more than --tolerance percent
+// (10 if not given) slower, so that it can gate a change. --filter=text
+// runs only the benchmarks whose names contain text; --quick runs them
+// for a tenth of the time. built by the CMake target mix-bench, and run by
+// the target bench.
+
+#include "mix.h"
+#include "mixop-table.hpp"
+#include "interpreter.hpp"
+#include "image.hpp"
+#include "assembler.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+volatile PackedWord sink; // keeps the results alive
+
+int repeats = 5;
+int scale = 10;            // (1 with --quick)
+const char *filter = nullptr;
+std::map<std::string, double> results; // ns an instruction, by name
+
+bool wanted(const std::string &name)
+{
+    return !filter || name.find(filter) != std::string::npos;
+}
+
+// the fastest of the repeats of a benchmark, printed
+void report(const std::string &name, long long instructions, std::vector<double> ns)
+{
+    std::sort(ns.begin(), ns.end());
+    double fastest = ns.front(), median = ns[ns.size() / 2];
+    std::printf("{\"name\":\"%s\",\"instructions\":%lld,\"ns_per_instruction\":%.3f,"
+                "\"ips\":%.0f,\"median\":%.3f,\"spread\":%.3f}\n",
+                name.c_str(), instructions, fastest, 1e9 / fastest, median, (ns.back() - fastest) / median);
+    std::fflush(stdout);
+    results[name] = fastest;
+}
+
+MIXInstr instruction(Opcode oc, int addr, int field)
+{
+    MIXInstr in = MIXInstr();
+    decodeWord(MIXWord(MIXAddr(addr), 0, static_cast<MIXByte>(field), oc).w, in);
+    return in;
+}
+
+// ---- handlers
+
+// call the handler of the instruction n times through in.op, putting back
+// what would stop it or send it elsewhere each time
+void benchHandler(MIXMachine &m, const std::string &name, Opcode oc, int addr, int field)
+{
+    if (!wanted("handler/" + name)) return;
+    const MIXInstr in = instruction(oc, addr, field);
+    const long long n = 100000LL * scale;
+    std::vector<double> ns;
+    for (int r = 0; r < repeats; r++) {
+        Clock::time_point start = Clock::now();
+        for (long long i = 0; i < n; i++) {
+            if (oc == DIV) m.Reg[REG_A].w = 0;        // (no overflow)
+            if (oc == MOVE) m.Reg[REG_I1] = MIXAddr(2000);
+            in.op(m, in);
+            m.programCounter = 100;                   // (jumps)
+            m.stop = Stop::Running;                   // (HLT)
+        }
+        ns.push_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count() / n);
+        sink = m.Reg[REG_A].w ^ m.Reg[REG_X].w;
+        m.Reg[REG_A].w = 0123;
+        m.Reg[REG_X].w = 04567;
+    }
+    report("handler/" + name, n, ns);
+}
+
+void benchHandlers(MIXMachine &m)
+{
+    static const char *const regs = "A123456X";
+    static const int fields[] = {5, 13, 27, 2}; // (0:5) (1:5) (3:3) (0:2)
+    static const char *const fieldNames[] = {"(0:5)", "(1:5)", "(3:3)", "(0:2)"};
+    auto withFields = [&](Opcode oc, const std::string &mnemonic) {
+        for (int f = 0; f < 4; f++) benchHandler(m, mnemonic + fieldNames[f], oc, 1000, fields[f]);
+    };
+
+    benchHandler(m, "NOP", NOP, 0, 0);
+    withFields(ADD, "ADD");
+    withFields(SUB, "SUB");
+    withFields(MUL, "MUL");
+    withFields(DIV, "DIV");
+    benchHandler(m, "NUM", NUM, 0, 0);
+    benchHandler(m, "CHAR", CHAR, 0, 1);
+    benchHandler(m, "HLT", HLT, 0, 2);
+    static const char *const shifts[] = {"SLA", "SRA", "SLAX", "SRAX", "SLC", "SRC"};
+    for (int f = 0; f < 6; f++) benchHandler(m, std::string(shifts[f]) + " 1", SLA, 1, f);
+    benchHandler(m, "MOVE F=1", MOVE, 1000, 1);
+    benchHandler(m, "MOVE F=10", MOVE, 1000, 10);
+    benchHandler(m, "MOVE F=63", MOVE, 1000, 63);
+    for (int r = 0; r < 8; r++) {
+        withFields(Opcode(LDA + r), std::string("LD") + regs[r]);
+        withFields(Opcode(LDAN + r), std::string("LD") + regs[r] + "N");
+    }
+    for (int r = 0; r < 8; r++) withFields(Opcode(STA + r), std::string("ST") + regs[r]);
+    withFields(STJ, "STJ");
+    withFields(STZ, "STZ");
+    static const char *const jumps[] = {"JMP", "JSJ", "JOV", "JNOV", "JL", "JE", "JG", "JGE", "JNE", "JLE"};
+    for (int f = 0; f < 10; f++) benchHandler(m, jumps[f], JMP, 200, f);
+    static const char *const conditions[] = {"N", "Z", "P", "NN", "NZ", "NP"};
+    for (int r = 0; r < 8; r++) {
+        for (int f = 0; f < 6; f++) benchHandler(m, std::string("J") + regs[r] + conditions[f], Opcode(JAN + r), 200, f);
+    }
+    static const char *const transfers[] = {"INC", "DEC", "ENT", "ENN"};
+    for (int r = 0; r < 8; r++) {
+        for (int f = 0; f < 4; f++) benchHandler(m, transfers[f] + std::string(1, regs[r]), Opcode(INCA + r), 1, f);
+    }
+    for (int r = 0; r < 8; r++) {
+        for (int f = 0; f < 3; f++) benchHandler(m, std::string("CMP") + regs[r] + fieldNames[f], Opcode(CMPA + r), 1000, fields[f]);
+    }
+}
+
+// ---- programs
+
+struct Program {
+    const char *name;
+    const char *source;
+    std::function<void(MIXMachine&)> setUp; // the data, before each run
+    std::function<bool(const MIXMachine&)> check;
+};
+
+// Program P of TAOCP 1.3.2, up to the table of primes (the printing is left out)
+const char *const programP =
+    "L       EQU  500\n"
+    "PRIME   EQU  -1\n"
+    "        ORIG PRIME+1\n"
+    "        CON  2\n"
+    "        ORIG 3000\n"
+    "START   LD1  =1-L=\n"
+    "        LD2  =3=\n"
+    "2H      INC1 1\n"
+    "        ST2  PRIME+L,1\n"
+    "        J1Z  2F\n"
+    "4H      INC2 2\n"
+    "        ENT3 2\n"
+    "6H      ENTA 0\n"
+    "        ENTX 0,2\n"
+    "        DIV  PRIME,3\n"
+    "        JXZ  4B\n"
+    "        CMPA PRIME,3\n"
+    "        INC3 1\n"
+    "        JG   6B\n"
+    "        JMP  2B\n"
+    "2H      HLT\n"
+    "        END  START\n";
+
+// Program M of TAOCP 1.3.2, called 100 times on X[1..1000]
+const char *const programM =
+    "X       EQU  1000\n"
+    "N       EQU  1000\n"
+    "        ORIG 3000\n"
+    "MAXIMUM STJ  EXIT\n"
+    "INIT    ENT3 0,1\n"
+    "        JMP  CHANGEM\n"
+    "LOOP    CMPA X,3\n"
+    "        JGE  *+3\n"
+    "CHANGEM ENT2 0,3\n"
+    "        LDA  X,3\n"
+    "        DEC3 1\n"
+    "        J3P  LOOP\n"
+    "EXIT    JMP  *\n"
+    "START   ENT4 100\n"
+    "1H      ENT1 N\n"
+    "        JMP  MAXIMUM\n"
+    "        DEC4 1\n"
+    "        J4P  1B\n"
+    "        HLT\n"
+    "        END  START\n";
+
+// Program S of TAOCP 5.2.1, on K[1..500]
+const char *const programS =
+    "N       EQU  500\n"
+    "INPUT   EQU  1000\n"
+    "        ORIG 3000\n"
+    "START   ENT1 2-N\n"
+    "2H      LDA  INPUT+N,1\n"
+    "        ENT2 N-1,1\n"
+    "3H      CMPA INPUT,2\n"
+    "        JGE  5F\n"
+    "4H      LDX  INPUT,2\n"
+    "        STX  INPUT+1,2\n"
+    "        DEC2 1\n"
+    "        J2P  3B\n"
+    "5H      STA  INPUT+1,2\n"
+    "        INC1 1\n"
+    "        J1NP 2B\n"
+    "        HLT\n"
+    "        END  START\n";
+
+// a = a * C mod D + B, 100000 times
+const char *const arithmetic =
+    "A       EQU  2000\n"
+    "B       EQU  2001\n"
+    "C       EQU  2002\n"
+    "D       EQU  2003\n"
+    "        ORIG 3000\n"
+    "START   ENT2 100\n"
+    "1H      ENT1 1000\n"
+    "2H      LDA  A\n"
+    "        MUL  C\n"
+    "        DIV  D\n"
+    "        STX  A\n"
+    "        LDA  A\n"
+    "        ADD  B\n"
+    "        STA  A\n"
+    "        DEC1 1\n"
+    "        J1P  2B\n"
+    "        DEC2 1\n"
+    "        J2P  1B\n"
+    "        HLT\n"
+    "        END  START\n";
+
+// the same words every time
+PackedWord key(int i)
+{
+    return static_cast<PackedWord>(i * 2654435761u >> 7) & MAG_MASK;
+}
+
+std::vector<Program> programs()
+{
+    std::vector<Program> p;
+    p.push_back(Program{"primes", programP, [](MIXMachine&) {},
+        [](const MIXMachine &m) { return m.Memory[499].w == 3571; }});
+    p.push_back(Program{"maximum", programM,
+        [](MIXMachine &m) {
+            for (int i = 1; i <= 1000; i++) {
+                m.Memory[1000 + i].w = key(i);
+                invalidateDecoded(m, 1000 + i);
+            }
+        },
+        [](const MIXMachine &m) {
+            int j = 1;
+            for (int i = 2; i <= 1000; i++) if (key(i) > key(j)) j = i;
+            return m.Reg[REG_A].w == key(j) && packedValue(m.Reg[REG_I2].w) == j;
+        }});
+    p.push_back(Program{"insertion-sort", programS, p[1].setUp,
+        [](const MIXMachine &m) {
+            std::vector<PackedWord> keys;
+            for (int i = 1; i <= 500; i++) keys.push_back(key(i));
+            std::sort(keys.begin(), keys.end());
+            for (int i = 1; i <= 500; i++) if (m.Memory[1000 + i].w != keys[i-1]) return false;
+            return true;
+        }});
+    p.push_back(Program{"arithmetic", arithmetic,
+        [](MIXMachine &m) {
+            const PackedWord words[] = {1, 7, 12345, 1000003};
+            for (int i = 0; i < 4; i++) {
+                m.Memory[2000 + i].w = words[i];
+                invalidateDecoded(m, 2000 + i);
+            }
+        },
+        [](const MIXMachine &m) {
+            long long a = 1;
+            for (int i = 0; i < 100000; i++) a = a * 12345 % 1000003 + 7;
+            return packedValue(m.Memory[2000].w) == a;
+        }});
+    return p;
+}
+
+// run the program over and over for about 20 ms (2 with --quick) of each
+// repeat on engine e; false if it went wrong
+bool benchProgram(const Program &p, const MachineImage &image, Engine e, const char *engine)
+{
+    std::string name = std::string("program/") + p.name + "/" + engine;
+    if (!wanted(name)) return true;
+    MIXMachine m;
+    restoreState(m, image);
+    p.setUp(m);
+    long long instructions = 0;
+    if (runCounted(m, 0, instructions) != Stop::Halted || !p.check(m)) {
+        std::fprintf(stderr, "%s: %s", name.c_str(), stopMessage(m).c_str());
+        return false;
+    }
+    long long runs = std::max(1LL, 2000000LL * scale / instructions);
+    std::vector<double> ns;
+    for (int r = 0; r < repeats; r++) {
+        double total = 0;
+        for (long long i = 0; i < runs; i++) {
+            m.reset();
+            m.programCounter = image.programCounter;
+            p.setUp(m);
+            Clock::time_point start = Clock::now();
+            run(m, e);
+            total += std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        }
+        if (m.stop != Stop::Halted || !p.check(m)) {
+            std::fprintf(stderr, "%s: wrong result\n", name.c_str());
+            return false;
+        }
+        ns.push_back(total / (runs * instructions));
+    }
+    report(name, instructions, ns);
+    return true;
+}
+
+bool benchPrograms()
+{
+    bool ok = true;
+    for (const Program &p : programs()) {
+        std::unique_ptr<MachineImage> image(new MachineImage());
+        std::vector<AssemblyError> errors;
+        if (!assemble(p.source, std::strlen(p.source), *image, errors)) {
+            for (const AssemblyError &e : errors) std::fprintf(stderr, "%s:%d: %s\n", p.name, e.line, e.message.c_str());
+            return false;
+        }
+        ok &= benchProgram(p, *image, Engine::Table, "table");
+        if (haveThreadedEngine()) ok &= benchProgram(p, *image, Engine::Threaded, "threaded");
+        if (haveJit()) ok &= benchProgram(p, *image, Engine::Jit, "jit");
+    }
+    return ok;
+}
+
+// ---- comparison with a baseline
+
+// the names and ns an instruction of an earlier output
+bool readBaseline(const char *path, std::map<std::string, double> &baseline)
+{
+    std::ifstream in(path);
+    if (!in) return false;
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t name = line.find("\"name\":\""), ns = line.find("\"ns_per_instruction\":");
+        if (name == std::string::npos || ns == std::string::npos) continue;
+        name += 8;
+        baseline[line.substr(name, line.find('"', name) - name)] = std::atof(line.c_str() + ns + 21);
+    }
+    return true;
+}
+
+// 0 if nothing is slower than tolerance percent, 1 otherwise
+int compare(const std::map<std::string, double> &baseline, double tolerance)
+{
+    int slower = 0;
+    for (const auto &r : results) {
+        auto b = baseline.find(r.first);
+        if (b == baseline.end() || b->second <= 0) continue;
+        double change = 100 * (r.second - b->second) / b->second;
+        if (change > tolerance) {
+            std::fprintf(stderr, "%s: %.3f ns, was %.3f ns (%+.1f%%)\n", r.first.c_str(), r.second, b->second, change);
+            slower++;
+        }
+    }
+    std::fprintf(stderr, "%d of %zu benchmarks more than %.0f%% slower than the baseline\n",
+                 slower, results.size(), tolerance);
+    return slower ? 1 : 0;
+}
+
+} // namespace
+
+int main(int argc, const char *argv[])
+{
+    const char *baselinePath = nullptr;
+    double tolerance = 10;
+    for (int i = 1; i < argc; i++) {
+        if (std::strncmp(argv[i], "--repeat=", 9) == 0) repeats = std::max(1, std::atoi(argv[i] + 9));
+        else if (std::strcmp(argv[i], "--quick") == 0) scale = 1;
+        else if (std::strncmp(argv[i], "--filter=", 9) == 0) filter = argv[i] + 9;
+        else if (std::strncmp(argv[i], "--baseline=", 11) == 0) baselinePath = argv[i] + 11;
+        else if (std::strncmp(argv[i], "--tolerance=", 12) == 0) tolerance = std::atof(argv[i] + 12);
+        else {
+            std::fprintf(stderr, "usage: %s [--repeat=n] [--quick] [--filter=text] [--baseline=file [--tolerance=percent]]\n", argv[0]);
+            return 2;
+        }
+    }
+    std::map<std::string, double> baseline;
+    if (baselinePath && !readBaseline(baselinePath, baseline)) {
+        std::fprintf(stderr, "Cannot read %s.\n", baselinePath);
+        return 2;
+    }
+
+    MIXMachine m;
+    // small words, so that every field of them fits an index register
+    for (int i = 0; i < ADDR_CAP; i++) m.Memory[i].w = (i & 1 ? SIGN_BIT : 0) | (i * 37 & 07777);
+    benchHandlers(m);
+    if (!benchPrograms()) return 2;
+    return baselinePath ? compare(baseline, tolerance) : 0;
+}
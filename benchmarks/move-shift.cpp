@@ -0,0 +1,139 @@
+//
+//  move-shift.cpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+// microbenchmarks of MOVE and the shifts: each handler on its own, for
+// large and small F and every shift, and then a MIX loop made of them run
+// by the threaded engine. MOVE is also timed against a copy one word at a
+// time, the way the handler would go without block copies. build from this
+// directory with
+//
+//     c++ -O2 -std=c++11 -pthread -I../mix-simulator -o move-shift move-shift.cpp
+//         ../mix-simulator/{mix,mixop-table,interpreter,threaded,jit,devices,debugger}.cpp
+//
+// (all on one line).
+
+#include "mix.h"
+#include "mixop-table.hpp"
+#include "interpreter.hpp"
+#include <chrono>
+#include <cstdio>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+volatile PackedWord sink; // keeps the results alive
+
+MIXInstr instruction(Opcode oc, int addr, int field)
+{
+    MIXInstr in = MIXInstr();
+    decodeWord(MIXWord(MIXAddr(addr), 0, static_cast<MIXByte>(field), oc).w, in);
+    return in;
+}
+
+double nanoseconds(Clock::time_point start, long long n)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / n;
+}
+
+// MOVE of F words from 1000 to to, over and over
+void benchMove(MIXMachine &m, int field, int to, const char *what)
+{
+    const long long n = 2000000;
+    MIXInstr in = instruction(MOVE, 1000, field);
+    Clock::time_point start = Clock::now();
+    for (long long i = 0; i < n; i++) {
+        m.Reg[REG_I1] = MIXAddr(to);
+        move(m, in);
+    }
+    double ns = nanoseconds(start, n);
+    sink = m.Memory[to].w;
+
+    // the same words copied one by one (with the same overlap)
+    start = Clock::now();
+    for (long long i = 0; i < n; i++) {
+        for (int j = 0; j < field; j++) {
+            m.Memory[to + j] = m.Memory[1000 + j];
+            invalidateDecoded(m, to + j);
+        }
+        sink = m.Memory[to].w;
+    }
+    double perWord = nanoseconds(start, n);
+    std::printf("MOVE  F=%-2d %-11s %8.2f ns  (%.2f ns a word; one by one %8.2f ns)\n",
+                field, what, ns, ns / field, perWord);
+}
+
+void benchShift(MIXMachine &m, int field, int count)
+{
+    static const char *const names[6] = {"SLA", "SRA", "SLAX", "SRAX", "SLC", "SRC"};
+    const long long n = 20000000;
+    MIXInstr in = instruction(SLA, count, field);
+    m.Reg[REG_A].w = 01234567012;
+    m.Reg[REG_X].w = SIGN_BIT | 07654321076;
+    Clock::time_point start = Clock::now();
+    for (long long i = 0; i < n; i++) {
+        shift(m, in);
+        m.Reg[REG_A].w |= 1; // (so that nothing shifts down to a constant)
+    }
+    double ns = nanoseconds(start, n);
+    sink = m.Reg[REG_A].w ^ m.Reg[REG_X].w;
+    std::printf("%-4s  %-2d %23.2f ns\n", names[field], count, ns);
+}
+
+// a loop of MOVEs and shifts, 4000 times:
+//
+//     0  ENT6 4000       5  SLC 3
+//     1  ENT1 2000       6  SRAX 2
+//     2  MOVE 1000(63)   7  DEC6 1
+//     3  SLA 1           8  J6P 1
+//     4  SRC 7           9  HLT
+void benchProgram(MIXMachine &m)
+{
+    const PackedWord program[] = {
+        MIXWord(MIXAddr(4000), 0, 2, ENT6).w, MIXWord(MIXAddr(2000), 0, 2, ENT1).w,
+        MIXWord(MIXAddr(1000), 0, 63, MOVE).w, MIXWord(MIXAddr(1), 0, 0, SLA).w,
+        MIXWord(MIXAddr(7), 0, 5, SRC).w, MIXWord(MIXAddr(3), 0, 4, SLC).w,
+        MIXWord(MIXAddr(2), 0, 3, SRAX).w, MIXWord(MIXAddr(1), 0, 1, DEC6).w,
+        MIXWord(MIXAddr(1), 0, 2, J6P).w, MIXWord(MIXAddr(0), 0, 2, HLT).w};
+    const int length = sizeof program / sizeof program[0];
+    for (int i = 0; i < length; i++) {
+        m.Memory[i].w = program[i];
+        invalidateDecoded(m, i);
+    }
+    const int runs = 200;
+    Clock::time_point start = Clock::now();
+    for (int r = 0; r < runs; r++) {
+        m.reset();
+        if (runThreaded(m) != Stop::Halted) std::printf("%s\n", stopMessage(m).c_str());
+    }
+    long long instructions = runs * (1 + 4000LL * 8 + 1);
+    double ns = nanoseconds(start, instructions);
+    std::printf("loop of MOVE F=63 and shifts %10.2f ns an instruction (%.0f MIPS)\n", ns, 1000 / ns);
+}
+
+} // namespace
+
+int main()
+{
+    MIXMachine m;
+    for (int i = 0; i < ADDR_CAP; i++) m.Memory[i].w = static_cast<PackedWord>(i * 2654435761u) & MAG_MASK;
+
+    std::printf("handler   M (or rI1)                 time\n");
+    static const int fields[] = {1, 8, 32, 63};
+    for (int f : fields) {
+        benchMove(m, f, 2000, "apart");
+        benchMove(m, f, 1001, "up by 1");  // fills with the word at 1000
+        benchMove(m, f, 1000 + f/2 + 1, "up by F/2");
+        benchMove(m, f, 999, "down by 1");
+    }
+    static const int counts[] = {1, 4, 9, 13};
+    for (int f = 0; f < 6; f++) {
+        for (int c : counts) benchShift(m, f, c);
+    }
+    benchProgram(m);
+    return 0;
+}
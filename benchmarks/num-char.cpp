@@ -0,0 +1,178 @@
+//
+//  num-char.cpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+// throughput of NUM and CHAR: the handler (two digits a step, by table)
+// against the obvious conversion a byte and a digit at a time, and then a
+// MIX loop that converts numbers back and forth, run by the threaded
+// engine. the handler is checked against the obvious conversion first.
+// build from this directory with
+//
+//     c++ -O2 -std=c++11 -pthread -I../mix-simulator -o num-char num-char.cpp
+//         ../mix-simulator/{mix,mixop-table,interpreter,threaded,jit,devices,debugger}.cpp
+//
+// (all on one line).
+
+#include "mix.h"
+#include "mixop-table.hpp"
+#include "interpreter.hpp"
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+volatile PackedWord sink; // keeps the results alive
+
+MIXInstr instruction(Opcode oc, int addr, int field)
+{
+    MIXInstr in = MIXInstr();
+    decodeWord(MIXWord(MIXAddr(addr), 0, static_cast<MIXByte>(field), oc).w, in);
+    return in;
+}
+
+double nanoseconds(Clock::time_point start, long long n)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / n;
+}
+
+// NUM and CHAR one byte (one digit) at a time
+void slowNum(MIXMachine &m)
+{
+    unsigned long long val = 0;
+    for (int j = 0; j < 5; j++) val = val*10 + m.Reg[REG_A].byte(j) % 10;
+    for (int j = 0; j < 5; j++) val = val*10 + m.Reg[REG_X].byte(j) % 10;
+    m.Reg[REG_A].w = (m.Reg[REG_A].w & SIGN_BIT) | static_cast<PackedWord>(val & MAG_MASK);
+}
+
+void slowChar(MIXMachine &m)
+{
+    unsigned val = m.Reg[REG_A].w & MAG_MASK;
+    for (int j = 4; j >= 0; j--) {
+        m.Reg[REG_X].setByte(j, 30 + val % 10);
+        val /= 10;
+    }
+    for (int j = 4; j >= 0; j--) {
+        m.Reg[REG_A].setByte(j, 30 + val % 10);
+        val /= 10;
+    }
+}
+
+bool check()
+{
+    std::mt19937 rng(1);
+    MIXInstr num = instruction(NUM, 0, 0), chr = instruction(CHAR, 0, 1);
+    MIXMachine a, b;
+    for (int i = 0; i < 1000000; i++) {
+        a.Reg[REG_A].w = b.Reg[REG_A].w = rng() & (SIGN_BIT | MAG_MASK);
+        a.Reg[REG_X].w = b.Reg[REG_X].w = rng() & (SIGN_BIT | MAG_MASK);
+        if (i & 1) {
+            numChar(a, num);
+            slowNum(b);
+        } else {
+            numChar(a, chr);
+            slowChar(b);
+        }
+        if (a.Reg[REG_A].w != b.Reg[REG_A].w || a.Reg[REG_X].w != b.Reg[REG_X].w) {
+            std::printf("%s of %o %o is wrong\n", i & 1 ? "NUM" : "CHAR", b.Reg[REG_A].w, b.Reg[REG_X].w);
+            return false;
+        }
+    }
+    return true;
+}
+
+// convert the same numbers with the handler and the slow way: CHAR of
+// numbers of every size, NUM of the characters that gives
+void benchConversions(MIXMachine &m)
+{
+    const int n = 10000000;
+    const MIXInstr num = instruction(NUM, 0, 0), chr = instruction(CHAR, 0, 1);
+    std::mt19937 rng(2);
+    static PackedWord values[1024], charsA[1024], charsX[1024];
+    for (int i = 0; i < 1024; i++) {
+        values[i] = (rng() & MAG_MASK) >> (rng() % 30);
+        m.Reg[REG_A].w = values[i];
+        numChar(m, chr);
+        charsA[i] = m.Reg[REG_A].w;
+        charsX[i] = m.Reg[REG_X].w;
+    }
+
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < n; i++) {
+        m.Reg[REG_A].w = values[i & 1023];
+        numChar(m, chr);
+        sink = m.Reg[REG_A].w ^ m.Reg[REG_X].w;
+    }
+    double fast = nanoseconds(start, n);
+    start = Clock::now();
+    for (int i = 0; i < n; i++) {
+        m.Reg[REG_A].w = values[i & 1023];
+        slowChar(m);
+        sink = m.Reg[REG_A].w ^ m.Reg[REG_X].w;
+    }
+    std::printf("CHAR  %8.2f ns  (a digit at a time %8.2f ns)\n", fast, nanoseconds(start, n));
+
+    start = Clock::now();
+    for (int i = 0; i < n; i++) {
+        m.Reg[REG_A].w = charsA[i & 1023];
+        m.Reg[REG_X].w = charsX[i & 1023];
+        numChar(m, num);
+        sink = m.Reg[REG_A].w;
+    }
+    fast = nanoseconds(start, n);
+    start = Clock::now();
+    for (int i = 0; i < n; i++) {
+        m.Reg[REG_A].w = charsA[i & 1023];
+        m.Reg[REG_X].w = charsX[i & 1023];
+        slowNum(m);
+        sink = m.Reg[REG_A].w;
+    }
+    std::printf("NUM   %8.2f ns  (a byte at a time  %8.2f ns)\n", fast, nanoseconds(start, n));
+}
+
+// the inner loop of a program printing numbers, 4000 times:
+//
+//     0  ENT6 4000       4  STX 1001
+//     1  ENTA 0,6        5  NUM
+//     2  CHAR            6  DEC6 1
+//     3  STA 1000        7  J6P 1
+//                        8  HLT
+void benchProgram(MIXMachine &m)
+{
+    const PackedWord program[] = {
+        MIXWord(MIXAddr(4000), 0, 2, ENT6).w, MIXWord(MIXAddr(0), 6, 2, ENTA).w,
+        MIXWord(MIXAddr(0), 0, 1, CHAR).w, MIXWord(MIXAddr(1000), 0, 5, STA).w,
+        MIXWord(MIXAddr(1001), 0, 5, STX).w, MIXWord(MIXAddr(0), 0, 0, NUM).w,
+        MIXWord(MIXAddr(1), 0, 1, DEC6).w, MIXWord(MIXAddr(1), 0, 2, J6P).w,
+        MIXWord(MIXAddr(0), 0, 2, HLT).w};
+    const int length = sizeof program / sizeof program[0];
+    for (int i = 0; i < length; i++) {
+        m.Memory[i].w = program[i];
+        invalidateDecoded(m, i);
+    }
+    const int runs = 500;
+    Clock::time_point start = Clock::now();
+    for (int r = 0; r < runs; r++) {
+        m.reset();
+        if (runThreaded(m) != Stop::Halted) std::printf("%s\n", stopMessage(m).c_str());
+    }
+    long long instructions = runs * (1 + 4000LL * 7 + 1);
+    double ns = nanoseconds(start, instructions);
+    std::printf("loop of CHAR and NUM %18.2f ns an instruction (%.0f MIPS)\n", ns, 1000 / ns);
+}
+
+} // namespace
+
+int main()
+{
+    if (!check()) return 1;
+    MIXMachine m;
+    benchConversions(m);
+    benchProgram(m);
+    return 0;
+}
@@ -0,0 +1,415 @@
+//
+//  aot.cpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+// ahead-of-time translator: writes the program in memory out as C++, one
+// basic block per label, with every instruction a call of its handler on a
+// constant MIXInstr (so the compiler folds the field, register and address
+// lookups away) and jumps with constant targets turned into gotos.
+//
+// only words reachable from where the program starts (the location it was
+// loaded or assembled with) are translated. jumps to computed
+// locations go through a switch on the block leaders. a store into a
+// translated word marks its block dirty: dirty blocks (and anything that was
+// not translated) run in the interpreter, which hands back to native code at
+// the next clean block leader. stores of a constant location into the
+// address field of an instruction (STJ into the exit of a subroutine) are
+// expected, and that instruction takes its address from memory at run time.
+// I/O instructions are left to the interpreter, which also notes the words
+// that input brings in like stores.
+
+#include "aot.hpp"
+#include <ostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+namespace {
+
+// words whose address field is filled in at run time depend on the rest only
+constexpr PackedWord ALL_BITS = SIGN_BIT | MAG_MASK;
+constexpr PackedWord NON_ADDR_BITS = MAG_MASK & ~(ADDR_MASK << 18);
+
+const char *handlerName(MIXOp op)
+{
+    static const struct { MIXOp op; const char *name; } handlers[] = {
+        {&nop, "nop"}, {&add, "add"}, {&sub, "sub"}, {&mul, "mul"}, {&div, "div"},
+        {&numChar, "numChar"}, {&shift, "shift"}, {&move, "move"},
+        {&load, "load"}, {&store, "store"}, {&jump, "jump"}, {&jumpRegCond, "jumpRegCond"},
+        {&immed, "immed"}, {&compare, "compare"}};
+    for (const auto &h : handlers) {
+        if (h.op == op) return h.name;
+    }
+    return "nullfunc";
+}
+
+bool isJump(const MIXInstr &in)
+{
+    return in.oc >= JMP && in.oc <= JXN;
+}
+
+bool isIO(const MIXInstr &in)
+{
+    return in.oc >= JBUS && in.oc <= JRED;
+}
+
+// a jump whose condition field is not valid goes to nullfunc
+bool badJump(const MIXInstr &in)
+{
+    return isJump(in) && in.field > (in.oc == JMP ? 9 : 5);
+}
+
+// true if execution can continue with the next word
+bool fallsThrough(const MIXInstr &in)
+{
+    if (in.oc == JMP && in.field <= 1 && !badJump(in)) return false; // JMP, JSJ
+    if (in.oc == HLT && in.field == 2) return false;
+    return true;
+}
+
+// true if the handler may stop the machine (or report programCounter). an
+// operand faults outside memory, so only a constant one in memory cannot
+bool mayStop(const MIXInstr &in, bool dynamicAddress)
+{
+    bool operand = in.op == opTable[in.oc]
+        && ((in.oc >= ADD && in.oc <= DIV) || (in.oc >= LDA && in.oc <= STZ) || in.oc >= CMPA);
+    if (operand && (in.index != 0 || dynamicAddress || in.addr < 0 || in.addr >= ADDR_CAP)) return true;
+    if (in.op == &load) {
+        return registerMask[in.variant & REGISTER_BITS] != MAG_MASK; // index registers fault on big values
+    }
+    return in.op == &numChar || in.op == &shift || in.op == &move
+        || in.op == &nullfunc || badJump(in);
+}
+
+class Translator {
+public:
+    explicit Translator(MIXMachine &m) :m(m), entry(m.programCounter) {}
+    void analyze();
+    void write(std::ostream &os);
+
+private:
+    MIXMachine &m;
+    int entry;                   // where the program starts
+    bool code[ADDR_CAP] = {};    // translated
+    bool leader[ADDR_CAP] = {};  // start of a basic block
+    bool dynAddr[ADDR_CAP] = {}; // address field set at run time
+    short blockOf[ADDR_CAP];
+    std::vector<short> blockStart, blockEnd;
+
+    void reach();
+    void findDynamicAddresses();
+    void findBlocks();
+    PackedWord fixedBits(int loc) const;
+
+    void writeTable(std::ostream &os, const char *decl, int n, long (Translator::*value)(int) const);
+    long imageWord(int loc) const { return m.Memory[loc].w; }
+    long fixedWord(int loc) const { return fixedBits(loc); }
+    long blockWord(int loc) const { return blockOf[loc]; }
+    long startWord(int b) const { return blockStart[b]; }
+    long endWord(int b) const { return blockEnd[b]; }
+
+    void writeInstruction(std::ostream &os, int loc);
+    void writeTarget(std::ostream &os, const MIXInstr &in, const char *name);
+};
+
+// mark the words reachable from the entry, and the leaders among them
+void Translator::reach()
+{
+    for (int i = 0; i < ADDR_CAP; i++) code[i] = leader[i] = false;
+    std::vector<bool> seen(ADDR_CAP);
+    std::vector<int> work;
+    // (a program that starts outside memory faults at once)
+    if (static_cast<unsigned>(entry) < ADDR_CAP) {
+        work.push_back(entry);
+        leader[entry] = true;
+    }
+    while (!work.empty()) {
+        int loc = work.back();
+        work.pop_back();
+        if (seen[loc]) continue;
+        seen[loc] = true;
+        decodeInstruction(m, loc);
+        const MIXInstr &in = m.Decoded[loc];
+
+        if (isIO(in)) {
+            // interpreted: native code goes on after it, and at the target of JBUS and JRED
+            if (loc+1 < ADDR_CAP) {
+                leader[loc+1] = true;
+                work.push_back(loc+1);
+            }
+            int target = in.addr;
+            if ((in.oc == JBUS || in.oc == JRED) && in.index == 0 && target >= 0 && target < ADDR_CAP) {
+                leader[target] = true;
+                work.push_back(target);
+            }
+            continue;
+        }
+        code[loc] = true;
+        if (fallsThrough(in) && loc+1 < ADDR_CAP) work.push_back(loc+1);
+        if (isJump(in) && !badJump(in)) {
+            // the word after a jump that saves rJ is where a subroutine returns
+            if (loc+1 < ADDR_CAP) {
+                leader[loc+1] = true;
+                if (!(in.oc == JMP && in.field == 1)) work.push_back(loc+1);
+            }
+            int target = in.addr;
+            if (in.index == 0 && !dynAddr[loc] && target >= 0 && target < ADDR_CAP) {
+                leader[target] = true;
+                work.push_back(target);
+            }
+        }
+    }
+}
+
+// stores of a constant location into (part of) the sign and address of a
+// translated word leave the rest of the word alone
+void Translator::findDynamicAddresses()
+{
+    for (int loc = 0; loc < ADDR_CAP; loc++) {
+        const MIXInstr &in = m.Decoded[loc];
+        if (!code[loc] || in.op != &store || in.index != 0) continue;
+        int L = in.field/8, R = in.field%8;
+        if (in.addr >= 0 && in.addr < ADDR_CAP && code[in.addr] && L <= R && R <= 2)
+            dynAddr[in.addr] = true;
+    }
+}
+
+// split the translated words into basic blocks
+void Translator::findBlocks()
+{
+    blockStart.clear();
+    blockEnd.clear();
+    for (int loc = 0; loc < ADDR_CAP; loc++) {
+        blockOf[loc] = -1;
+        if (!code[loc]) continue;
+        if (loc == 0 || !code[loc-1] || !fallsThrough(m.Decoded[loc-1])) leader[loc] = true;
+        if (leader[loc]) {
+            blockStart.push_back(loc);
+            blockEnd.push_back(loc);
+        }
+        blockOf[loc] = static_cast<short>(blockStart.size() - 1);
+        blockEnd.back() = loc+1;
+    }
+}
+
+void Translator::analyze()
+{
+    reach();
+    findDynamicAddresses();
+    // the old targets of run-time addresses need not be code after all
+    reach();
+    for (int loc = 0; loc < ADDR_CAP; loc++) dynAddr[loc] = false;
+    findDynamicAddresses();
+    findBlocks();
+}
+
+PackedWord Translator::fixedBits(int loc) const
+{
+    if (!code[loc]) return 0;
+    return dynAddr[loc] ? NON_ADDR_BITS : ALL_BITS;
+}
+
+void Translator::writeTable(std::ostream &os, const char *decl, int n,
+                            long (Translator::*value)(int) const)
+{
+    os << "static " << decl << " = {";
+    for (int i = 0; i < n; i++) {
+        if (i % 12 == 0) os << "\n   ";
+        os << ' ' << (this->*value)(i) << (i+1 < n ? "," : "");
+    }
+    os << "};\n";
+}
+
+// go to the target of the jump in (after saving rJ)
+void Translator::writeTarget(std::ostream &os, const MIXInstr &in, const char *name)
+{
+    if (in.index != 0 || dynAddr[&in - m.Decoded]) {
+        os << "m.programCounter = effectiveAddress(m, " << name << "); goto dispatch;";
+    } else if (in.addr < 0 || in.addr >= ADDR_CAP) {
+        os << "return fetchFault(m, " << in.addr << ");";
+    } else if (!code[in.addr]) {
+        os << "m.programCounter = " << in.addr << "; goto dispatch;"; // (I/O, interpreted)
+    } else {
+        os << "goto L" << in.addr << ";";
+    }
+}
+
+void Translator::writeInstruction(std::ostream &os, int loc)
+{
+    const MIXInstr &in = m.Decoded[loc];
+    std::string name = "I";
+    name += std::to_string(loc);
+
+    if (leader[loc]) {
+        int b = blockOf[loc];
+        os << "\n    // block " << b << ": " << blockStart[b] << " to " << blockEnd[b]-1 << "\n"
+           << "L" << loc << ":\n"
+           << "    if (blockDirty[" << b << "]) { m.programCounter = " << loc << "; goto interpret; }\n";
+    }
+    os << "    // " << std::setw(4) << std::setfill('0') << loc << ": " << m.Memory[loc]
+       << std::setfill(' ') << "\n    ";
+    if (dynAddr[loc]) {
+        os << "{ const MIXInstr &" << name << " = aotFetch(m, " << loc << "); ";
+    } else {
+        os << "{ ";
+    }
+    bool stops = mayStop(in, dynAddr[loc]);
+    if (stops) os << "m.programCounter = " << loc << "; ";
+
+    const char *n = name.c_str();
+    if (badJump(in) || in.op == &nullfunc) {
+        os << "nullfunc(m, " << n << ");";
+    } else if (in.oc == JMP && in.field <= 1) {
+        if (in.field == 0) os << "m.Reg[REG_J] = MIXAddr(" << loc+1 << "); ";
+        writeTarget(os, in, n);
+    } else if (isJump(in)) {
+        os << "if (" << (in.oc == JMP ? "jumpCondition(m, " : "regJumpCondition(m, ") << n << ")) { "
+           << "m.Reg[REG_J] = MIXAddr(" << loc+1 << "); ";
+        writeTarget(os, in, n);
+        os << " }";
+    } else if (in.op == &store) {
+        if (in.index != 0 || dynAddr[loc]) {
+            os << "int loc = effectiveAddress(m, " << n << "); store(m, " << n << "); "
+               << "if (aotNoteStore(m, T, loc)) { m.programCounter = " << loc+1 << "; goto dispatch; }";
+        } else if (in.addr >= 0 && in.addr < ADDR_CAP && fixedBits(in.addr)) {
+            os << "store(m, " << n << "); "
+               << "if (aotNoteStore(m, T, " << in.addr << ")) { m.programCounter = " << loc+1 << "; goto dispatch; }";
+        } else {
+            os << "store(m, " << n << ");"; // data
+        }
+    } else if (in.op == &move) {
+        os << "int to = packedValue(m.Reg[REG_I1].w); move(m, " << n << ");";
+    } else if (in.op != &nop) {
+        os << handlerName(in.op) << "(m, " << n << ");";
+    }
+    if (stops) os << " if (m.stop != Stop::Running) goto stopped;";
+    if (in.op == &move && in.field) {
+        os << " if (aotNoteStores(m, T, to, to + " << int(in.field) << ")) { m.programCounter = "
+           << loc+1 << "; goto dispatch; }";
+    }
+    os << " }\n";
+
+    // running on into a word that was not translated (or off the end of memory)
+    if (fallsThrough(in) && (loc+1 == ADDR_CAP || !code[loc+1])) {
+        os << "    m.programCounter = " << loc+1 << "; goto dispatch;\n";
+    }
+}
+
+void Translator::write(std::ostream &os)
+{
+    os << "// generated by mix-simulator --aot: the program in memory, translated to C++\n"
+          "#include \"aot.hpp\"\n"
+          "#include \"devices.hpp\"\n"
+          "#include <iostream>\n\n";
+
+    writeTable(os, "const PackedWord image[ADDR_CAP]", ADDR_CAP, &Translator::imageWord);
+    writeTable(os, "const PackedWord fixedBits[ADDR_CAP]", ADDR_CAP, &Translator::fixedWord);
+    writeTable(os, "const short blockOf[ADDR_CAP]", ADDR_CAP, &Translator::blockWord);
+    int nb = static_cast<int>(blockStart.size());
+    std::string n = std::to_string(nb);
+    writeTable(os, ("const short blockStart[" + n + "]").c_str(), nb, &Translator::startWord);
+    writeTable(os, ("const short blockEnd[" + n + "]").c_str(), nb, &Translator::endWord);
+    os << "static bool blockDirty[" << n << "];\n"
+          "static const AotTables T = {image, fixedBits, blockOf, blockStart, blockEnd, blockDirty};\n\n";
+
+    // the instructions, decoded
+    for (int loc = 0; loc < ADDR_CAP; loc++) {
+        if (!code[loc] || dynAddr[loc]) continue;
+        const MIXInstr &in = m.Decoded[loc];
+        os << "static const MIXInstr I" << loc << " = {&" << handlerName(in.op) << ", "
+           << in.addr << ", " << int(in.index) << ", " << int(in.field) << ", "
+           << int(in.lo) << ", " << int(in.hi) << ", Opcode(" << int(in.oc) << "), "
+           << int(in.variant) << ", nullptr};\n";
+    }
+
+    os << "\n"
+          "static Stop runCompiled(MIXMachine &m)\n"
+          "{\n"
+          "    if (!startRun(m)) return m.stop;\n"
+          "dispatch:\n"
+          "    switch (m.programCounter) {\n";
+    for (int b = 0; b < nb; b++) {
+        os << "        case " << blockStart[b] << ": goto L" << blockStart[b] << ";\n";
+    }
+    os << "        default: break;\n"
+          "    }\n"
+          "    if (static_cast<unsigned>(m.programCounter) >= ADDR_CAP) return fetchFault(m, m.programCounter);\n"
+          "interpret:\n"
+          "    do if (!aotInterpretOne(m, T)) return m.stop; while (!aotCanEnter(T, m.programCounter));\n"
+          "    goto dispatch;\n"
+          "stopped:\n"
+          "    m.programCounter = m.stopLocation;\n"
+          "    return m.stop;\n";
+    for (int loc = 0; loc < ADDR_CAP; loc++) {
+        if (code[loc]) writeInstruction(os, loc);
+    }
+    // (every translated word jumps or goes on to another, so this is not
+    // reached, but the compiler cannot tell)
+    os << "    return m.stop;\n"
+          "}\n\n";
+
+    os << "int main()\n"
+          "{\n"
+          "    static MIXMachine m;\n"
+          "    for (int i = 0; i < ADDR_CAP; i++) m.Memory[i].w = image[i];\n"
+          "    m.programCounter = " << entry << ";\n"
+          "    attachDevices(m, DeviceFiles());\n"
+          "    runCompiled(m);\n"
+          "    finishIO(m);\n"
+          "    std::cerr << stopMessage(m);\n"
+          "    dumpState(std::cout, m);\n"
+          "    return 0;\n"
+          "}\n";
+}
+
+// the language standard of the project (CMakeLists.txt and the Xcode
+// project), which the generated program is compiled with as well
+const char *const standard = "-std=gnu++20";
+
+// the simulator sources the generated program is linked with
+const char *const runtimeSources[] = {
+    "mix.cpp", "mixop-table.cpp", "interpreter.cpp", "threaded.cpp", "jit.cpp", "devices.cpp", "debugger.cpp"};
+
+std::string sourceDir()
+{
+#ifdef MIX_SOURCE_DIR
+    return MIX_SOURCE_DIR;
+#else
+    std::string f = __FILE__;
+    size_t slash = f.find_last_of('/');
+    return slash == std::string::npos ? "." : f.substr(0, slash);
+#endif
+}
+
+} // namespace
+
+void translateImage(std::ostream &os, MIXMachine &m)
+{
+    Translator *t = new Translator(m); // (a few tables of ADDR_CAP entries)
+    t->analyze();
+    t->write(os);
+    delete t;
+}
+
+int buildImage(MIXMachine &m, const char *exe)
+{
+    std::string source = std::string(exe) + ".cpp";
+    {
+        std::ofstream out(source.c_str());
+        if (!out) return -1;
+        translateImage(out, m);
+        if (!out) return -1;
+    }
+
+    const char *cxx = std::getenv("CXX");
+    std::string dir = sourceDir();
+    std::string command = std::string(cxx && *cxx ? cxx : "c++")
+        + " " + standard + " -O2 -pthread -I'" + dir + "' -o '" + exe + "' '" + source + "'";
+    for (const char *f : runtimeSources) command += " '" + dir + "/" + f + "'";
+    return std::system(command.c_str());
+}
@@ -0,0 +1,93 @@
+//
+//  aot.hpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+#ifndef aot_hpp
+#define aot_hpp
+
+#include "mix.h"
+#include "interpreter.hpp"
+#include "mixop-table.hpp"
+#include "devices.hpp"
+
+// ahead-of-time translation of the program in memory into C++ (see aot.cpp).
+// the generated source includes this header for the runtime support below.
+
+// write C++ source for the program now in the memory of m, entered where m's
+// program counter is
+void translateImage(std::ostream &os, MIXMachine &m);
+
+// translate into exe.cpp and compile that into exe with the host compiler
+// ($CXX, or c++). returns the exit status of the compiler.
+int buildImage(MIXMachine &m, const char *exe);
+
+// tables written out by the translator
+struct AotTables {
+    const PackedWord *image;     // memory as it was translated
+    const PackedWord *fixedBits; // bits of each word the native code depends on (0 for data)
+    const short *blockOf;        // block holding each word, -1 if not translated
+    const short *blockStart;     // first word of each block
+    const short *blockEnd;       // one past the last word of each block
+    bool *blockDirty;            // some word of the block no longer matches the image
+};
+
+// after a store to loc: if loc was translated, recheck its block. true if the
+// block no longer matches the image, so it has to be interpreted from now on
+inline bool aotNoteStore(MIXMachine &m, const AotTables &t, int loc)
+{
+    if (static_cast<unsigned>(loc) >= ADDR_CAP || !t.fixedBits[loc]) return false;
+    int b = t.blockOf[loc];
+    if (!t.blockDirty[b] && !((m.Memory[loc].w ^ t.image[loc]) & t.fixedBits[loc])) return false;
+
+    bool dirty = false; // (a word may also have been put back the way it was)
+    for (int i = t.blockStart[b]; i < t.blockEnd[b]; i++)
+        dirty |= ((m.Memory[i].w ^ t.image[i]) & t.fixedBits[i]) != 0;
+    t.blockDirty[b] = dirty;
+    return dirty;
+}
+
+// the same for the words [first, end) (a MOVE, or input); true if any block
+// no longer matches
+inline bool aotNoteStores(MIXMachine &m, const AotTables &t, int first, int end)
+{
+    bool dirty = false;
+    for (int i = first; i < end; i++) dirty |= aotNoteStore(m, t, i);
+    return dirty;
+}
+
+// true if native code can take over at loc
+inline bool aotCanEnter(const AotTables &t, int loc)
+{
+    int b = t.blockOf[loc];
+    return b >= 0 && t.blockStart[b] == loc && !t.blockDirty[b];
+}
+
+// run the instruction at m.programCounter with the interpreter, keeping track
+// of stores (and input) into translated code; false if the machine stopped
+inline bool aotInterpretOne(MIXMachine &m, const AotTables &t)
+{
+    const MIXInstr &in = m.Decoded[m.programCounter];
+    if (!in.op) decodeInstruction(m, m.programCounter);
+    Opcode oc = in.oc;
+    int loc = (oc >= STA && oc <= STZ) ? effectiveAddress(m, in) : -1;
+    int to = packedValue(m.Reg[REG_I1].w), count = oc == MOVE ? in.field : 0;
+    bool ok = stepTable(m);
+    if (loc >= 0 && ok) aotNoteStore(m, t, loc);
+    if (count && ok) aotNoteStores(m, t, to, to + count);
+    int first, end;
+    if (oc >= JBUS && oc <= JRED && takeInput(m, first, end)) aotNoteStores(m, t, first, end);
+    return ok;
+}
+
+// the decoded form of a word whose address field is set at run time (the
+// usual STJ into the exit of a subroutine)
+inline const MIXInstr &aotFetch(MIXMachine &m, int loc)
+{
+    if (!m.Decoded[loc].op) decodeInstruction(m, loc);
+    return m.Decoded[loc];
+}
+
+#endif /* aot_hpp */
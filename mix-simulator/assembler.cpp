@@ -0,0 +1,618 @@
+//
+//  assembler.cpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+// the first pass finds the location of every line and defines the symbols
+// in the location fields (and with EQU); the second pass evaluates the
+// addresses and puts the words into the image. lines are split into their
+// fields once, in the first pass.
+//
+// symbols and mnemonics are at most ten letters and digits, so each is
+// kept as a number in base 37 and looked up in a hash table by that.
+
+#include "assembler.hpp"
+#include "devices.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+// the encodings are those of the Opcode enum; the tables below count on
+// each family being in TAOCP order
+static_assert(LDA == 8 && LDX == LDA + 7 && LDAN == LDA + 8 && LDXN == LDAN + 7, "loads");
+static_assert(STA == 24 && STX == STA + 7 && STJ == 32 && STZ == 33, "stores");
+static_assert(JBUS == 34 && IOC == 35 && IN == 36 && OUT == 37 && JRED == 38, "I/O");
+static_assert(JMP == 39 && JAN == 40 && JXN == JAN + 7, "jumps");
+static_assert(INCA == 48 && INCX == INCA + 7 && CMPA == 56 && CMPX == CMPA + 7, "address transfers and comparisons");
+
+namespace {
+
+typedef std::uint64_t Key;
+
+constexpr long long WORD_LIMIT = 1LL << 30; // magnitudes are less than 64^5
+constexpr int MAX_ERRORS = 100;
+
+// the value of a character in a key, 0 if it cannot be part of a symbol
+inline int symbolDigit(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0' + 1;
+    if (c >= 'A' && c <= 'Z') return c - 'A' + 11;
+    return 0;
+}
+
+inline bool isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// the key of the symbol [p, end); false if it is not one (too long, or
+// with a character other than letters and digits)
+bool makeKey(const char *p, const char *end, Key &key)
+{
+    if (p == end || end - p > 10) return false;
+    key = 0;
+    for (; p < end; p++) {
+        int d = symbolDigit(*p);
+        if (!d) return false;
+        key = key * 37 + d;
+    }
+    return true;
+}
+
+enum Kind : unsigned char { Instruction, Equ, Orig, Con, Alf, End };
+
+struct OpInfo {
+    Kind kind;
+    Opcode c;
+    MIXByte f;      // the default F
+    bool fieldSpec; // F is a field (L:R) of a word of memory
+};
+
+// every mnemonic and pseudo-operation
+class OpTable {
+public:
+    OpTable()
+    {
+        const char *regs = "A123456X";
+        add("NOP", NOP, 0);
+        add("ADD", ADD, 5, true);
+        add("SUB", SUB, 5, true);
+        add("MUL", MUL, 5, true);
+        add("DIV", DIV, 5, true);
+        add("NUM", NUM, 0);
+        add("CHAR", CHAR, 1);
+        add("HLT", HLT, 2);
+        static const char *const shifts[] = {"SLA", "SRA", "SLAX", "SRAX", "SLC", "SRC"};
+        for (int f = 0; f < 6; f++) add(shifts[f], SLA, f);
+        add("MOVE", MOVE, 1);
+        for (int r = 0; r < 8; r++) {
+            std::string reg(1, regs[r]);
+            add("LD" + reg, Opcode(LDA + r), 5, true);
+            add("LD" + reg + "N", Opcode(LDAN + r), 5, true);
+            add("ST" + reg, Opcode(STA + r), 5, true);
+            add("CMP" + reg, Opcode(CMPA + r), 5, true);
+            static const char *const conditions[] = {"N", "Z", "P", "NN", "NZ", "NP"};
+            for (int f = 0; f < 6; f++) add("J" + reg + conditions[f], Opcode(JAN + r), f);
+            static const char *const transfers[] = {"INC", "DEC", "ENT", "ENN"};
+            for (int f = 0; f < 4; f++) add(transfers[f] + reg, Opcode(INCA + r), f);
+        }
+        add("STJ", STJ, 2, true);
+        add("STZ", STZ, 5, true);
+        add("JBUS", JBUS, 0);
+        add("IOC", IOC, 0);
+        add("IN", IN, 0);
+        add("OUT", OUT, 0);
+        add("JRED", JRED, 0);
+        static const char *const jumps[] = {"JMP", "JSJ", "JOV", "JNOV", "JL", "JE", "JG", "JGE", "JNE", "JLE"};
+        for (int f = 0; f < 10; f++) add(jumps[f], JMP, f);
+        pseudo("EQU", Equ);
+        pseudo("ORIG", Orig);
+        pseudo("CON", Con);
+        pseudo("ALF", Alf);
+        pseudo("END", End);
+    }
+
+    const OpInfo *find(const char *p, const char *end) const
+    {
+        Key key;
+        if (!makeKey(p, end, key)) return nullptr;
+        auto i = ops.find(key);
+        return i == ops.end() ? nullptr : &i->second;
+    }
+
+private:
+    std::unordered_map<Key, OpInfo> ops;
+
+    void add(const std::string &name, Opcode c, int f, bool fieldSpec = false)
+    {
+        Key key;
+        makeKey(name.data(), name.data() + name.size(), key);
+        ops[key] = OpInfo{Instruction, c, static_cast<MIXByte>(f), fieldSpec};
+    }
+    void pseudo(const char *name, Kind kind)
+    {
+        Key key;
+        makeKey(name, name + std::strlen(name), key);
+        ops[key] = OpInfo{kind, NOP, 0, false};
+    }
+};
+
+const OpTable mnemonics;
+
+// the code of each character that ALF takes, -1 for the others
+struct AlfCodes {
+    signed char code[256];
+    AlfCodes() {
+        std::memset(code, -1, sizeof code);
+        for (int c = 0; c < MIX_CHARS; c++) code[static_cast<unsigned char>(mixChars[c])] = static_cast<signed char>(c);
+    }
+};
+
+const AlfCodes alfCodes;
+
+inline bool validField(long long f)
+{
+    return f >= 0 && f < 64 && f / 8 <= f % 8 && f % 8 <= 5;
+}
+
+
+// a line with something on it, split into its fields
+struct Line {
+    int number;
+    const OpInfo *op;
+    const char *loc, *locEnd;   // empty if there is no location
+    const char *addr, *addrEnd; // the address, or the operand of ALF
+    int location;               // the location counter at the line
+};
+
+struct Symbol {
+    long long value;
+    bool placeholder; // never defined: a word of +0 after the program
+};
+
+class Assembler {
+public:
+    Assembler(MachineImage &image, std::vector<AssemblyError> &errors)
+    :image(image), errors(errors), errorCount(0), lineNumber(0), pass(1), current(0),
+     counter(0), literalBase(0), literals(0), end(nullptr) {}
+
+    bool run(const char *text, std::size_t length);
+
+private:
+    MachineImage &image;
+    std::vector<AssemblyError> &errors;
+    int errorCount;
+    int lineNumber;                     // of the line being worked on, for errors
+
+    std::vector<Line> lines;
+    std::unordered_map<Key, Symbol> symbols;
+    std::vector<Key> futureRefs;        // symbols alone in an address, in order
+    std::vector<std::pair<int, long long>> localDefs[10]; // (line, value) of each dH
+    int localsBefore[10];               // the definitions of each dH before the current line
+
+    int pass;
+    int current;                        // the line being assembled (an index into lines)
+    long long counter;                  // the location counter (the value of *)
+    int literalBase, literals;          // where the literal constants go, and how many so far
+    std::vector<PackedWord> literalWords;
+    const Line *end;                    // the END line
+
+    bool fail(const std::string &message);
+    void split(const char *p, const char *lineEnd);
+    void firstPass();
+    void placeSymbols();
+    void secondPass();
+    void emit(long long loc, PackedWord w);
+    void startLine(int i);
+    void finishLine();
+
+    bool atom(const char *&p, const char *e, long long &v, bool placeholders);
+    bool expression(const char *&p, const char *e, long long &v, bool &minus, bool placeholders = false);
+    bool wValue(const char *p, const char *e, PackedWord &w);
+    bool instruction(const Line &line, PackedWord &w);
+    bool alf(const Line &line, PackedWord &w);
+    bool defineSymbol(const Line &line, long long value);
+};
+
+bool Assembler::fail(const std::string &message)
+{
+    if (errorCount++ < MAX_ERRORS) errors.push_back(AssemblyError{lineNumber, message});
+    return false;
+}
+
+// d if [p, e) is the local symbol d followed by kind (H, B or F), else -1
+int localDigit(const char *p, const char *e, char kind)
+{
+    return e - p == 2 && p[0] >= '0' && p[0] <= '9' && p[1] == kind ? p[0] - '0' : -1;
+}
+
+// true if [p, e) is an ordinary symbol (with a letter, and not local)
+bool ordinarySymbol(const char *p, const char *e, Key &key)
+{
+    if (!makeKey(p, e, key)) return false;
+    bool letter = false;
+    for (const char *q = p; q < e; q++) letter |= *q >= 'A';
+    return letter && localDigit(p, e, 'H') < 0 && localDigit(p, e, 'B') < 0 && localDigit(p, e, 'F') < 0;
+}
+
+// split the line [p, lineEnd) into its fields, unless it is blank or a comment
+void Assembler::split(const char *p, const char *lineEnd)
+{
+    const char *start = p;
+    while (p < lineEnd && isBlank(*p)) p++;
+    if (p == lineEnd || *start == '*') return;
+    Line line = Line();
+    line.number = lineNumber;
+    line.loc = line.locEnd = start;
+    if (p == start) {
+        while (p < lineEnd && !isBlank(*p)) p++;
+        line.locEnd = p;
+        while (p < lineEnd && isBlank(*p)) p++;
+        if (p == lineEnd) {
+            fail("no operation");
+            return;
+        }
+    }
+    const char *op = p;
+    while (p < lineEnd && !isBlank(*p)) p++;
+    line.op = mnemonics.find(op, p);
+    if (!line.op) {
+        fail("unknown operation " + std::string(op, p));
+        return;
+    }
+    if (line.op->kind == Alf) {
+        const char *q = p;
+        while (q < lineEnd && isBlank(*q)) q++;
+        if (q < lineEnd && *q == '"') {
+            line.addr = q + 1;
+            line.addrEnd = static_cast<const char*>(std::memchr(line.addr, '"', lineEnd - line.addr));
+            if (!line.addrEnd) line.addrEnd = lineEnd;
+        } else {
+            // the five characters after the blank, or columns 17 to 21
+            line.addr = p + 1;
+            if (op - start == 11 && line.addr - start == 15 && line.addr < lineEnd && *line.addr == ' ') line.addr++;
+            if (line.addr > lineEnd) line.addr = lineEnd;
+            line.addrEnd = lineEnd - line.addr > 5 ? line.addr + 5 : lineEnd;
+        }
+    } else {
+        while (p < lineEnd && isBlank(*p)) p++;
+        line.addr = p;
+        while (p < lineEnd && !isBlank(*p)) p++;
+        line.addrEnd = p;
+    }
+    lines.push_back(line);
+}
+
+bool Assembler::defineSymbol(const Line &line, long long value)
+{
+    if (line.loc == line.locEnd) return true;
+    int d = localDigit(line.loc, line.locEnd, 'H');
+    if (d >= 0) {
+        localDefs[d].push_back(std::make_pair(current, value));
+        return true;
+    }
+    Key key;
+    if (!ordinarySymbol(line.loc, line.locEnd, key)) {
+        return fail("invalid symbol " + std::string(line.loc, line.locEnd));
+    }
+    if (!symbols.insert(std::make_pair(key, Symbol{value, false})).second) {
+        return fail(std::string(line.loc, line.locEnd) + " is defined twice");
+    }
+    return true;
+}
+
+// a number, a symbol or *. placeholders allows a symbol that is never defined
+bool Assembler::atom(const char *&p, const char *e, long long &v, bool placeholders)
+{
+    if (p < e && *p == '*') {
+        p++;
+        v = counter;
+        return true;
+    }
+    const char *start = p;
+    bool digits = true;
+    while (p < e && symbolDigit(*p)) digits &= *p++ <= '9';
+    if (p == start) return fail(p == e ? "missing operand" : "unexpected " + std::string(p, e));
+    std::string name(start, p);
+    if (digits) {
+        if (p - start > 10) return fail("number " + name + " is too long");
+        v = 0;
+        for (const char *q = start; q < p; q++) v = v * 10 + (*q - '0');
+        if (v >= WORD_LIMIT) return fail("number " + name + " does not fit in a word");
+        return true;
+    }
+    int d = localDigit(start, p, 'B');
+    if (d >= 0) {
+        if (!localsBefore[d]) return fail("no " + std::string(1, *start) + "H before " + name);
+        v = localDefs[d][localsBefore[d] - 1].second;
+        return true;
+    }
+    d = localDigit(start, p, 'F');
+    if (d >= 0) {
+        if (pass == 1) return fail(name + " is a future reference");
+        // (a definition on this line is not after it)
+        size_t i = localsBefore[d];
+        if (i < localDefs[d].size() && localDefs[d][i].first == current) i++;
+        if (i >= localDefs[d].size()) return fail("no " + std::string(1, *start) + "H after " + name);
+        v = localDefs[d][i].second;
+        return true;
+    }
+    Key key;
+    if (!makeKey(start, p, key) || localDigit(start, p, 'H') >= 0) return fail("invalid symbol " + name);
+    auto s = symbols.find(key);
+    if (s == symbols.end()) return fail(name + (pass == 1 ? " is not defined yet" : " is not defined"));
+    if (s->second.placeholder && !placeholders) return fail(name + " is not defined");
+    v = s->second.value;
+    return true;
+}
+
+// an expression, evaluated from left to right. minus is set if it starts
+// with a - (so that -0 can be told from +0)
+bool Assembler::expression(const char *&p, const char *e, long long &v, bool &minus, bool placeholders)
+{
+    minus = p < e && *p == '-';
+    if (p < e && (*p == '+' || *p == '-')) p++;
+    if (!atom(p, e, v, placeholders)) return false;
+    if (minus) v = -v;
+    while (p < e && (*p == '+' || *p == '-' || *p == '*' || *p == '/' || *p == ':')) {
+        char op = *p++;
+        bool fraction = op == '/' && p < e && *p == '/';
+        if (fraction) p++;
+        long long w;
+        if (!atom(p, e, w, false)) return false;
+        switch (op) {
+            case '+': v += w; break;
+            case '-': v -= w; break;
+            case '*': v *= w; break;
+            case ':': v = 8*v + w; break;
+            default:
+                if (w == 0) return fail("division by zero");
+                v = fraction ? v * WORD_LIMIT / w : v / w;
+                break;
+        }
+        if (v >= WORD_LIMIT || v <= -WORD_LIMIT) return fail("value does not fit in a word");
+    }
+    return true;
+}
+
+// E1(F1),E2(F2),...: each value put into its field of a word of +0
+bool Assembler::wValue(const char *p, const char *e, PackedWord &w)
+{
+    w = 0;
+    for (;;) {
+        long long v, f = 5;
+        bool minus, fminus;
+        if (!expression(p, e, v, minus)) return false;
+        if (p < e && *p == '(') {
+            if (!expression(++p, e, f, fminus)) return false;
+            if (p == e || *p != ')') return fail("missing )");
+            p++;
+            if (!validField(f)) return fail("invalid field " + std::to_string(f));
+        }
+        PackedWord value = packValue(v) | (minus && v == 0 ? SIGN_BIT : 0);
+        w = fieldInsert(w, value, static_cast<MIXByte>(f));
+        if (p == e) return true;
+        if (*p != ',') return fail("unexpected " + std::string(p, e));
+        p++;
+    }
+}
+
+// A,I(F), where A may also be a future reference or a literal constant
+bool Assembler::instruction(const Line &line, PackedWord &w)
+{
+    const char *p = line.addr, *e = line.addrEnd;
+    long long a = 0, i = 0, f = line.op->f;
+    bool minus = false, iminus, fminus;
+    if (p < e && *p == '=') {
+        const char *close = static_cast<const char*>(std::memchr(p + 1, '=', e - p - 1));
+        if (!close) return fail("no = at the end of the literal constant");
+        PackedWord value;
+        if (!wValue(p + 1, close, value)) return false;
+        literalWords.push_back(value);
+        a = literalBase + literals++;
+        p = close + 1;
+    } else if (p < e && *p != ',' && *p != '(') {
+        const char *q = p;
+        while (q < e && *q != ',' && *q != '(') q++;
+        Key key;
+        if (!expression(p, q, a, minus, ordinarySymbol(p, q, key))) return false;
+    }
+    if (p < e && *p == ',') {
+        if (!expression(++p, e, i, iminus)) return false;
+        if (i < 0 || i > 6) return fail("index " + std::to_string(i) + " is not I1 to I6");
+    }
+    if (p < e && *p == '(') {
+        if (!expression(++p, e, f, fminus)) return false;
+        if (p == e || *p != ')') return fail("missing )");
+        p++;
+        if (f < 0 || f >= NUMBASE) return fail("field " + std::to_string(f) + " does not fit in a byte");
+        if (line.op->fieldSpec && !validField(f)) return fail("invalid field " + std::to_string(f));
+    }
+    if (p != e) return fail("unexpected " + std::string(p, e));
+    if (a > static_cast<long long>(ADDR_MASK) || a < -static_cast<long long>(ADDR_MASK)) {
+        return fail("address " + std::to_string(a) + " does not fit in two bytes");
+    }
+    PackedWord sign = a < 0 || (a == 0 && minus) ? SIGN_BIT : 0;
+    w = sign | PackedWord(a < 0 ? -a : a) << 18 | PackedWord(i) << 12 | PackedWord(f) << 6 | line.op->c;
+    return true;
+}
+
+bool Assembler::alf(const Line &line, PackedWord &w)
+{
+    w = 0;
+    for (int j = 0; j < 5; j++) {
+        const char *p = line.addr + j;
+        int c = p < line.addrEnd ? alfCodes.code[static_cast<unsigned char>(*p)] : 0;
+        if (c < 0) return fail(std::string("'") + *p + "' is not a MIX character");
+        w |= PackedWord(c) << (24 - 6*j);
+    }
+    return true;
+}
+
+void Assembler::emit(long long loc, PackedWord w)
+{
+    if (loc < 0 || loc >= ADDR_CAP) fail("location " + std::to_string(loc) + " is outside memory");
+    else image.memory[loc] = w;
+}
+
+void Assembler::startLine(int i)
+{
+    current = i;
+    lineNumber = lines[i].number;
+    counter = lines[i].location;
+}
+
+// count the definition of dH on the current line, if there is one
+void Assembler::finishLine()
+{
+    const Line &line = lines[current];
+    int d = localDigit(line.loc, line.locEnd, 'H');
+    if (d >= 0) localsBefore[d]++;
+}
+
+void Assembler::firstPass()
+{
+    pass = 1;
+    std::fill(localsBefore, localsBefore + 10, 0);
+    long long next = 0;
+    for (int i = 0; i < static_cast<int>(lines.size()); i++) {
+        Line &line = lines[i];
+        line.location = static_cast<int>(next);
+        startLine(i);
+        long long value = next;
+        PackedWord w;
+        switch (line.op->kind) {
+            case Equ:
+                if (wValue(line.addr, line.addrEnd, w)) value = packedValue(w);
+                break;
+            case Orig:
+                if (wValue(line.addr, line.addrEnd, w)) next = packedValue(w);
+                break;
+            case End:
+                // (its location is known once the words after the program are)
+                end = &line;
+                counter = next;
+                lines.resize(i + 1);
+                return;
+            case Instruction: {
+                const char *p = line.addr, *q = p;
+                while (q < line.addrEnd && *q != ',' && *q != '(') q++;
+                Key key;
+                if (p < q && *p == '=') literals++;
+                else if (ordinarySymbol(p, q, key)) futureRefs.push_back(key);
+                next++;
+                break;
+            }
+            default:
+                next++;
+                break;
+        }
+        defineSymbol(line, value);
+        finishLine();
+    }
+    lineNumber = lines.empty() ? 1 : lines.back().number;
+    fail("no END");
+}
+
+// the symbols never defined get a word of +0 each after the program, and
+// then come the literal constants; the location of END is after those
+void Assembler::placeSymbols()
+{
+    const Line &line = *end;
+    Key endKey = 0;
+    bool endSymbol = ordinarySymbol(line.loc, line.locEnd, endKey);
+    long long next = counter;
+    for (Key key : futureRefs) {
+        if ((endSymbol && key == endKey) || symbols.count(key)) continue;
+        symbols[key] = Symbol{next++, true};
+    }
+    literalBase = static_cast<int>(next);
+    startLine(static_cast<int>(lines.size()) - 1);
+    defineSymbol(line, next + literals);
+    literals = 0;
+}
+
+void Assembler::secondPass()
+{
+    pass = 2;
+    std::fill(localsBefore, localsBefore + 10, 0);
+    for (int i = 0; i < static_cast<int>(lines.size()); i++) {
+        const Line &line = lines[i];
+        startLine(i);
+        PackedWord w = 0;
+        switch (line.op->kind) {
+            case Instruction:
+                if (instruction(line, w)) emit(counter, w);
+                break;
+            case Con:
+                if (wValue(line.addr, line.addrEnd, w)) emit(counter, w);
+                break;
+            case Alf:
+                if (alf(line, w)) emit(counter, w);
+                break;
+            case End:
+                if (line.addr == line.addrEnd) w = 0;
+                else if (!wValue(line.addr, line.addrEnd, w)) break;
+                image.programCounter = packedValue(w);
+                for (long long loc = counter; loc < literalBase; loc++) emit(loc, 0);
+                for (int k = 0; k < literals; k++) emit(literalBase + k, literalWords[k]);
+                break;
+            default:
+                break;
+        }
+        finishLine();
+    }
+}
+
+bool Assembler::run(const char *text, std::size_t length)
+{
+    std::memset(&image, 0, sizeof image);
+    image.magic = MACHINE_IMAGE_MAGIC;
+    image.words = ADDR_CAP;
+    const char *p = text, *e = text + length;
+    lines.reserve(length / 16);
+    while (p < e) {
+        const char *lineEnd = static_cast<const char*>(std::memchr(p, '\n', e - p));
+        if (!lineEnd) lineEnd = e;
+        lineNumber++;
+        split(p, lineEnd);
+        p = lineEnd + 1;
+    }
+    symbols.reserve(lines.size() / 4);
+    firstPass();
+    if (!end) return false;
+    placeSymbols();
+    secondPass();
+    std::stable_sort(errors.begin(), errors.end(), [](const AssemblyError &a, const AssemblyError &b) {
+        return a.line < b.line;
+    });
+    return errorCount == 0;
+}
+
+} // namespace
+
+bool assemble(const char *text, std::size_t length, MachineImage &image, std::vector<AssemblyError> &errors)
+{
+    Assembler assembler(image, errors);
+    return assembler.run(text, length);
+}
+
+bool assembleFile(const char *path, MachineImage &image, std::vector<AssemblyError> &errors)
+{
+    std::FILE *f = std::fopen(path, "rb");
+    std::string text;
+    if (f) {
+        char buffer[1 << 16];
+        size_t n;
+        while ((n = std::fread(buffer, 1, sizeof buffer, f)) > 0) text.append(buffer, n);
+        std::fclose(f);
+    } else {
+        errors.push_back(AssemblyError{0, std::string("cannot read ") + path});
+        return false;
+    }
+    return assemble(text.data(), text.size(), image, errors);
+}
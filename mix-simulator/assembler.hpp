@@ -0,0 +1,48 @@
+//
+//  assembler.hpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+#ifndef assembler_hpp
+#define assembler_hpp
+
+#include "image.hpp"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// a two-pass assembler for MIXAL, the assembly language of TAOCP 1.3.2,
+// in free format: a line is an optional location (when it starts in the
+// first column), an operation and an address, separated by blanks, and
+// anything after the address is a comment, as is a line starting with *.
+// (so an instruction with no address cannot have a comment.) it has
+//
+//     EQU, ORIG, CON, ALF and END
+//     expressions with + - * / // and :, and * for the location
+//     W-values, as in CON 1(1:1),2(2:2)
+//     local symbols dH, dB and dF
+//     future references, and literal constants =W-value=
+//
+// symbols never defined, and then the literal constants, get a word each
+// after the last word of the program, as in TAOCP; a location on the END
+// line is the location after those. the operand of ALF is either in quotes
+// or the five characters after the blank that follows ALF (columns 17 to
+// 21 when the line is in the columns of TAOCP).
+
+// a problem found in a source, at line (counted from 1)
+struct AssemblyError {
+    int line;
+    std::string message;
+};
+
+// assemble the source text (length bytes) into image: the words
+// assembled, with programCounter the location given by END and everything
+// else zero. false if there are errors, which are added to errors
+bool assemble(const char *text, std::size_t length, MachineImage &image, std::vector<AssemblyError> &errors);
+
+// the same for the source in a file (an error at line 0 if it cannot be read)
+bool assembleFile(const char *path, MachineImage &image, std::vector<AssemblyError> &errors);
+
+#endif /* assembler_hpp */
@@ -0,0 +1,416 @@
+//
+//  batch.cpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+// the jobs are handed out to a pool of threads, each with its own machine.
+// every thread starts with an even share of the jobs in its own queue and
+// takes them from the front; a thread whose queue is empty steals from the
+// back of another's, so long jobs do not leave the other threads idle.
+// each result is kept in the job's slot and written out in manifest order
+// once all jobs are done. in lockstep mode the unit of work handed out is a
+// group of jobs on the same image, run as the lanes of one Lockstep.
+//
+// each image is kept as a PristineMachine (see fork.hpp). a thread forks
+// its machine from the image of its job, and for the next job on the same
+// image only resets it, which copies back just the pages the last job wrote
+// and keeps the rest of the program decoded.
+//
+// with a trace, each thread records into a TraceRing of its own, and every
+// job starts with a TraceStart record giving its number. jobs are then
+// run one at a time, not in lockstep.
+//
+// with coroutines, each thread has a Scheduler (see scheduler.hpp) and a
+// machine for every job of its share, forked from the image, and hands
+// them all to the scheduler at once; there is no stealing then.
+
+#include "batch.hpp"
+#include "interpreter.hpp"
+#include "image.hpp"
+#include "lockstep.hpp"
+#include "fork.hpp"
+#include "trace.hpp"
+#include "devices.hpp"
+#include "scheduler.hpp"
+#include "variants.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+struct Job {
+    std::string imageName;
+    int image;              // index into the images read
+    long long budget;       // 0 for no limit
+    // results
+    std::string state;
+    long long steps;
+    long long together;     // of the steps, those run in lockstep
+    double seconds;
+};
+
+// a queue of group numbers: the owner pops from the front, thieves from the back
+class JobQueue {
+public:
+    void push(int group) { std::lock_guard<std::mutex> g(lock); jobs.push_back(group); }
+    bool pop(int &job) {
+        std::lock_guard<std::mutex> g(lock);
+        if (jobs.empty()) return false;
+        job = jobs.front();
+        jobs.pop_front();
+        return true;
+    }
+    bool steal(int &job) {
+        std::lock_guard<std::mutex> g(lock);
+        if (jobs.empty()) return false;
+        job = jobs.back();
+        jobs.pop_back();
+        return true;
+    }
+private:
+    std::mutex lock;
+    std::deque<int> jobs;
+};
+
+struct Registers {
+    PackedWord a, x, j, i[7];
+    int pc;
+    signed char ci;
+    bool ov;
+};
+
+// "-0" has to come out as -0
+bool parseValue(const char *s, long max, PackedWord &w)
+{
+    char *end;
+    long v = std::strtol(s, &end, 10);
+    if (end == s || *end || v > max || v < -max) return false;
+    w = v != 0 ? packValue(v) : (*s == '-' ? SIGN_BIT : 0);
+    return true;
+}
+
+bool parseRegister(const std::string &tok, Registers &r)
+{
+    size_t eq = tok.find('=');
+    if (eq == std::string::npos) return false;
+    std::string name = tok.substr(0, eq);
+    const char *v = tok.c_str() + eq + 1;
+    PackedWord w;
+    if (name == "A") return parseValue(v, MAG_MASK, r.a);
+    if (name == "X") return parseValue(v, MAG_MASK, r.x);
+    if (name == "J") return parseValue(v, ADDR_MASK, r.j);
+    if (name.size() == 2 && name[0] == 'I' && name[1] >= '1' && name[1] <= '6')
+        return parseValue(v, ADDR_MASK, r.i[name[1] - '0']);
+    if (!parseValue(v, ADDR_CAP-1, w)) return false;
+    int n = packedValue(w);
+    if (name == "PC" && n >= 0) r.pc = n;
+    else if (name == "OV" && (n == 0 || n == 1)) r.ov = n != 0;
+    else if (name == "CI" && n >= -1 && n <= 1) r.ci = static_cast<signed char>(n);
+    else return false;
+    return true;
+}
+
+std::string directoryOf(const char *path)
+{
+    const char *slash = std::strrchr(path, '/');
+    return slash ? std::string(path, slash + 1) : std::string();
+}
+
+class Batch {
+public:
+    bool readManifest(const char *manifest);
+    void run(unsigned threads, int lanes, TraceFile *trace, long long slice);
+    bool writeResults(const char *results) const;
+    void report(std::ostream &os) const;
+
+private:
+    std::vector<std::unique_ptr<PristineMachine> > images;
+    std::vector<Job> jobs;
+    std::vector<Registers> registers;
+    std::vector<DeviceFiles> units;
+    std::vector<std::vector<int> > groups; // the jobs run together
+    std::vector<JobQueue> queues;
+    double seconds;
+    unsigned threads;
+    TraceFile *trace;
+    long long slice;                       // with coroutines; 0 without
+    long long waits, slices;               // (and how they went)
+    std::mutex countLock;
+
+    void worker(unsigned self);
+    void schedule(unsigned self);
+    void setUp(MIXMachine &m, int job, int &forked);
+    void runJob(MIXMachine &m, int job, int &forked, TraceRing *ring);
+    void runLockstep(MIXMachine &m, const std::vector<int> &group, int &forked);
+    void record(const MIXMachine &m, int job, Stop stop, long long steps);
+};
+
+bool Batch::readManifest(const char *manifest)
+{
+    std::ifstream in(manifest);
+    if (!in) {
+        std::cerr << "Cannot read " << manifest << ".\n";
+        return false;
+    }
+    std::string dir = directoryOf(manifest);
+    std::map<std::string, int> imageIndex;
+    std::string line;
+    for (int lineNo = 1; std::getline(in, line); lineNo++) {
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) line.erase(hash);
+        std::istringstream words(line);
+        std::string name, tok;
+        if (!(words >> name)) continue;
+
+        Job job = Job();
+        Registers r = Registers();
+        DeviceFiles files;
+        job.imageName = name;
+        if (!(words >> job.budget) || job.budget < 0) {
+            std::cerr << manifest << ":" << lineNo << ": missing step budget.\n";
+            return false;
+        }
+        while (words >> tok) {
+            if (!parseRegister(tok, r) && !parseUnit(tok.c_str(), files)) {
+                std::cerr << manifest << ":" << lineNo << ": bad register setting or unit " << tok << ".\n";
+                return false;
+            }
+        }
+        for (int u = 0; u < UNITS; u++) {
+            if (files.path[u][0] != '/') files.path[u] = dir + files.path[u];
+        }
+
+        std::string path = name[0] == '/' ? name : dir + name;
+        std::map<std::string, int>::iterator i = imageIndex.find(path);
+        if (i == imageIndex.end()) {
+            MemoryImage image;
+            if (!readImage(path.c_str(), image)) {
+                std::cerr << "Cannot read image " << path << ".\n";
+                return false;
+            }
+            MIXMachine loaded;
+            loadImage(loaded, image);
+            images.push_back(std::unique_ptr<PristineMachine>(new PristineMachine(loaded)));
+            i = imageIndex.insert(std::make_pair(path, static_cast<int>(images.size()) - 1)).first;
+        }
+        job.image = i->second;
+        jobs.push_back(job);
+        registers.push_back(r);
+        units.push_back(files);
+    }
+    return true;
+}
+
+// forked is the image m was last forked from (-1 for none)
+void Batch::setUp(MIXMachine &m, int n, int &forked)
+{
+    const Registers &r = registers[n];
+    const PristineMachine &image = *images[jobs[n].image];
+    if (forked == jobs[n].image) {
+        image.reset(m);
+    } else {
+        image.fork(m);
+        forked = jobs[n].image;
+    }
+    m.Reg[REG_A].w = r.a;
+    m.Reg[REG_X].w = r.x;
+    m.Reg[REG_J].w = r.j;
+    for (int i = 1; i < 7; i++) m.Reg[i].w = r.i[i];
+    m.programCounter = r.pc;
+    m.compIndicator = r.ci;
+    m.overflowToggle = r.ov;
+}
+
+// only a bad opcode or a device error needs more than the reason to explain itself
+void Batch::record(const MIXMachine &m, int n, Stop stop, long long steps)
+{
+    Job &job = jobs[n];
+    std::ostringstream out;
+    out << "job " << n+1 << ": " << job.imageName << '\n'
+        << stopName(stop) << " after " << steps << " instructions\n";
+    if (stop == Stop::BadOpcode || stop == Stop::DeviceError) out << stopMessage(m);
+    dumpState(out, m);
+    job.state = out.str();
+    job.steps = steps;
+}
+
+void Batch::runJob(MIXMachine &m, int n, int &forked, TraceRing *ring)
+{
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    setUp(m, n, forked);
+    long long steps = 0;
+    // (checked: a job that goes wrong stops with a fault, and the rest go on)
+    Stop stop = ring ? runTraced(m, *ring, n+1, jobs[n].budget, steps) : runChecked(m, jobs[n].budget, steps);
+    record(m, n, stop, steps);
+    jobs[n].seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// the time of a group is shared out evenly between its jobs
+void Batch::runLockstep(MIXMachine &m, const std::vector<int> &group, int &forked)
+{
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    int lanes = static_cast<int>(group.size());
+    Lockstep *lockstep = new Lockstep(lanes);
+    for (int l = 0; l < lanes; l++) {
+        setUp(m, group[l], forked);
+        lockstep->setLane(l, m, jobs[group[l]].budget);
+    }
+    lockstep->run();
+    for (int l = 0; l < lanes; l++) {
+        lockstep->getLane(l, m);
+        record(m, group[l], lockstep->stop(l), lockstep->steps(l));
+        jobs[group[l]].together = lockstep->lockstepSteps(l);
+    }
+    delete lockstep;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    for (int l = 0; l < lanes; l++) jobs[group[l]].seconds = seconds / lanes;
+}
+
+// all the jobs in the queue of self at once, each on a machine of its own
+void Batch::schedule(unsigned self)
+{
+    Scheduler scheduler(slice);
+    std::vector<std::unique_ptr<MIXMachine> > machines;
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    int group;
+    while (queues[self].pop(group)) {
+        int n = groups[group][0], forked = -1;
+        machines.push_back(std::unique_ptr<MIXMachine>(new MIXMachine));
+        MIXMachine &m = *machines.back();
+        setUp(m, n, forked);
+        scheduler.add(m, units[n], jobs[n].budget, [this, &m, n, t0](Stop stop, long long steps) {
+            record(m, n, stop, steps);
+            jobs[n].seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        });
+    }
+    scheduler.run();
+    std::lock_guard<std::mutex> g(countLock);
+    waits += scheduler.waits();
+    slices += scheduler.slices();
+}
+
+void Batch::worker(unsigned self)
+{
+    if (slice) {
+        schedule(self);
+        return;
+    }
+    MIXMachine m;
+    std::unique_ptr<TraceRing> ring(trace ? new TraceRing(*trace) : nullptr);
+    int forked = -1;
+    int group;
+    for (;;) {
+        bool found = queues[self].pop(group);
+        for (unsigned k = 1; !found && k < threads; k++) {
+            found = queues[(self + k) % threads].steal(group);
+        }
+        if (!found) return; // nothing is added once the threads start
+        if (groups[group].size() == 1) runJob(m, groups[group][0], forked, ring.get());
+        else runLockstep(m, groups[group], forked);
+    }
+}
+
+// without lockstep (lanes 0) every job is a group of its own; with it, the
+// jobs on each image are grouped in manifest order, up to lanes at a time
+void Batch::run(unsigned threads, int lanes, TraceFile *trace, long long slice)
+{
+    this->trace = trace;
+    this->slice = slice;
+    waits = slices = 0;
+    if (trace || slice) lanes = 0;
+    std::vector<int> open(images.size(), -1); // the group filling up for each image
+    for (size_t j = 0; j < jobs.size(); j++) {
+        int &g = open[jobs[j].image];
+        if (lanes <= 1 || g < 0 || static_cast<int>(groups[g].size()) == lanes) {
+            g = static_cast<int>(groups.size());
+            groups.push_back(std::vector<int>());
+        }
+        groups[g].push_back(static_cast<int>(j));
+    }
+
+    int n = static_cast<int>(groups.size());
+    if (threads == 0) threads = 1;
+    if (threads > static_cast<unsigned>(n) && n > 0) threads = n;
+    this->threads = threads;
+    std::vector<JobQueue>(threads).swap(queues);
+    for (unsigned t = 0; t < threads; t++) {
+        for (int j = static_cast<int>(n * t / threads); j < static_cast<int>(n * (t+1) / threads); j++)
+            queues[t].push(j);
+    }
+
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; t++) pool.push_back(std::thread(&Batch::worker, this, t));
+    worker(0);
+    for (size_t t = 0; t < pool.size(); t++) pool[t].join();
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+bool Batch::writeResults(const char *results) const
+{
+    std::ofstream out(results);
+    for (size_t j = 0; j < jobs.size(); j++) out << jobs[j].state << '\n';
+    out.close();
+    if (!out) {
+        std::cerr << "Cannot write " << results << ".\n";
+        return false;
+    }
+    return true;
+}
+
+void Batch::report(std::ostream &os) const
+{
+    long long total = 0, together = 0;
+    for (size_t j = 0; j < jobs.size(); j++) {
+        os << "job " << j+1 << ": " << jobs[j].steps << " instructions in "
+           << jobs[j].seconds * 1e3 << " ms\n";
+        total += jobs[j].steps;
+        together += jobs[j].together;
+    }
+    if (groups.size() < jobs.size()) {
+        os << "lockstep: " << groups.size() << " groups, "
+           << (total > 0 ? 100.0 * together / total : 0) << "% of instructions in lockstep"
+           << (haveLockstep() ? "\n" : " (no AVX2: all run alone)\n");
+    }
+    if (slice) os << "coroutines: " << waits << " waits for a unit, " << slices << " slices of " << slice << " instructions\n";
+    os << jobs.size() << " jobs, " << total << " instructions in " << seconds << " s on "
+       << threads << (threads == 1 ? " thread: " : " threads: ")
+       << (seconds > 0 ? total / seconds / 1e6 : 0) << " MIPS\n";
+}
+
+} // namespace
+
+int runBatch(const char *manifest, const char *results, unsigned threads, int lanes,
+             const char *tracePath, long long slice)
+{
+    std::unique_ptr<TraceFile> trace(tracePath ? new TraceFile(tracePath) : nullptr);
+    if (trace && !trace->ok()) {
+        std::cerr << "Cannot write " << tracePath << ".\n";
+        return 1;
+    }
+    std::unique_ptr<Batch> batch(new Batch);
+    bool ok = batch->readManifest(manifest);
+    if (ok) {
+        batch->run(threads, lanes, trace.get(), slice);
+        if (trace && !trace->close()) {
+            std::cerr << "Cannot write all of " << tracePath << ".\n";
+            ok = false;
+        }
+        ok = batch->writeResults(results) && ok;
+        batch->report(std::cout);
+    }
+    return ok ? 0 : 1;
+}
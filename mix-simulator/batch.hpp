@@ -0,0 +1,44 @@
+//
+//  batch.hpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+#ifndef batch_hpp
+#define batch_hpp
+
+// batch mode: run every job of a manifest, spread over threads, and write
+// the final state of each to a results file.
+//
+// the manifest has one job per line (# starts a comment):
+//
+//     image budget [A=n] [X=n] [I1=n ... I6=n] [J=n] [OV=0|1] [CI=-1|0|1] [PC=n] [unit:file ...]
+//
+// image is a file in the format of the octal dump (see image.hpp), relative
+// to the manifest; budget is the most instructions the job may execute (0
+// for no limit); the registers are set to the given decimal values first.
+// unit:file puts an I/O unit of the job on a file other than its default
+// (as --unit does; see devices.hpp); the files of the units are relative
+// to the manifest too.
+// the results come out in manifest order, the same for any number of
+// threads. a report of the time taken by each job and the total throughput
+// goes to standard output.
+//
+// with lanes > 1 the jobs on the same image run in lockstep (see
+// lockstep.hpp), up to lanes jobs at a time; the results are the same.
+// with tracePath every instruction of every job is traced into that file
+// (see trace.hpp), each job under its number in the manifest, counted
+// from 1; there is no lockstep then.
+//
+// jobs only have I/O units when slice > 0: each thread then runs its
+// share of the jobs all at once, as coroutines that take turns of slice
+// instructions, and are put aside while they wait for a busy unit (see
+// scheduler.hpp). the time given for a job is then the time until it ended.
+//
+// returns 0 on success, 1 if the manifest or an image cannot be read or the
+// results cannot be written
+int runBatch(const char *manifest, const char *results, unsigned threads, int lanes = 0,
+             const char *tracePath = nullptr, long long slice = 0);
+
+#endif /* batch_hpp */
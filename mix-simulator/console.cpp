@@ -0,0 +1,253 @@
+//
+//  console.cpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+#include "console.hpp"
+#include "debugger.hpp"
+#include "devices.hpp"
+#include "fork.hpp"
+#include "history.hpp"
+#include "image.hpp"
+#include "variants.hpp"
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+const char *const helpText =
+    "n and loc are decimal; a word is a sign and five octal bytes, as in +1 01 44 00 05 10\n"
+    "  set loc word...      put the words into memory from loc on\n"
+    "  x loc [n]            show n words from loc, with their opcodes\n"
+    "  regs                 show the registers and indicators\n"
+    "  state                show the registers and the words of memory that are not +0\n"
+    "  break loc            stop before the instruction at loc runs\n"
+    "  watch loc [r|w|rw]   stop before an instruction reads or writes loc (w if not given)\n"
+    "  delete loc           take away the breakpoint and watchpoints at loc\n"
+    "  info                 list the breakpoints and watchpoints\n"
+    "  run [n]              start the program over, as set or loaded, for at most n instructions\n"
+    "  continue [n]         go on from where it stopped, for at most n instructions\n"
+    "  step [n]             run n instructions (1 if not given)\n"
+    "  back [n]             take back the last n instructions (1 if not given)\n"
+    "  reverse              go back to the last breakpoint, or write to a watched word\n"
+    "  save file            write the machine out as an image\n"
+    "  quit\n";
+
+class Console {
+public:
+    Console(MIXMachine &m, const ConsoleOptions &options);
+    // carry out one command line; false to quit
+    bool command(const std::string &line);
+
+private:
+    MIXMachine &m;
+    const ConsoleOptions &options;
+    std::unique_ptr<History> history;
+    std::unique_ptr<PristineMachine> pristine;
+    std::vector<std::pair<int, MIXWord> > edits; // made since the program was last started
+    bool started;
+
+    void set(std::istream &args);
+    void examine(int loc, int n);
+    void run(long long budget);
+    bool go(long long budget);
+    void stopped(bool stepping);
+    void showNext();
+};
+
+Console::Console(MIXMachine &m, const ConsoleOptions &options)
+:m(m), options(options), started(false)
+{
+    if (options.historyBytes) history.reset(new History(options.historyBytes));
+}
+
+bool Console::command(const std::string &line)
+{
+    std::istringstream args(line);
+    std::string c;
+    if (!(args >> c)) return true;
+    long long n = 0;
+    int loc = -1;
+    if (c == "quit" || c == "q") {
+        return false;
+    } else if (c == "help" || c == "h" || c == "?") {
+        std::cout << helpText;
+    } else if (c == "set") {
+        set(args);
+    } else if (c == "x") {
+        args >> loc >> n;
+        examine(loc, n ? static_cast<int>(n) : 1);
+    } else if (c == "regs" || c == "r") {
+        dumpRegisters(std::cout, m);
+    } else if (c == "state") {
+        dumpState(std::cout, m);
+    } else if (c == "break" || c == "b" || c == "watch" || c == "w" || c == "delete" || c == "d") {
+        if (!(args >> loc) || static_cast<unsigned>(loc) >= ADDR_CAP) {
+            std::cerr << "Which location (0 to " << ADDR_CAP - 1 << ")?\n";
+        } else if (c[0] == 'b') {
+            setDebugFlags(m, loc, BREAK, true);
+        } else if (c[0] == 'd') {
+            setDebugFlags(m, loc, BREAK | WATCH_READ | WATCH_WRITE, false);
+        } else {
+            std::string how = "w";
+            args >> how;
+            std::uint8_t flags = (how.find('r') != std::string::npos ? WATCH_READ : 0)
+                               | (how.find('w') != std::string::npos ? WATCH_WRITE : 0);
+            setDebugFlags(m, loc, flags ? flags : std::uint8_t(WATCH_WRITE), true);
+        }
+    } else if (c == "info" || c == "i") {
+        for (int i = 0; i < ADDR_CAP; i++) {
+            std::uint8_t f = debugFlags(m, i);
+            if (!f) continue;
+            std::cout << std::setfill('0') << std::setw(4) << i << std::setfill(' ') << ':'
+                      << (f & BREAK ? " break" : "") << (f & WATCH_READ ? " read" : "")
+                      << (f & WATCH_WRITE ? " write" : "") << '\n';
+        }
+    } else if (c == "run") {
+        args >> n;
+        run(n);
+        stopped(false);
+    } else if (c == "continue" || c == "c") {
+        args >> n;
+        if (go(n)) stopped(false);
+    } else if (c == "step" || c == "s") {
+        args >> n;
+        if (go(n > 0 ? n : 1)) stopped(true);
+    } else if (c == "back" || c == "reverse" || c == "rc") {
+        args >> n;
+        if (!history) {
+            std::cerr << "There is no history to go back in (it is off with --history=0).\n";
+        } else if (c == "back" ? history->stepBack(m, n > 0 ? n : 1)
+                   : history->reverseContinue(m, [this](int loc) { return debugFlags(m, loc) & BREAK; },
+                                              [this](int loc) { return debugFlags(m, loc) & WATCH_WRITE; })) {
+            std::cout << "Back at step " << history->now() << ".\n";
+            showNext();
+        } else if (c == "back") {
+            std::cerr << "Cannot go back there; the history reaches back to step " << history->oldest() << ".\n";
+        } else {
+            std::cerr << "No breakpoint or watched write since step " << history->oldest() << ".\n";
+        }
+    } else if (c == "save") {
+        std::string path;
+        if (!(args >> path) || !writeMachineImage(path.c_str(), m)) std::cerr << "Cannot write " << path << ".\n";
+    } else {
+        std::cerr << "What is " << c << "? (help lists the commands)\n";
+    }
+    return true;
+}
+
+// words are read as octalEntry reads them: a sign (+1 or -1) and five octal bytes
+void Console::set(std::istream &args)
+{
+    int loc;
+    if (!(args >> loc) || static_cast<unsigned>(loc) >= ADDR_CAP) {
+        std::cerr << "Which location (0 to " << ADDR_CAP - 1 << ")?\n";
+        return;
+    }
+    int sign;
+    while (loc < ADDR_CAP && args >> std::dec >> sign) {
+        MIXWord w;
+        w.setSign(sign);
+        for (int j = 0; j < 5; j++) {
+            int byte = 0;
+            args >> std::oct >> byte;
+            w.setByte(j, static_cast<MIXByte>(byte));
+        }
+        m.Memory[loc] = w;
+        invalidateDecoded(m, loc);
+        edits.push_back(std::make_pair(loc, w));
+        loc++;
+    }
+    // (what came before the change cannot be undone through it)
+    if (history) history->clear();
+}
+
+void Console::examine(int loc, int n)
+{
+    if (loc < 0) loc = m.programCounter;
+    for (int i = loc; i < loc + n && i < ADDR_CAP; i++) {
+        std::cout << std::setfill('0') << std::setw(4) << i << ": " << m.Memory[i] << ' '
+                  << opcodeNames[m.Memory[i].w & 077] << std::setfill(' ') << '\n';
+    }
+}
+
+// start over from the program as set or loaded: as it was when first
+// started, with the edits since then
+void Console::run(long long budget)
+{
+    if (pristine && started) pristine->reset(m);
+    if (!pristine || !edits.empty()) {
+        for (const auto &e : edits) {
+            m.Memory[e.first] = e.second;
+            invalidateDecoded(m, e.first);
+        }
+        pristine.reset(new PristineMachine(m));
+        pristine->fork(m);
+        edits.clear();
+    }
+    if (history) history->clear();
+    started = true;
+    long long steps = 0;
+    if (history) history->run(m, budget, steps);
+    else runChecked(m, budget, steps);
+}
+
+// go on from where m stopped, past a breakpoint or watchpoint there; false
+// if there is nowhere to go on from
+bool Console::go(long long budget)
+{
+    if (!started) {
+        run(budget);
+        return true;
+    }
+    if (m.stop == Stop::Halted || static_cast<unsigned>(m.programCounter) >= ADDR_CAP) {
+        std::cerr << "The program has ended; run starts it over.\n";
+        return false;
+    }
+    long long steps = 0;
+    passTrap(m, true);
+    Stop s = history ? history->run(m, 1, steps) : runChecked(m, 1, steps);
+    passTrap(m, false);
+    if (s != Stop::Budget || budget == 1) return true;
+    if (budget) budget--;
+    if (history) history->run(m, budget, steps);
+    else runChecked(m, budget, steps);
+    return true;
+}
+
+void Console::stopped(bool stepping)
+{
+    if (m.stop == Stop::Halted || m.stop == Stop::AddressFault || m.stop == Stop::BadOpcode || m.stop == Stop::DeviceError) {
+        finishIO(m);
+    }
+    if (stepping && m.stop == Stop::Budget) showNext();
+    else std::cerr << stopMessage(m);
+    if (options.showState) dumpState(std::cout, m);
+    if (options.savePath && !writeMachineImage(options.savePath, m)) std::cerr << "Cannot write " << options.savePath << ".\n";
+}
+
+// the instruction to run next
+void Console::showNext()
+{
+    if (static_cast<unsigned>(m.programCounter) < ADDR_CAP) examine(m.programCounter, 1);
+}
+
+} // namespace
+
+int runConsole(MIXMachine &m, const ConsoleOptions &options, std::istream &in)
+{
+    Console console(m, options);
+    std::string line;
+    for (;;) {
+        std::cerr << "mix> ";
+        if (!std::getline(in, line) || !console.command(line)) break;
+    }
+    finishIO(m);
+    return 0;
+}
@@ -0,0 +1,28 @@
+//
+//  console.hpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+#ifndef console_hpp
+#define console_hpp
+
+#include "mix.h"
+#include <cstddef>
+#include <iostream>
+
+// the interactive debugger: a prompt for commands to set memory, set
+// breakpoints and watchpoints (see debugger.hpp), run, step forward and
+// back (see history.hpp) and look at the machine. "help" lists them.
+struct ConsoleOptions {
+    std::size_t historyBytes;  // for the undo log; 0 for none (and no going back)
+    bool showState;            // print the machine whenever it stops
+    const char *savePath;      // write it out as an image whenever it stops, or null
+};
+
+// take commands from in until "quit" or the end of input, with m as the
+// program so far; the exit status
+int runConsole(MIXMachine &m, const ConsoleOptions &options, std::istream &in);
+
+#endif /* console_hpp */
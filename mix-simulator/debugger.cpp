@@ -0,0 +1,116 @@
+//
+//  debugger.cpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+#include "debugger.hpp"
+#include "mixop-table.hpp"
+#include "devices.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// the words an instruction at address a reads and writes, as [first, first
+// + n) of each (MOVE writes from i1 on); false if it touches none
+bool accesses(const MIXInstr &in, int a, int i1, int &read, int &reads, int &written, int &writes)
+{
+    read = written = a;
+    reads = writes = 0;
+    Opcode oc = in.oc;
+    if ((oc >= ADD && oc <= DIV) || (oc >= LDA && oc <= LDXN) || oc >= CMPA) reads = 1;
+    else if (oc >= STA && oc <= STZ) writes = 1;
+    else if (oc == MOVE) {
+        reads = writes = in.field;
+        written = i1;
+    }
+    else if (oc == IN) writes = blockSize(in.field);
+    else if (oc == OUT) reads = blockSize(in.field);
+    return reads || writes;
+}
+
+// the first of n words from first with flag set, or -1
+int flagged(const DebugFlags &d, int first, int n, std::uint8_t flag)
+{
+    int end = std::min(first + n, ADDR_CAP);
+    for (int w = std::max(first, 0); w < end; w++) {
+        if (d.at[w] & flag) return w;
+    }
+    return -1;
+}
+
+} // namespace
+
+DebugFlags::DebugFlags()
+:watched(0), resume(-1), word(0), write(false)
+{
+    std::memset(at, 0, sizeof at);
+}
+
+void setDebugFlags(MIXMachine &m, int loc, std::uint8_t flags, bool on)
+{
+    if (static_cast<unsigned>(loc) >= ADDR_CAP) return;
+    if (!m.debug) {
+        if (!on) return;
+        m.debug = new DebugFlags();
+    }
+    DebugFlags &d = *m.debug;
+    std::uint8_t old = d.at[loc];
+    d.at[loc] = on ? old | flags : old & ~flags;
+    bool wasWatched = old & (WATCH_READ | WATCH_WRITE), isWatched = d.at[loc] & (WATCH_READ | WATCH_WRITE);
+    d.watched += isWatched - wasWatched;
+    if (old == d.at[loc]) return;
+    // decode again what may be trapped now, or no longer
+    if ((old ^ d.at[loc]) & (WATCH_READ | WATCH_WRITE)) {
+        for (int i = 0; i < ADDR_CAP; i++) invalidateDecoded(m, i);
+    } else {
+        invalidateDecoded(m, loc);
+    }
+}
+
+std::uint8_t debugFlags(const MIXMachine &m, int loc)
+{
+    return m.debug && static_cast<unsigned>(loc) < ADDR_CAP ? m.debug->at[loc] : 0;
+}
+
+bool needsTrap(const MIXMachine &m, const MIXInstr &in, int loc)
+{
+    const DebugFlags &d = *m.debug;
+    if (d.at[loc] & BREAK) return true;
+    int read, reads, written, writes;
+    if (!d.watched || !accesses(in, in.addr, 0, read, reads, written, writes)) return false;
+    if (in.index || in.oc == MOVE) return true; // (where it goes is only known when it runs)
+    return flagged(d, read, reads, WATCH_READ) >= 0 || flagged(d, written, writes, WATCH_WRITE) >= 0;
+}
+
+void debugTrap(MIXMachine &m, const MIXInstr &in)
+{
+    DebugFlags &d = *m.debug;
+    int pc = m.programCounter;
+    if (pc != d.resume) {
+        if (d.at[pc] & BREAK) {
+            stopMachine(m, Stop::Breakpoint);
+            return;
+        }
+        int read, reads, written, writes;
+        if (d.watched && in.index <= 6
+            && accesses(in, effectiveAddress(m, in), packedValue(m.Reg[REG_I1].w), read, reads, written, writes)) {
+            int w = flagged(d, read, reads, WATCH_READ);
+            d.write = w < 0;
+            if (d.write) w = flagged(d, written, writes, WATCH_WRITE);
+            if (w >= 0) {
+                d.word = w;
+                stopMachine(m, Stop::Watchpoint);
+                return;
+            }
+        }
+    }
+    decodedHandler(in)(m, in);
+}
+
+void passTrap(MIXMachine &m, bool on)
+{
+    if (m.debug) m.debug->resume = on ? m.programCounter : -1;
+}
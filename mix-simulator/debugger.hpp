@@ -0,0 +1,56 @@
+//
+//  debugger.hpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+#ifndef debugger_hpp
+#define debugger_hpp
+
+#include "mix.h"
+#include <cstdint>
+
+// breakpoints on instructions and watchpoints on words of memory. they are
+// kept as a byte of flags for each word, next to the machine's memory, and
+// folded into the decoded instructions: decodeInstruction gives an
+// instruction with a breakpoint, or one that may read or write a watched
+// word, the handler debugTrap in place of its own, and nothing else. a
+// machine with none set runs exactly as before; with some, each trapped
+// instruction costs a test of the flags of the words it reads or writes.
+//
+// debugTrap stops the machine before the instruction runs, with
+// Stop::Breakpoint or Stop::Watchpoint, and otherwise carries it out. the
+// engines all call it like any handler (the JIT leaves trapped
+// instructions to its interpreter), so they all stop the same way.
+enum : std::uint8_t {
+    BREAK = 1,       // stop before running the instruction here
+    WATCH_READ = 2,  // stop before an instruction reads the word here
+    WATCH_WRITE = 4  // or writes it
+};
+
+struct DebugFlags {
+    std::uint8_t at[ADDR_CAP];
+    int watched;          // the number of words with a WATCH flag
+    int resume;           // a location whose trap lets the next instruction through, or -1
+    int word;             // the word a watchpoint stopped at
+    bool write;           // (and whether it was to be written)
+    DebugFlags();
+};
+
+// set or clear flags at loc (BREAK, WATCH_READ and WATCH_WRITE, or'd); the
+// machine gets its DebugFlags when the first is set
+void setDebugFlags(MIXMachine &m, int loc, std::uint8_t flags, bool on);
+// the flags at loc (0 if m has none)
+std::uint8_t debugFlags(const MIXMachine &m, int loc);
+
+// the handler that stands in for a trapped instruction
+void debugTrap(MIXMachine &m, const MIXInstr &in);
+// true if the decoded instruction at loc is to be trapped
+bool needsTrap(const MIXMachine &m, const MIXInstr &in, int loc);
+
+// let the instruction at programCounter run through its trap once (to go
+// on from a breakpoint or watchpoint), or stop doing so
+void passTrap(MIXMachine &m, bool on);
+
+#endif /* debugger_hpp */
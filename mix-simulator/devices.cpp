@@ -0,0 +1,572 @@
+//
+//  devices.cpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+// each machine with devices has a host thread for them (its own, or those
+// of an IOHost it shares), which takes the units with work to do from a
+// queue in the order it was started. the instruction that starts an
+// operation does what has to be done on the machine's own thread
+// (checking, copying a block out of memory, making the line of text to
+// print) and marks the unit busy; the host thread does the rest and marks
+// it ready. only the machine's thread touches Memory.
+
+#include "devices.hpp"
+#include "mixop-table.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const char mixChars[MIX_CHARS + 1] = " ABCDEFGHI~JKLMNOPQR[#STUVWXYZ0123456789.,()+-*/=$<>@;:'";
+
+namespace {
+
+enum Kind { Tape, Disk, CardReader, CardPunch, Printer, Typewriter, PaperTape };
+
+Kind kindOf(int unit)
+{
+    if (unit < 8) return Tape;
+    if (unit < 16) return Disk;
+    return Kind(CardReader + unit - 16);
+}
+
+const int blockWords[] = {100, 100, 16, 16, 24, 14, 14};
+
+constexpr long BLOCK_BYTES = 100 * sizeof(PackedWord);
+constexpr long GROWTH = 64;         // blocks a tape or disk file grows by at a time
+constexpr long DISK_BLOCKS = 1L << 16;
+
+// the code of each host character (lower case as upper case, anything
+// else as a blank)
+struct CharCodes {
+    MIXByte code[256];
+    CharCodes() {
+        std::memset(code, 0, sizeof code);
+        for (int c = 0; c < MIX_CHARS; c++) code[static_cast<unsigned char>(mixChars[c])] = static_cast<MIXByte>(c);
+        for (int c = 'a'; c <= 'z'; c++) code[c] = code[c - 'a' + 'A'];
+    }
+};
+
+const CharCodes charCodes;
+
+// a host file mapped into memory, as long as the file
+class MappedFile {
+public:
+    MappedFile() :data(nullptr), size(0), fd(-1), writable(false) {}
+    ~MappedFile() { close(); }
+
+    bool open(const std::string &path, bool write)
+    {
+        fd = ::open(path.c_str(), write ? O_RDWR | O_CREAT : O_RDONLY, 0666);
+        if (fd < 0) return false;
+        writable = write;
+        struct stat st;
+        if (fstat(fd, &st) != 0) return false;
+        size = static_cast<size_t>(st.st_size);
+        return map();
+    }
+    // make the file at least bytes long (the new part reads as +0 words)
+    bool grow(size_t bytes)
+    {
+        if (bytes <= size) return true;
+        if (data) munmap(data, size);
+        data = nullptr;
+        if (ftruncate(fd, static_cast<off_t>(bytes)) != 0) return false;
+        size = bytes;
+        return map();
+    }
+    void close()
+    {
+        if (data) munmap(data, size);
+        if (fd >= 0) ::close(fd);
+        data = nullptr;
+        size = 0;
+        fd = -1;
+    }
+    bool isOpen() const { return fd >= 0; }
+
+    char *data;
+    size_t size;
+
+private:
+    int fd;
+    bool writable;
+
+    bool map()
+    {
+        if (size == 0) return true; // (nothing to map yet)
+        void *p = mmap(nullptr, size, PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) return false;
+        data = static_cast<char*>(p);
+        return true;
+    }
+};
+
+struct Unit {
+    Kind kind;
+    MappedFile file;          // tapes, disks, and the units that read
+    std::FILE *out;           // the units that write text
+    long position;            // tape: the next block; text input: the next byte
+
+    // the operation under way: the host thread does work, then clears busy
+    enum Work { Page, Flush, Read, Write } work;
+    std::atomic<bool> busy;
+    long from;                // Page, Flush: the block's place in the file
+    int target;               // IN: where the block goes in memory, -1 if nowhere
+    std::vector<PackedWord> words; // Read: the block read
+    std::string line;         // Write: the text
+
+    Unit() :kind(Tape), out(nullptr), position(0), work(Page),
+            busy(false), from(0), target(-1) {}
+};
+
+} // namespace
+
+struct Devices {
+    DeviceFiles files;
+    Unit units[UNITS];
+    const char *error;        // (for deviceError)
+    int inputFirst, inputEnd; // memory filled in by input since takeInput
+    std::function<void(int)> ready; // (for waitForUnits)
+    int waiting;              // the unit it stopped with Stop::Waiting for
+
+    IOHost *host;             // null until the first operation, without one given
+    std::unique_ptr<IOHost> own;
+
+    Devices(const DeviceFiles &files, IOHost *host);
+    ~Devices();
+
+    void start(int unit);
+    bool mustWait(MIXMachine &m, int unit);
+    void settle(MIXMachine &m, Unit &u);
+    void perform(Unit &u);
+};
+
+Devices::Devices(const DeviceFiles &files, IOHost *host)
+:files(files), error(nullptr), inputFirst(ADDR_CAP), inputEnd(0), waiting(-1), host(host)
+{
+    for (int i = 0; i < UNITS; i++) units[i].kind = kindOf(i);
+}
+
+Devices::~Devices()
+{
+    // (a shared host may still have work of ours queued)
+    if (host) {
+        std::unique_lock<std::mutex> g(host->lock);
+        for (int i = 0; i < UNITS; i++) {
+            Unit &u = units[i];
+            host->done.wait(g, [&u] { return !u.busy.load(std::memory_order_acquire); });
+        }
+    }
+    for (int i = 0; i < UNITS; i++) {
+        if (units[i].out && units[i].out != stdout) std::fclose(units[i].out);
+    }
+}
+
+// hand unit over to the host thread
+void Devices::start(int unit)
+{
+    if (!host) {
+        own.reset(new IOHost);
+        host = own.get();
+    }
+    units[unit].busy.store(true, std::memory_order_relaxed);
+    host->start(this, unit);
+}
+
+// true (with m stopped) if m waits for its units itself and unit is busy
+bool Devices::mustWait(MIXMachine &m, int unit)
+{
+    if (!ready || !units[unit].busy.load(std::memory_order_acquire)) return false;
+    waiting = unit;
+    stopMachine(m, Stop::Waiting);
+    return true;
+}
+
+IOHost::IOHost(unsigned threads)
+:size(threads ? threads : 1), quit(false)
+{
+}
+
+IOHost::~IOHost()
+{
+    {
+        std::lock_guard<std::mutex> g(lock);
+        quit = true;
+    }
+    wake.notify_all();
+    for (std::thread &t : threads) t.join();
+}
+
+void IOHost::start(Devices *d, int unit)
+{
+    {
+        std::lock_guard<std::mutex> g(lock);
+        queue.push_back(std::make_pair(d, unit));
+        if (threads.size() < size && threads.size() < queue.size()) threads.push_back(std::thread(&IOHost::work, this));
+    }
+    wake.notify_one();
+}
+
+void IOHost::work()
+{
+    std::unique_lock<std::mutex> g(lock);
+    for (;;) {
+        wake.wait(g, [this] { return quit || !queue.empty(); });
+        if (queue.empty()) return;
+        Devices *d = queue.front().first;
+        int unit = queue.front().second;
+        queue.pop_front();
+        g.unlock();
+        d->perform(d->units[unit]);
+        g.lock();
+        d->units[unit].busy.store(false, std::memory_order_release);
+        // (under the lock, so that d is not deleted under it: see ~Devices)
+        if (d->ready) d->ready(unit);
+        done.notify_all();
+    }
+}
+
+// the slow part of an operation, on the host thread
+void Devices::perform(Unit &u)
+{
+    switch (u.work) {
+        case Unit::Page: {
+            // touch the pages of the block, so that the copy into memory
+            // does not wait for the disk
+            long end = std::min<long>(u.from + BLOCK_BYTES, static_cast<long>(u.file.size));
+            volatile char sink = 0;
+            for (long i = u.from; i < end; i += 4096) sink = sink + u.file.data[i];
+            if (u.from < end) sink = sink + u.file.data[end - 1];
+            break;
+        }
+        case Unit::Flush: {
+            long page = sysconf(_SC_PAGESIZE);
+            long start = u.from / page * page;
+            msync(u.file.data + start, u.from + BLOCK_BYTES - start, MS_ASYNC);
+            break;
+        }
+        case Unit::Read: {
+            // the next line, as characters of five to a word; short lines
+            // are filled out with blanks
+            const char *p = u.file.data + u.position, *end = u.file.data + u.file.size;
+            const char *eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+            if (!eol) eol = end;
+            u.position = eol - u.file.data + (eol < end);
+            if (eol > p && eol[-1] == '\r') eol--;
+            long length = eol - p;
+            for (size_t w = 0; w < u.words.size(); w++) {
+                PackedWord word = 0;
+                for (long j = 5*w; j < 5*static_cast<long>(w) + 5; j++) {
+                    MIXByte c = j < length ? charCodes.code[static_cast<unsigned char>(p[j])] : 0;
+                    word = word << 6 | c;
+                }
+                u.words[w] = word;
+            }
+            break;
+        }
+        case Unit::Write:
+            std::fputs(u.line.c_str(), u.out);
+            std::fflush(u.out);
+            break;
+    }
+}
+
+// wait for the unit to be ready, then put the block it read into memory
+void Devices::settle(MIXMachine &m, Unit &u)
+{
+    if (u.busy.load(std::memory_order_acquire)) {
+        std::unique_lock<std::mutex> g(host->lock);
+        host->done.wait(g, [&u] { return !u.busy.load(std::memory_order_acquire); });
+    }
+    if (u.target < 0) return;
+    int n = blockWords[u.kind];
+    if (u.kind == Tape || u.kind == Disk) {
+        // straight out of the mapping; past the end of the file is +0
+        long have = std::max<long>(0, std::min<long>(BLOCK_BYTES, static_cast<long>(u.file.size) - u.from));
+        if (have > 0) std::memcpy(&m.Memory[u.target], u.file.data + u.from, have);
+        std::memset(reinterpret_cast<char*>(&m.Memory[u.target]) + have, 0, BLOCK_BYTES - have);
+    } else {
+        for (int i = 0; i < n; i++) m.Memory[u.target + i].w = u.words[i];
+    }
+    for (int i = 0; i < n; i++) invalidateDecoded(m, u.target + i);
+    inputFirst = std::min(inputFirst, u.target);
+    inputEnd = std::max(inputEnd, u.target + n);
+    u.target = -1;
+}
+
+namespace {
+
+static_assert(sizeof(MIXWord) == sizeof(PackedWord), "tape blocks are copied word for word");
+
+// stop m with a device error, for the reason why
+void fail(MIXMachine &m, const char *why)
+{
+    m.devices->error = why;
+    stopMachine(m, Stop::DeviceError);
+}
+
+// the unit of in, once it is ready; null (with m stopped) if there is none
+Unit *unitFor(MIXMachine &m, const MIXInstr &in)
+{
+    if (!m.devices) {
+        stopMachine(m, Stop::DeviceError);
+        return nullptr;
+    }
+    if (in.field >= UNITS) {
+        fail(m, "there is no such unit");
+        return nullptr;
+    }
+    if (m.devices->mustWait(m, in.field)) return nullptr;
+    Unit &u = m.devices->units[in.field];
+    m.devices->settle(m, u);
+    return &u;
+}
+
+// open the file of unit for reading (tapes and disks: for writing too)
+bool openInput(MIXMachine &m, Unit &u, int unit)
+{
+    if (u.file.isOpen()) return true;
+    if (u.file.open(m.devices->files.path[unit], u.kind == Tape || u.kind == Disk)) return true;
+    u.file.close();
+    fail(m, "its file cannot be opened");
+    return false;
+}
+
+bool openOutput(MIXMachine &m, Unit &u, int unit)
+{
+    if (u.kind == Tape || u.kind == Disk) return openInput(m, u, unit);
+    if (!u.out) u.out = u.kind == Typewriter ? stdout : std::fopen(m.devices->files.path[unit].c_str(), "w");
+    if (u.out) return true;
+    fail(m, "its file cannot be opened");
+    return false;
+}
+
+// the block of a disk: rX, which must be in range
+bool diskBlock(MIXMachine &m, Unit &u, long &block)
+{
+    block = packedValue(m.Reg[REG_X].w);
+    if (block >= 0 && block < DISK_BLOCKS) return true;
+    fail(m, "the block number in rX is out of range");
+    return false;
+}
+
+// the block at M, which has to fit in memory
+bool blockAddress(MIXMachine &m, const MIXInstr &in, const Unit &u, int &M)
+{
+    M = effectiveAddress(m, in);
+    if (M >= 0 && M + blockWords[u.kind] <= ADDR_CAP) return true;
+    stopMachine(m, Stop::AddressFault);
+    return false;
+}
+
+} // namespace
+
+void input(MIXMachine &m, const MIXInstr &in)
+{
+    Unit *u = unitFor(m, in);
+    int M;
+    if (!u || !blockAddress(m, in, *u, M)) return;
+    switch (u->kind) {
+        case Tape:
+        case Disk: {
+            long block;
+            if (u->kind == Tape) block = u->position++;
+            else if (!diskBlock(m, *u, block)) return;
+            if (!openInput(m, *u, in.field)) return;
+            u->from = block * BLOCK_BYTES;
+            u->work = Unit::Page;
+            break;
+        }
+        case CardReader:
+        case Typewriter:
+        case PaperTape:
+            if (!openInput(m, *u, in.field)) return;
+            if (static_cast<size_t>(u->position) >= u->file.size) {
+                fail(m, "there is no more input");
+                return;
+            }
+            u->words.resize(blockWords[u->kind]);
+            u->work = Unit::Read;
+            break;
+        default:
+            fail(m, "the unit cannot read");
+            return;
+    }
+    u->target = M;
+    m.devices->start(in.field);
+}
+
+void output(MIXMachine &m, const MIXInstr &in)
+{
+    Unit *u = unitFor(m, in);
+    int M;
+    if (!u || !blockAddress(m, in, *u, M)) return;
+    switch (u->kind) {
+        case Tape:
+        case Disk: {
+            long block;
+            if (u->kind == Tape) block = u->position++;
+            else if (!diskBlock(m, *u, block)) return;
+            if (!openOutput(m, *u, in.field)) return;
+            u->from = block * BLOCK_BYTES;
+            if (!u->file.grow((block / GROWTH + 1) * GROWTH * BLOCK_BYTES)) {
+                fail(m, "its file cannot be extended");
+                return;
+            }
+            std::memcpy(u->file.data + u->from, &m.Memory[M], BLOCK_BYTES);
+            u->work = Unit::Flush;
+            break;
+        }
+        case CardPunch:
+        case Printer:
+        case Typewriter: {
+            if (!openOutput(m, *u, in.field)) return;
+            std::string &line = u->line;
+            line.clear();
+            for (int i = 0; i < blockWords[u->kind]; i++) {
+                for (int j = 0; j < 5; j++) {
+                    MIXByte c = m.Memory[M + i].byte(j);
+                    line += c < MIX_CHARS ? mixChars[c] : '?';
+                }
+            }
+            line.erase(line.find_last_not_of(' ') + 1);
+            line += '\n';
+            u->work = Unit::Write;
+            break;
+        }
+        default:
+            fail(m, "the unit cannot write");
+            return;
+    }
+    m.devices->start(in.field);
+}
+
+// tapes: rewind (M = 0) or skip M blocks; disks: nothing to do, as IN and
+// OUT take the block from rX; printer: new page; paper tape: rewind
+void ioControl(MIXMachine &m, const MIXInstr &in)
+{
+    Unit *u = unitFor(m, in);
+    if (!u) return;
+    int M = effectiveAddress(m, in);
+    switch (u->kind) {
+        case Tape:
+            u->position = M == 0 ? 0 : std::max<long>(0, u->position + M);
+            return;
+        case Disk:
+            return;
+        case Printer:
+            if (M != 0 || !openOutput(m, *u, in.field)) break;
+            u->line.assign(1, '\f');
+            u->work = Unit::Write;
+            m.devices->start(in.field);
+            return;
+        case PaperTape:
+            if (M != 0) break;
+            u->position = 0;
+            return;
+        default:
+            break;
+    }
+    if (m.stop == Stop::Running) fail(m, "the unit cannot do that");
+}
+
+bool unitBusy(MIXMachine &m, const MIXInstr &in)
+{
+    if (!m.devices || in.field >= UNITS) {
+        unitFor(m, in); // (stops m)
+        return false;
+    }
+    if (m.devices->mustWait(m, in.field)) return false;
+    Unit &u = m.devices->units[in.field];
+    if (u.busy.load(std::memory_order_acquire)) return true;
+    m.devices->settle(m, u);
+    return false;
+}
+
+DeviceFiles::DeviceFiles()
+{
+    for (int i = 0; i < 8; i++) path[i] = "tape" + std::to_string(i) + ".mix";
+    for (int i = 8; i < 16; i++) path[i] = "disk" + std::to_string(i) + ".mix";
+    path[16] = "cards.txt";
+    path[17] = "punch.txt";
+    path[18] = "printer.txt";
+    path[19] = "typewriter.txt";
+    path[20] = "papertape.txt";
+}
+
+bool parseUnit(const char *arg, DeviceFiles &files)
+{
+    char *end;
+    long unit = std::strtol(arg, &end, 10);
+    if (end == arg || *end != ':' || unit < 0 || unit >= UNITS || !end[1]) return false;
+    files.path[unit] = end + 1;
+    return true;
+}
+
+void attachDevices(MIXMachine &m, const DeviceFiles &files, IOHost *host)
+{
+    devicesRelease(m);
+    m.devices = new Devices(files, host);
+}
+
+void waitForUnits(MIXMachine &m, std::function<void(int)> ready)
+{
+    m.devices->ready = std::move(ready);
+}
+
+bool unitReady(const MIXMachine &m, int unit)
+{
+    return !m.devices->units[unit].busy.load(std::memory_order_acquire);
+}
+
+void devicesRelease(MIXMachine &m)
+{
+    delete m.devices;
+    m.devices = nullptr;
+}
+
+void finishIO(MIXMachine &m)
+{
+    if (!m.devices) return;
+    for (int i = 0; i < UNITS; i++) m.devices->settle(m, m.devices->units[i]);
+}
+
+bool takeInput(MIXMachine &m, int &first, int &end)
+{
+    if (!m.devices || m.devices->inputFirst >= m.devices->inputEnd) return false;
+    first = m.devices->inputFirst;
+    end = m.devices->inputEnd;
+    m.devices->inputFirst = ADDR_CAP;
+    m.devices->inputEnd = 0;
+    return true;
+}
+
+int blockSize(int unit)
+{
+    return unit >= 0 && unit < UNITS ? blockWords[kindOf(unit)] : 0;
+}
+
+const char *deviceError(const MIXMachine &m)
+{
+    if (!m.devices) return "no I/O units are attached";
+    return m.devices->error ? m.devices->error : "I/O error";
+}
+
+int waitingUnit(const MIXMachine &m)
+{
+    return m.devices ? m.devices->waiting : -1;
+}
@@ -0,0 +1,108 @@
+//
+//  devices.hpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+#ifndef devices_hpp
+#define devices_hpp
+
+#include "mix.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// the I/O units of TAOCP 1.3.1, each backed by a host file:
+//
+//     0-7    tapes          100 words a block, read and written in sequence
+//     8-15   disks/drums    100 words a block, the block number in rX
+//     16     card reader    16 words (80 characters) a card
+//     17     card punch     16 words
+//     18     line printer   24 words (120 characters) a line
+//     19     typewriter     14 words (70 characters); reads its file, types on standard output
+//     20     paper tape     14 words
+//
+// tapes and disks are files of words (PackedWord, as this machine stores
+// them) mapped into memory, so a block moves with one copy between the
+// mapping and Memory. the character units read and write lines of text in
+// the MIX character set (with ~ [ # for delta, sigma and pi).
+//
+// IN, OUT and IOC start an operation and go on at once; the unit is busy
+// until a host thread has done the slow part (paging in the block, writing
+// the line), which JBUS and JRED see. an instruction for a busy unit waits
+// for it (or, with waitForUnits, stops the machine to be run again later).
+// as on the real machine, the words of an IN are only there once the unit
+// is ready: they are put into memory when the program finds that out
+// (JBUS, JRED or the next I/O on the unit) or the run ends.
+constexpr int UNITS = 21;
+
+// the MIX character set: the character of each code, from 0 (blank) to 55
+constexpr int MIX_CHARS = 56;
+extern const char mixChars[MIX_CHARS + 1];
+
+// the host file of each unit. tapes and disks are created if they do not
+// exist; output files are started afresh when first written
+struct DeviceFiles {
+    std::string path[UNITS];
+    DeviceFiles(); // tape0.mix ... tape7.mix, disk8.mix ... disk15.mix, cards.txt,
+                   // punch.txt, printer.txt, typewriter.txt and papertape.txt
+};
+
+// parse "n:path" (from --unit=n:path) into files; false if n is not a unit
+bool parseUnit(const char *arg, DeviceFiles &files);
+
+// host threads that do the slow part of the operations of any number of
+// machines, in the order they were started. a machine without one starts
+// its own (with one thread) when it first needs it
+class IOHost {
+public:
+    explicit IOHost(unsigned threads = 1); // (started when first needed)
+    ~IOHost(); // the machines using it must be gone first
+    IOHost(const IOHost&) = delete;
+    IOHost& operator=(const IOHost&) = delete;
+
+private:
+    friend struct Devices;
+    std::mutex lock;
+    std::condition_variable wake, done;
+    std::deque<std::pair<Devices*, int> > queue;
+    std::vector<std::thread> threads;
+    unsigned size;
+    bool quit;
+
+    void start(Devices *d, int unit);
+    void work();
+};
+
+// give m its I/O units, done on host (if not null). files are opened when a
+// unit is first used
+void attachDevices(MIXMachine &m, const DeviceFiles &files, IOHost *host = nullptr);
+
+// let m wait for its units itself: an instruction that would have to wait
+// for a busy unit (IN, OUT or IOC), or that asks about one (JBUS, JRED),
+// stops m with Stop::Waiting instead, before doing anything. run again once
+// the unit is ready, it goes on as usual, so JBUS and JRED never find the
+// unit busy. ready(unit) is called on a host thread whenever a unit of m
+// becomes ready
+void waitForUnits(MIXMachine &m, std::function<void(int)> ready);
+// true if unit of m has no operation under way
+bool unitReady(const MIXMachine &m, int unit);
+
+// wait for every unit of m to finish, and put the input still on its way
+// into memory. done after each run
+void finishIO(MIXMachine &m);
+
+// the words of memory that input has filled in since the last call, as
+// [first, end); false if there are none
+bool takeInput(MIXMachine &m, int &first, int &end);
+
+// the block size of unit (0 if there is no such unit)
+int blockSize(int unit);
+
+#endif /* devices_hpp */
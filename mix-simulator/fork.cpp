@@ -0,0 +1,119 @@
+//
+//  fork.cpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+// the pristine memory lives in a file with no name (memfd on Linux, an
+// unlinked temporary file elsewhere), mapped shared by the PristineMachine
+// and read-only once filled in. each child maps the same file privately,
+// which the host turns into copy-on-write pages.
+
+#include "fork.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+// a file of size bytes that nobody else can see, or -1
+int anonymousFile(std::size_t size)
+{
+#ifdef __linux__
+    int fd = memfd_create("mix-pristine", MFD_CLOEXEC);
+#else
+    const char *dir = std::getenv("TMPDIR");
+    std::string path = std::string(dir ? dir : "/tmp") + "/mix-pristine-XXXXXX";
+    int fd = mkstemp(&path[0]);
+    if (fd >= 0) unlink(path.c_str());
+#endif
+    if (fd >= 0 && ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+} // namespace
+
+PristineMachine::PristineMachine(const MIXMachine &m)
+:programCounter(m.programCounter),
+compIndicator(m.compIndicator), overflowToggle(m.overflowToggle), memory(nullptr), file(-1)
+{
+    std::copy(m.Reg, m.Reg + REGISTERS, Reg);
+    long page = sysconf(_SC_PAGESIZE);
+    bytes = (ADDR_CAP * sizeof(MIXWord) + page - 1) / page * page;
+    file = anonymousFile(bytes);
+    if (file >= 0) {
+        void *p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+        if (p != MAP_FAILED) {
+            memory = static_cast<MIXWord*>(p);
+            std::memcpy(memory, m.Memory, ADDR_CAP * sizeof(MIXWord));
+            mprotect(memory, bytes, PROT_READ);
+        } else {
+            close(file);
+            file = -1;
+        }
+    }
+    if (file < 0) {
+        memory = new MIXWord[ADDR_CAP];
+        std::memcpy(memory, m.Memory, ADDR_CAP * sizeof(MIXWord));
+    }
+}
+
+PristineMachine::~PristineMachine()
+{
+    if (file >= 0) {
+        munmap(memory, bytes);
+        close(file);
+    } else {
+        delete [] memory;
+    }
+}
+
+void PristineMachine::restoreRegisters(MIXMachine &child) const
+{
+    std::copy(Reg, Reg + REGISTERS, child.Reg);
+    child.programCounter = programCounter;
+    child.compIndicator = compIndicator;
+    child.overflowToggle = overflowToggle;
+    child.stop = Stop::Running;
+    child.stopLocation = 0;
+    child.stopInstruction = MIXWord();
+}
+
+void PristineMachine::fork(MIXMachine &child) const
+{
+    void *p = file >= 0 ? mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0) : MAP_FAILED;
+    if (p != MAP_FAILED) {
+        if (child.mappedBytes) munmap(child.Memory, child.mappedBytes);
+        else delete [] child.Memory;
+        child.Memory = static_cast<MIXWord*>(p);
+        child.mappedBytes = bytes;
+    } else {
+        std::memcpy(child.Memory, memory, ADDR_CAP * sizeof(MIXWord));
+    }
+    for (int i = 0; i < ADDR_CAP; i++) invalidateDecoded(child, i);
+    child.dirtyPages = 0;
+    restoreRegisters(child);
+}
+
+// (a word is only put back, and its decoded form thrown away, if it differs)
+void PristineMachine::reset(MIXMachine &child) const
+{
+    for (std::uint64_t dirty = child.dirtyPages; dirty; dirty &= dirty - 1) {
+        int first = __builtin_ctzll(dirty) << PAGE_SHIFT;
+        int end = first + PAGE_WORDS < ADDR_CAP ? first + PAGE_WORDS : ADDR_CAP;
+        for (int i = first; i < end; i++) {
+            if (child.Memory[i].w == memory[i].w) continue;
+            child.Memory[i] = memory[i];
+            invalidateDecoded(child, i);
+        }
+    }
+    child.dirtyPages = 0;
+    restoreRegisters(child);
+}
@@ -0,0 +1,56 @@
+//
+//  fork.hpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+#ifndef fork_hpp
+#define fork_hpp
+
+#include "mix.h"
+
+// copy-on-write forks of a machine, for running one loaded program over and
+// over: afresh, or on different input. a PristineMachine keeps the state of
+// a machine just after loading (registers, indicators and memory, but not
+// the I/O units). fork() turns any machine into a copy of it whose memory
+// is a private mapping of the pristine memory, so that the host copies a
+// page only when the child first writes to it; reset() puts a child back
+// into the pristine state by copying back only the pages (of PAGE_WORDS
+// words) it has written since it was forked or last reset, which
+// invalidateDecoded notes in dirtyPages. the child keeps the instructions
+// it has decoded in the other pages, so a program run again after a reset
+// is not decoded again.
+//
+// a PristineMachine only reads its state after it is made, so any number of
+// threads can fork and reset their own machines from the same one. it must
+// outlive the resets, but not the children. if the host cannot share the
+// memory (no shared file can be made) a fork gets a copy of it instead,
+// which works the same but costs a copy of memory.
+class PristineMachine {
+public:
+    explicit PristineMachine(const MIXMachine &m);
+    ~PristineMachine();
+    PristineMachine(const PristineMachine&) = delete;
+    PristineMachine& operator=(const PristineMachine&) = delete;
+
+    // make child a copy of the pristine machine; whatever it held is lost
+    void fork(MIXMachine &child) const;
+    // put child, forked from this, back into the pristine state, in time
+    // proportional to the number of pages it has written
+    void reset(MIXMachine &child) const;
+
+private:
+    MIXWord Reg[REGISTERS];
+    int programCounter;
+    signed char compIndicator;
+    bool overflowToggle;
+
+    MIXWord *memory; // ADDR_CAP words, mapped from file (or allocated if file < 0)
+    int file;
+    std::size_t bytes;
+
+    void restoreRegisters(MIXMachine &child) const;
+};
+
+#endif /* fork_hpp */
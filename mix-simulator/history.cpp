@@ -0,0 +1,196 @@
+//
+//  history.cpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+// the log is a ring of 8-byte entries; positions in it are counted from
+// the start, so that a checkpoint can say where the log was when it was
+// taken. going back to step n takes the first checkpoint at or after n
+// (if there is one before now), and undoes the instructions from there
+// back to n.
+
+#include "history.hpp"
+#include "interpreter.hpp"
+#include "variants.hpp"
+#include "devices.hpp"
+#include "trace.hpp"
+#include <algorithm>
+
+History::History(std::size_t maxBytes, long long interval)
+:begin(0), end(0), first(0), current(0), interval(interval > 0 ? interval : 1)
+{
+    // an eighth for checkpoints, the rest for the log (which needs room for
+    // at least one instruction: 100 words of input)
+    std::size_t checkpointBytes = sizeof(Checkpoint) + ADDR_CAP * sizeof(MIXWord);
+    maxCheckpoints = maxBytes / 8 / checkpointBytes;
+    // (a power of two, to find an entry with a mask)
+    std::size_t entries = (maxBytes - maxCheckpoints * checkpointBytes) / sizeof(Change);
+    for (limit = 256; limit * 2 <= entries; limit *= 2) { }
+    log.reset(new Change[limit]); // (left uninitialized: the host only gives it pages as they are used)
+}
+
+void History::clear()
+{
+    begin = end = 0;
+    first = current = 0;
+    checkpoints.clear();
+}
+
+void History::add(std::uint16_t where, std::uint16_t slot, PackedWord value)
+{
+    if (end - begin == limit) forgetOldest();
+    Change &c = log[end++ & (limit - 1)];
+    c.where = where;
+    c.slot = slot;
+    c.value = value;
+}
+
+// the log is full: drop the entries of the oldest instruction
+void History::forgetOldest()
+{
+    while (log[begin & (limit - 1)].where != STEP) begin++;
+    begin++;
+    first++;
+    while (!checkpoints.empty() && checkpoints.front().step < first) checkpoints.pop_front();
+}
+
+void History::checkpoint(const MIXMachine &m)
+{
+    if (!maxCheckpoints || (!checkpoints.empty() && checkpoints.back().step == current)) return;
+    Checkpoint c;
+    if (checkpoints.size() == maxCheckpoints) {
+        c = std::move(checkpoints.front()); // (reusing its memory)
+        checkpoints.pop_front();
+    }
+    c.step = current;
+    c.position = end;
+    std::copy(m.Reg, m.Reg + REGISTERS, c.Reg);
+    c.programCounter = m.programCounter;
+    c.compIndicator = m.compIndicator;
+    c.overflowToggle = m.overflowToggle;
+    c.memory.assign(m.Memory, m.Memory + ADDR_CAP);
+    checkpoints.push_back(std::move(c));
+}
+
+Stop History::run(MIXMachine &m, long long budget, long long &steps)
+{
+    if (!startRun(m)) return m.stop;
+    const RegisterMap reg(m);
+    int from, to;
+    takeInput(m, from, to); // (input from before is not ours to undo)
+    long long n = 0, next = (current + interval - 1) / interval * interval;
+    for (; !budget || n < budget; n++) {
+        if (current == next) {
+            checkpoint(m);
+            next += interval;
+        }
+        int pc = m.programCounter;
+        const MIXInstr &in = m.Decoded[pc];
+        if (!in.op) decodeInstruction(m, pc);
+        Opcode oc = in.oc;
+        std::uint16_t slot = static_cast<std::uint16_t>(pc | (m.compIndicator + 1) << 12 | (m.overflowToggle ? 1 << 14 : 0));
+
+        // what it may change, as it was
+        int r1 = registerWrites.first[oc], r2 = registerWrites.second[oc];
+        PackedWord old1 = *reg.at[r1], old2 = *reg.at[r2];
+        int target, count = wordsWritten(m, in, target);
+        if (target < 0) count = 0; // (it will fault)
+        count = std::min(count, ADDR_CAP - target);
+        PackedWord words[64];
+        for (int k = 0; k < count; k++) words[k] = m.Memory[target + k].w;
+        bool io = oc >= JBUS && oc <= JRED && m.devices;
+        if (io) before.assign(m.Memory, m.Memory + ADDR_CAP);
+
+        bool running = stepChecked(m);
+        // an instruction that faulted stored nothing (one that ran off the
+        // end of memory afterwards did; so may an IN that ran out of input)
+        bool faulted = !running && m.stopLocation == pc && m.stop != Stop::Halted;
+        std::uint64_t mark = end;
+        if (!faulted) {
+            for (int k = 0; k < count; k++) add(static_cast<std::uint16_t>(target + k), 0, words[k]);
+        }
+        if (*reg.at[r1] != old1) add(static_cast<std::uint16_t>(REGISTER + r1), 0, old1);
+        if (*reg.at[r2] != old2) add(static_cast<std::uint16_t>(REGISTER + r2), 0, old2);
+        if (io && takeInput(m, from, to)) {
+            for (int i = from; i < to; i++) {
+                if (m.Memory[i].w != before[i].w) add(static_cast<std::uint16_t>(i), 0, before[i].w);
+            }
+        }
+        if (!faulted || end != mark) {
+            add(STEP, slot, static_cast<PackedWord>(end - mark));
+            current++;
+        }
+        if (!running) {
+            if (m.stop == Stop::Halted) steps++;
+            return m.stop;
+        }
+        steps++;
+    }
+    stopAt(m, Stop::Budget, m.programCounter);
+    return Stop::Budget;
+}
+
+// take back the last instruction
+void History::undo(MIXMachine &m)
+{
+    const RegisterMap reg(m);
+    Change s = log[--end & (limit - 1)];
+    for (PackedWord k = s.value; k; k--) {
+        const Change &c = log[--end & (limit - 1)];
+        if (c.where >= REGISTER) {
+            *reg.at[c.where - REGISTER] = c.value;
+        } else {
+            m.Memory[c.where].w = c.value;
+            invalidateDecoded(m, c.where);
+        }
+    }
+    m.programCounter = s.slot & ADDR_MASK;
+    m.compIndicator = static_cast<signed char>((s.slot >> 12 & 3) - 1);
+    m.overflowToggle = (s.slot >> 14 & 1) != 0;
+    current--;
+}
+
+bool History::goTo(MIXMachine &m, long long n)
+{
+    if (n < first || n > current) return false;
+    auto c = std::lower_bound(checkpoints.begin(), checkpoints.end(), n,
+                              [](const Checkpoint &c, long long step) { return c.step < step; });
+    if (c != checkpoints.end() && c->step < current) {
+        std::copy(c->Reg, c->Reg + REGISTERS, m.Reg);
+        m.programCounter = c->programCounter;
+        m.compIndicator = c->compIndicator;
+        m.overflowToggle = c->overflowToggle;
+        for (int i = 0; i < ADDR_CAP; i++) {
+            if (m.Memory[i].w == c->memory[i].w) continue;
+            m.Memory[i] = c->memory[i];
+            invalidateDecoded(m, i);
+        }
+        end = c->position;
+        current = c->step;
+    }
+    while (current > n) undo(m);
+    // (what came after is forgotten)
+    while (!checkpoints.empty() && checkpoints.back().step > n) checkpoints.pop_back();
+    m.stop = Stop::Running;
+    m.stopLocation = 0;
+    m.stopInstruction = MIXWord();
+    return true;
+}
+
+bool History::reverseContinue(MIXMachine &m, const std::function<bool(int)> &at,
+                              const std::function<bool(int)> &written)
+{
+    std::uint64_t position = end;
+    for (long long step = current; step > first; step--) {
+        const Change &s = log[--position & (limit - 1)];
+        bool found = at && at(s.slot & ADDR_MASK);
+        for (PackedWord k = s.value; k; k--) {
+            const Change &c = log[--position & (limit - 1)];
+            found |= written && c.where < REGISTER && written(c.where);
+        }
+        if (found) return goTo(m, step - 1);
+    }
+    return false;
+}
@@ -0,0 +1,109 @@
+//
+//  history.hpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+#ifndef history_hpp
+#define history_hpp
+
+#include "mix.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// a run that can be stepped backward. History::run executes a machine like
+// runChecked, keeping an undo log of what each instruction changed: the old
+// value of each register it wrote (rA for a load or ADD, rA and rX for MUL,
+// DIV and the shifts, rJ for a jump taken...), of each word it stored
+// (MOVE and input give one for each word) and the indicators and location
+// it ran with. a load is 16 bytes of log, a jump not taken 8. every
+// `interval` instructions it also keeps a full checkpoint of the machine,
+// so that going back a long way is a copy of memory and at most `interval`
+// undos rather than one undo for every instruction in between.
+//
+// the log and the checkpoints together stay within the memory given to the
+// History: once it is full, the oldest instructions are forgotten, so the
+// history reaches back as far as it has room for. running on after going
+// back forgets what had been undone.
+//
+// the steps are counted from the first run (or clear()): step n is the state
+// after n instructions, before instruction n + 1. output that has gone to a
+// unit stays gone; input that arrives after the end of a run (finishIO) is
+// not part of any instruction and is not undone.
+class History {
+public:
+    // at most maxBytes of log and checkpoints, with a checkpoint every
+    // interval instructions
+    explicit History(std::size_t maxBytes = 64 << 20, long long interval = 1 << 16);
+    History(const History&) = delete;
+    History& operator=(const History&) = delete;
+
+    // run m like runChecked, recording every instruction. m must be the
+    // machine of the history so far, or the first run after clear()
+    Stop run(MIXMachine &m, long long budget, long long &steps);
+
+    // the step m is at, and the earliest one it can go back to
+    long long now() const { return current; }
+    long long oldest() const { return first; }
+
+    // put m back the way it was at step n (oldest() <= n <= now()), ready to
+    // run on from there; false if n is out of reach, and m is left alone
+    bool goTo(MIXMachine &m, long long n);
+    bool stepBack(MIXMachine &m, long long n = 1) { return goTo(m, current - n); }
+    // go back to the last time an instruction at a location for which at()
+    // is true was about to run, or one that was about to write a word for
+    // which written() is true (either may be empty); false if there was none
+    // within reach (m is left alone)
+    bool reverseContinue(MIXMachine &m, const std::function<bool(int)> &at,
+                         const std::function<bool(int)> &written = nullptr);
+    bool reverseContinue(MIXMachine &m, int location)
+    {
+        return reverseContinue(m, [location](int loc) { return loc == location; });
+    }
+
+    // forget everything, to start recording a new run
+    void clear();
+
+private:
+    // an entry of the log: a word or register and its old value. the
+    // entries of each instruction are followed by a STEP entry, with its
+    // location and indicators in slot and the number of entries in value
+    struct Change {
+        std::uint16_t where;
+        std::uint16_t slot;
+        PackedWord value;
+    };
+    static constexpr std::uint16_t REGISTER = 0x1000; // where: + a TraceWhat
+    static constexpr std::uint16_t STEP = 0xFFFF;
+
+    struct Checkpoint {
+        long long step;
+        std::uint64_t position; // of the log at that step
+        MIXWord Reg[REGISTERS];
+        int programCounter;
+        signed char compIndicator;
+        bool overflowToggle;
+        std::vector<MIXWord> memory;
+    };
+
+    std::unique_ptr<Change[]> log; // a ring of limit entries: [begin, end), counted from the first
+    std::size_t limit;
+    std::uint64_t begin, end;
+    long long first, current;      // the steps at begin and at end
+    std::deque<Checkpoint> checkpoints; // in step order, all within reach
+    std::size_t maxCheckpoints;
+    long long interval;
+    std::vector<MIXWord> before;   // memory before an I/O instruction
+
+    void add(std::uint16_t where, std::uint16_t slot, PackedWord value);
+    void forgetOldest();
+    void checkpoint(const MIXMachine &m);
+    void undo(MIXMachine &m);
+};
+
+#endif /* history_hpp */
@@ -0,0 +1,224 @@
+//
+//  image.cpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+#include "image.hpp"
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(sizeof(MIXWord) == sizeof(PackedWord), "memory is copied as packed words");
+static_assert(offsetof(MachineImage, memory) == 52 && sizeof(MachineImage) == 52 + 4*ADDR_CAP,
+              "the layout of a machine image is fixed");
+
+namespace {
+
+constexpr PackedWord WORD_BITS = SIGN_BIT | MAG_MASK;
+
+// a machine image file, mapped read-only; image is null if the file is
+// not one
+class MappedImage {
+public:
+    explicit MappedImage(const char *path) :image(nullptr)
+    {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size == static_cast<off_t>(sizeof(MachineImage))) {
+            void *p = mmap(nullptr, sizeof(MachineImage), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) image = static_cast<const MachineImage*>(p);
+        }
+        close(fd);
+        if (image && (image->magic != MACHINE_IMAGE_MAGIC || image->words != ADDR_CAP)) unmap();
+    }
+    ~MappedImage() { unmap(); }
+    MappedImage(const MappedImage&) = delete;
+    MappedImage& operator=(const MappedImage&) = delete;
+
+    const MachineImage *image;
+
+private:
+    void unmap()
+    {
+        if (image) munmap(const_cast<MachineImage*>(image), sizeof(MachineImage));
+        image = nullptr;
+    }
+};
+
+} // namespace
+
+// parse "LLLL: +1 bb bb bb bb bb"; false if the line is not a word
+static bool parseWord(const char *line, int &loc, PackedWord &w)
+{
+    char *end;
+    long l = std::strtol(line, &end, 10);
+    if (end == line || *end != ':') return false;
+    const char *p = end + 1;
+    long sgn = std::strtol(p, &end, 10);
+    if (end == p || (sgn != 1 && sgn != -1)) return false;
+    w = sgn < 0 ? SIGN_BIT : 0;
+    for (int j = 0; j < 5; j++) {
+        p = end;
+        long b = std::strtol(p, &end, 8);
+        if (end == p || b < 0 || b >= NUMBASE) return false;
+        w |= PackedWord(b) << (24 - 6*j);
+    }
+    loc = static_cast<int>(l);
+    return true;
+}
+
+// true for a line an image may have besides its words: a blank one, or
+// one of the registers that --state prints before them
+static bool otherLine(const char *line)
+{
+    static const char *const names[] = {"A:", "X:", "I1:", "I2:", "I3:", "I4:", "I5:", "I6:", "J:", "overflow:"};
+    line += std::strspn(line, " \t\r");
+    if (!*line) return true;
+    for (const char *name : names) {
+        if (std::strncmp(line, name, std::strlen(name)) == 0) return true;
+    }
+    return false;
+}
+
+bool readImage(const char *path, MemoryImage &image)
+{
+    std::FILE *f = std::fopen(path, "r");
+    if (!f) return false;
+    std::uint32_t magic = 0;
+    if (std::fread(&magic, sizeof magic, 1, f) == 1 && magic == MACHINE_IMAGE_MAGIC) {
+        std::fclose(f);
+        MappedImage mapped(path);
+        if (!mapped.image) return false;
+        image.resize(ADDR_CAP);
+        for (int i = 0; i < ADDR_CAP; i++) image[i] = mapped.image->memory[i] & WORD_BITS;
+        return true;
+    }
+    std::rewind(f);
+    std::string text;
+    char buffer[4096];
+    for (std::size_t n; (n = std::fread(buffer, 1, sizeof buffer, f)) > 0; ) text.append(buffer, n);
+    bool ok = !std::ferror(f);
+    std::fclose(f);
+    return ok && parseImage(text.data(), text.size(), image);
+}
+
+bool parseImage(const char *text, std::size_t size, MemoryImage &image)
+{
+    image.assign(ADDR_CAP, 0);
+    const char *end = text + size;
+    std::string line;
+    bool words = false;
+    while (text < end) {
+        const char *eol = static_cast<const char*>(std::memchr(text, '\n', end - text));
+        if (!eol) eol = end;
+        line.assign(text, eol); // (parseWord needs it to end)
+        text = eol + (eol < end);
+        int loc;
+        PackedWord w;
+        if (!parseWord(line.c_str(), loc, w)) {
+            if (otherLine(line.c_str())) continue;
+            return false;
+        }
+        if (loc < 0 || loc >= ADDR_CAP) return false;
+        image[loc] = w;
+        words = true;
+    }
+    return words;
+}
+
+void loadImage(MIXMachine &m, const MemoryImage &image)
+{
+    for (int i = 0; i < ADDR_CAP; i++) {
+        m.Memory[i].w = image[i];
+        invalidateDecoded(m, i);
+    }
+}
+
+void saveState(const MIXMachine &m, MachineImage &image)
+{
+    image.magic = MACHINE_IMAGE_MAGIC;
+    image.words = ADDR_CAP;
+    image.A = m.Reg[REG_A].w;
+    image.X = m.Reg[REG_X].w;
+    for (int i = 1; i < 7; i++) image.I[i-1] = m.Reg[i].w;
+    image.J = m.Reg[REG_J].w;
+    image.programCounter = m.programCounter;
+    image.compIndicator = m.compIndicator;
+    image.overflowToggle = m.overflowToggle;
+    image.reserved[0] = image.reserved[1] = 0;
+    std::memcpy(image.memory, m.Memory, sizeof image.memory);
+}
+
+void restoreState(MIXMachine &m, const MachineImage &image)
+{
+    m.Reg[REG_A].w = image.A & WORD_BITS;
+    m.Reg[REG_X].w = image.X & WORD_BITS;
+    for (int i = 1; i < 7; i++) m.Reg[i].w = image.I[i-1] & (SIGN_BIT | ADDR_MASK);
+    m.Reg[REG_J].w = image.J & ADDR_MASK;
+    m.programCounter = image.programCounter;
+    m.compIndicator = (image.compIndicator > 0) - (image.compIndicator < 0);
+    m.overflowToggle = image.overflowToggle != 0;
+    m.stop = Stop::Running;
+    for (int i = 0; i < ADDR_CAP; i++) {
+        m.Memory[i].w = image.memory[i] & WORD_BITS;
+        invalidateDecoded(m, i);
+    }
+}
+
+bool writeMachineImage(const char *path, const MIXMachine &m)
+{
+    std::unique_ptr<MachineImage> image(new MachineImage());
+    saveState(m, *image);
+    std::FILE *f = std::fopen(path, "wb");
+    if (!f) return false;
+    bool ok = std::fwrite(image.get(), sizeof *image, 1, f) == 1;
+    return std::fclose(f) == 0 && ok;
+}
+
+bool readMachineImage(const char *path, MIXMachine &m)
+{
+    MappedImage mapped(path);
+    if (!mapped.image) return false;
+    restoreState(m, *mapped.image);
+    return true;
+}
+
+bool restoreMachineImage(const void *data, std::size_t size, MIXMachine &m)
+{
+    if (size != sizeof(MachineImage)) return false;
+    std::unique_ptr<MachineImage> image(new MachineImage);
+    std::memcpy(image.get(), data, size);
+    if (image->magic != MACHINE_IMAGE_MAGIC || image->words != ADDR_CAP) return false;
+    restoreState(m, *image);
+    return true;
+}
+
+bool loadMachine(const char *path, MIXMachine &m)
+{
+    if (readMachineImage(path, m)) return true;
+    MemoryImage image;
+    if (!readImage(path, image)) return false;
+    loadImage(m, image);
+    return true;
+}
+
+bool loadBuffer(const void *data, std::size_t size, MIXMachine &m)
+{
+    std::uint32_t magic = 0;
+    if (size >= sizeof magic) std::memcpy(&magic, data, sizeof magic);
+    if (magic == MACHINE_IMAGE_MAGIC) return restoreMachineImage(data, size, m);
+    MemoryImage image;
+    if (!parseImage(static_cast<const char*>(data), size, image)) return false;
+    loadImage(m, image);
+    return true;
+}
@@ -0,0 +1,73 @@
+//
+//  image.hpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+#ifndef image_hpp
+#define image_hpp
+
+#include "mix.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// a memory image: the contents of all ADDR_CAP words
+typedef std::vector<PackedWord> MemoryImage;
+
+// read an image written as an octal dump: one word per line, as in
+// "0012: +1 01 44 00 05 10" (location in decimal, bytes in octal). blank
+// lines and the registers of a --state dump are skipped, and words not
+// mentioned are +0. a machine image (see below) will also do, for its
+// memory. false if the file cannot be read, a location is out of range,
+// any other line is not a word, or there are no words at all
+bool readImage(const char *path, MemoryImage &image);
+// the same from the size bytes of an octal dump at text
+bool parseImage(const char *text, std::size_t size, MemoryImage &image);
+
+// set the memory of m to image
+void loadImage(MIXMachine &m, const MemoryImage &image);
+
+// a machine image: everything a program needs to go on where it left off
+// (the registers, the indicators, the location of the next instruction and
+// memory), in fixed-width fields in the byte order of the host. a file
+// holds exactly one, so loading it is a mapping and a copy of memory; a
+// file from a host of the other byte order fails the check of the magic
+// number. the I/O units are not part of it.
+constexpr std::uint32_t MACHINE_IMAGE_MAGIC = 0x3158494d; // "MIX1" in little-endian order
+
+struct MachineImage {
+    std::uint32_t magic;
+    std::uint32_t words;         // ADDR_CAP
+    PackedWord A, X;
+    PackedWord I[6];             // I1 to I6
+    PackedWord J;
+    std::int32_t programCounter;
+    std::int8_t compIndicator;
+    std::uint8_t overflowToggle;
+    std::uint8_t reserved[2];
+    PackedWord memory[ADDR_CAP];
+};
+
+// the state of m, at any point between runs
+void saveState(const MIXMachine &m, MachineImage &image);
+// put m back into a saved state (it forgets the instructions it has
+// decoded or compiled). the fields are masked to the sizes of the registers
+void restoreState(MIXMachine &m, const MachineImage &image);
+
+// write the state of m to path as a machine image; false if it cannot
+bool writeMachineImage(const char *path, const MIXMachine &m);
+// restore m from the machine image in path; false (leaving m alone) if
+// the file cannot be mapped or is not a machine image of this machine
+bool readMachineImage(const char *path, MIXMachine &m);
+// the same from the size bytes at data, which need not be aligned
+bool restoreMachineImage(const void *data, std::size_t size, MIXMachine &m);
+
+// load what --load takes into m: a machine image, or else an octal dump
+// (which sets memory only). false (leaving m alone) if it is neither, or
+// the file cannot be read. loadBuffer does the same from memory
+bool loadMachine(const char *path, MIXMachine &m);
+bool loadBuffer(const void *data, std::size_t size, MIXMachine &m);
+
+#endif /* image_hpp */
@@ -0,0 +1,32 @@
+//
+//  interpreter.cpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+#include "interpreter.hpp"
+#include "mixop-table.hpp"
+
+// main event loop: read the next instruction and interpret it
+Stop runTable(MIXMachine &m)
+{
+    if (startRun(m)) {
+        while (stepTable(m)) { }
+    }
+    return m.stop;
+}
+
+Stop runCounted(MIXMachine &m, long long budget, long long &steps)
+{
+    if (!startRun(m)) return m.stop;
+    for (long long n = 0; !budget || n < budget; n++) {
+        if (!stepTable(m)) {
+            if (m.stop == Stop::Halted) steps++; // (the HLT)
+            return m.stop;
+        }
+        steps++;
+    }
+    stopAt(m, Stop::Budget, m.programCounter);
+    return Stop::Budget;
+}
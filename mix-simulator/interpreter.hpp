@@ -0,0 +1,90 @@
+//
+//  interpreter.hpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+#ifndef interpreter_hpp
+#define interpreter_hpp
+
+#include "mix.h"
+
+// the execution engines. all run machine m from its programCounter until it
+// halts or faults, and return why it stopped (see stopMessage for the text).
+// programCounter is then the location of the instruction that stopped it,
+// or the location outside memory that execution went to.
+enum class Engine {
+    Table,    // one call through opTable per instruction
+    Threaded, // direct-threaded dispatch over Decoded[] (computed goto)
+    Jit       // native code for hot blocks, the table loop for the rest
+};
+
+Stop runTable(MIXMachine &m);
+Stop runThreaded(MIXMachine &m);
+Stop runJit(MIXMachine &m);
+
+// execution went to pc, outside memory
+inline Stop fetchFault(MIXMachine &m, int pc)
+{
+    m.programCounter = pc;
+    stopAt(m, Stop::AddressFault, pc);
+    return Stop::AddressFault;
+}
+
+// clear the stop reason of m before a run; false (with an address fault)
+// if it is to start outside memory
+inline bool startRun(MIXMachine &m)
+{
+    m.stop = Stop::Running;
+    if (static_cast<unsigned>(m.programCounter) < ADDR_CAP) return true;
+    fetchFault(m, m.programCounter);
+    return false;
+}
+
+// execute the instruction at programCounter through opTable. false if the
+// machine has stopped (m.stop says why)
+inline bool stepTable(MIXMachine &m)
+{
+    // fetch the decoded instruction, decoding the word on first use
+    const MIXInstr &in = m.Decoded[m.programCounter];
+    if (!in.op) decodeInstruction(m, m.programCounter);
+    Opcode oc = in.oc; // (may be invalidated by a store to itself)
+    in.op(m, in); // call the op table
+    // (this is the concept of "interpretive routine")
+    if (m.stop != Stop::Running) {
+        // HLT or a fault: stay at the instruction (a jump may have moved on)
+        m.programCounter = m.stopLocation;
+        return false;
+    }
+
+    // jump instructions set the location of the next instruction themselves
+    if (!isJumpOpcode(oc)) {
+        ++m.programCounter; // otherwise just increment the program counter
+    }
+    // rudimentary managed environment:
+    if (static_cast<unsigned>(m.programCounter) >= ADDR_CAP) {
+        fetchFault(m, m.programCounter);
+        return false;
+    }
+    return true;
+}
+
+// run m with stepTable for at most budget instructions (0 for no limit),
+// adding the number completed to steps (the HLT counts, a faulting
+// instruction does not)
+Stop runCounted(MIXMachine &m, long long budget, long long &steps);
+
+// true if this build has the threaded engine (it needs computed goto)
+bool haveThreadedEngine();
+// true if this build can compile to native code (x86-64 only)
+bool haveJit();
+
+inline Stop run(MIXMachine &m, Engine e)
+{
+    if (e == Engine::Jit && haveJit()) return runJit(m);
+    if (e != Engine::Table && haveThreadedEngine()) return runThreaded(m);
+    return runTable(m);
+}
+
+#endif /* interpreter_hpp */
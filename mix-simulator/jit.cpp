@@ -0,0 +1,649 @@
+//
+//  jit.cpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+// a simple template JIT for x86-64. the dispatcher counts how often each
+// block leader (a location reached by a jump, or where compiled code left
+// off) is entered; once a leader gets hot, the straight-line run of supported
+// instructions starting there is translated into native code. conditional
+// jumps leave the block only when taken, and jumps back into the block stay
+// in native code. everything else (and cold code) goes through the handlers.
+//
+// loads, stores, adds, immediates, compares and jumps are expanded inline,
+// with the field shifts and masks folded into the code; MUL and DIV call the
+// handlers. a store into a word covered by a block goes through the handler
+// too: it kills that block (and makes the running block return to the
+// dispatcher), so modified code is interpreted until it gets hot again.
+//
+// each machine has its own blocks. the code reaches the machine through a
+// register (r13), memory through rbx and the index registers through r12.
+
+#include "interpreter.hpp"
+#include "mixop-table.hpp"
+#include "debugger.hpp"
+#include <vector>
+#include <cstring>
+#include <cstddef>
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+
+#include <sys/mman.h>
+
+namespace {
+
+typedef int (*JitBlock)(MIXMachine *m); // returns the location to continue at
+
+constexpr int JIT_THRESHOLD = 50;  // entries before a leader is compiled
+constexpr int MAX_BLOCK = 64;      // instructions per block
+constexpr size_t ARENA_SIZE = 1 << 20;
+
+struct BlockInfo {
+    int start, end; // the block covers [start, end)
+    bool live;
+};
+
+} // namespace
+
+// the compiled code of one machine, made on its first run with the JIT.
+// the code addresses the machine through a register, but calls the
+// handlers with copies of instructions kept in this machine's arena
+struct JitState {
+    unsigned char *arena;      // executable memory
+    size_t arenaUsed;
+    JitBlock jitEntry[ADDR_CAP];
+    unsigned short hotness[ADDR_CAP];
+    unsigned short jitCovered[ADDR_CAP]; // (the machine's jitCovered points here)
+    std::vector<BlockInfo> blocks;
+    bool jitKilled; // set when a block is killed; running code checks it after stores
+};
+
+namespace {
+
+// x86 registers (only the 32-bit legacy ones are used as operands)
+enum Reg { EAX, ECX, EDX, EBX, ESP, EBP, ESI, EDI };
+// condition codes
+enum Cond { CC_B = 2, CC_AE = 3, CC_E = 4, CC_NE = 5, CC_BE = 6, CC_A = 7,
+    CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF };
+// group 1 opcodes (reg, reg) and their /digit for immediates
+enum Alu { ADD_OP = 0x01, OR_OP = 0x09, AND_OP = 0x21, SUB_OP = 0x29, XOR_OP = 0x31, CMP_OP = 0x39 };
+
+inline int aluDigit(Alu op) { return op >> 3; }
+
+// writes machine code into a fixed buffer; jumps go to labels that are
+// patched by finish()
+class Emitter {
+public:
+    Emitter(unsigned char *buf, size_t cap) :buf(buf), cap(cap), pos(0) {}
+
+    bool overflowed() const { return pos > cap; }
+    size_t size() const { return pos; }
+
+    void byte(unsigned b) { if (pos < cap) buf[pos] = static_cast<unsigned char>(b); pos++; }
+    void imm32(std::uint32_t v) { for (int i = 0; i < 4; i++) byte(v >> 8*i); }
+    void imm64(std::uint64_t v) { for (int i = 0; i < 8; i++) byte(static_cast<unsigned>(v >> 8*i)); }
+
+    int newLabel() { labels.push_back(-1); return static_cast<int>(labels.size()) - 1; }
+    void bind(int l) { labels[l] = static_cast<long>(pos); }
+    void jcc(Cond c, int l) { byte(0x0F); byte(0x80 | c); rel32(l); }
+    void jmp(int l) { byte(0xE9); rel32(l); }
+    bool finish() {
+        if (overflowed()) return false;
+        for (size_t i = 0; i < fixups.size(); i++) {
+            long target = labels[fixups[i].second];
+            std::int32_t rel = static_cast<std::int32_t>(target - static_cast<long>(fixups[i].first + 4));
+            std::memcpy(buf + fixups[i].first, &rel, 4);
+        }
+        return true;
+    }
+
+    void movRR(Reg dst, Reg src) { byte(0x89); byte(0xC0 | src << 3 | dst); }
+    void movRI(Reg dst, std::uint32_t v) { byte(0xB8 | dst); imm32(v); }
+    void aluRR(Alu op, Reg dst, Reg src) { byte(op); byte(0xC0 | src << 3 | dst); }
+    void aluRI(Alu op, Reg dst, std::uint32_t v) { byte(0x81); byte(0xC0 | aluDigit(op) << 3 | dst); imm32(v); }
+    void testRR(Reg a, Reg b) { byte(0x85); byte(0xC0 | b << 3 | a); }
+    void testRI(Reg r, std::uint32_t v) { byte(0xF7); byte(0xC0 | r); imm32(v); }
+    void shr(Reg r, int n) { byte(0xC1); byte(0xE8 | r); byte(n); }
+    void shl(Reg r, int n) { byte(0xC1); byte(0xE0 | r); byte(n); }
+    void sar(Reg r, int n) { byte(0xC1); byte(0xF8 | r); byte(n); }
+    void neg(Reg r) { byte(0xF7); byte(0xD8 | r); }
+    void setcc(Cond c, Reg r8) { byte(0x0F); byte(0x90 | c); byte(0xC0 | r8); }
+    void subR8(Reg dst, Reg src) { byte(0x28); byte(0xC0 | src << 3 | dst); }
+
+    // r11 = address; then the access goes through [r11]
+    void movR11(const void *p) { byte(0x49); byte(0xBB); imm64(reinterpret_cast<std::uintptr_t>(p)); }
+    void cmpGlobal8Imm(const void *p, unsigned v) { movR11(p); byte(0x41); byte(0x80); byte(0x3B); byte(v); }
+
+    // fields of the machine, which r13 points to: [r13 + disp32]
+    void field(unsigned reg, size_t off) { byte(0x85 | reg << 3); imm32(static_cast<std::uint32_t>(off)); }
+    void loadField(Reg dst, size_t off) { byte(0x41); byte(0x8B); field(dst, off); }
+    void storeField(size_t off, Reg src) { byte(0x41); byte(0x89); field(src, off); }
+    void storeFieldImm(size_t off, std::uint32_t v) { byte(0x41); byte(0xC7); field(0, off); imm32(v); }
+    void loadField8s(Reg dst, size_t off) { byte(0x41); byte(0x0F); byte(0xBE); field(dst, off); }
+    void loadField8u(Reg dst, size_t off) { byte(0x41); byte(0x0F); byte(0xB6); field(dst, off); }
+    void storeField8(size_t off, Reg src) { byte(0x41); byte(0x88); field(src, off); }
+    void storeField8Imm(size_t off, unsigned v) { byte(0x41); byte(0xC6); field(0, off); byte(v); }
+    void loadField64(Reg dst, size_t off) { byte(0x49); byte(0x8B); field(dst, off); }
+
+    // eax = the 16-bit entry ecx of the array at p
+    void loadTable16(const void *p) { movR11(p); byte(0x41); byte(0x0F); byte(0xB7); byte(0x04); byte(0x4B); }
+    // clear m.Decoded[ecx] (rdx = m.Decoded): op = null, label = threadedDecodeLabel,
+    // and set the bit of the page of ecx in m.dirtyPages
+    void invalidateDecoded() {
+        byte(0x8D); byte(0x04); byte(0x49);                     // lea eax, [rcx+rcx*2]
+        byte(0x48); byte(0xC7); byte(0x04); byte(0xC2); imm32(0); // mov qword [rdx+rax*8], 0
+        movR11(&threadedDecodeLabel);
+        byte(0x4D); byte(0x8B); byte(0x1B);                     // mov r11, [r11]
+        byte(0x4C); byte(0x89); byte(0x5C); byte(0xC2); byte(offsetof(MIXInstr, label)); // mov [rdx+rax*8+label], r11
+        movRR(EAX, ECX);
+        shr(EAX, PAGE_SHIFT);
+        byte(0x45); byte(0x31); byte(0xDB);                     // xor r11d, r11d
+        byte(0x49); byte(0x0F); byte(0xAB); byte(0xC3);         // bts r11, rax
+        byte(0x4D); byte(0x09); field(3, offsetof(MIXMachine, dirtyPages)); // or [r13+dirtyPages], r11
+    }
+
+    // rbx holds &Memory[0], r12 holds &Reg[0] (register i is at [r12+4*i])
+    void loadMem(Reg dst, Reg index) { byte(0x8B); byte(dst << 3 | 4); byte(0x80 | index << 3 | EBX); }
+    void storeMem(Reg index, Reg src) { byte(0x89); byte(src << 3 | 4); byte(0x80 | index << 3 | EBX); }
+    void loadReg(Reg dst, int i) { byte(0x41); byte(0x8B); byte(0x44 | dst << 3); byte(0x24); byte(4*i); }
+    void storeReg(int i, Reg src) { byte(0x41); byte(0x89); byte(0x44 | src << 3); byte(0x24); byte(4*i); }
+    void storeRegImm(int i, std::uint32_t v) { byte(0x41); byte(0xC7); byte(0x44); byte(0x24); byte(4*i); imm32(v); }
+
+    void prologue() {
+        byte(0x53);                // push rbx
+        byte(0x41); byte(0x54);    // push r12
+        byte(0x41); byte(0x55);    // push r13 (keeps the stack 16-byte aligned)
+        byte(0x49); byte(0x89); byte(0xFD); // mov r13, rdi (the machine)
+        byte(0x49); byte(0x8B); field(EBX, offsetof(MIXMachine, Memory));   // mov rbx, [r13+Memory]
+        byte(0x4D); byte(0x8D); field(ESP, offsetof(MIXMachine, Reg));      // lea r12, [r13+Reg]
+    }
+    void epilogue() {
+        byte(0x41); byte(0x5D);    // pop r13
+        byte(0x41); byte(0x5C);    // pop r12
+        byte(0x5B);                // pop rbx
+        byte(0xC3);                // ret
+    }
+    // handler(m, in): in is a pointer to a copy of the decoded instruction
+    void callHandler(MIXOp op, const MIXInstr *in) {
+        byte(0x4C); byte(0x89); byte(0xEF);  // mov rdi, r13
+        byte(0x48); byte(0xBE); imm64(reinterpret_cast<std::uintptr_t>(in));  // movabs rsi
+        byte(0x48); byte(0xB8); imm64(reinterpret_cast<std::uintptr_t>(op));  // movabs rax
+        byte(0xFF); byte(0xD0);    // call rax
+    }
+
+private:
+    void rel32(int l) { fixups.push_back(std::make_pair(pos, l)); imm32(0); }
+
+    unsigned char *buf;
+    size_t cap, pos;
+    std::vector<long> labels;
+    std::vector<std::pair<size_t, int> > fixups;
+};
+
+// the translation of one block
+class BlockCompiler {
+public:
+    BlockCompiler(Emitter &e, MIXMachine &m, int start, MIXInstr *pool)
+    :e(e), m(m), jit(*m.jit), start(start), pool(pool), used(0) {
+        epilogueLabel = e.newLabel();
+    }
+
+    // can this instruction be compiled? (the rest is left to the handlers)
+    static bool supported(const MIXInstr &in)
+    {
+        if (in.index > 6 || in.op == debugTrap) return false;
+        int oc = in.oc;
+        if (oc == NOP) return true;
+        if (oc >= JMP && oc <= JXN) return oc == JMP ? in.field <= 9 : in.field <= 5;
+        if (oc >= INCA && oc <= INCX) return in.field <= 3;
+        if ((oc >= ADD && oc <= DIV) || (oc >= LDA && oc <= STZ) || oc >= CMPA) {
+            // a constant address outside memory is left to the interpreter
+            return in.index != 0 || (in.addr >= 0 && in.addr < ADDR_CAP);
+        }
+        return false;
+    }
+    // unconditional jumps end a block
+    static bool endsBlock(const MIXInstr &in) { return in.oc == JMP && in.field <= 1; }
+
+    void compile(int end)
+    {
+        this->end = end;
+        for (int a = start; a < end; a++) instrLabel.push_back(e.newLabel());
+        e.prologue();
+        for (int a = start; a < end; a++) {
+            e.bind(instrLabel[a - start]);
+            instruction(a, m.Decoded[a]);
+        }
+        exitTo(end); // ran off the end of the block
+        for (size_t i = 0; i < stubs.size(); i++) {
+            e.bind(stubs[i].first);
+            exitTo(stubs[i].second);
+        }
+        e.bind(epilogueLabel);
+        e.epilogue();
+    }
+
+private:
+    void exitTo(int pc) { e.movRI(EAX, pc); e.jmp(epilogueLabel); }
+    // a label that leaves the block at pc
+    int exitLabel(int pc) { int l = e.newLabel(); stubs.push_back(std::make_pair(l, pc)); return l; }
+
+    // ecx = M = address + rI. with check, leave the block (before executing
+    // the instruction at a) if M is not a valid memory location
+    void effectiveAddress(int a, const MIXInstr &in, bool check)
+    {
+        e.movRI(ECX, static_cast<std::uint32_t>(in.addr));
+        if (in.index == 0) return; // constant, checked when the block was formed
+        e.loadReg(EDX, in.index);
+        toSigned(EDX, EAX);
+        e.aluRR(ADD_OP, ECX, EDX);
+        if (check) {
+            e.aluRI(CMP_OP, ECX, ADDR_CAP-1);
+            e.jcc(CC_A, exitLabel(a));
+        }
+    }
+    // packed word in r to a signed integer (tmp is clobbered)
+    void toSigned(Reg r, Reg tmp)
+    {
+        e.movRR(tmp, r);
+        e.aluRI(AND_OP, r, MAG_MASK);
+        e.shr(tmp, 30);
+        e.neg(tmp);
+        e.aluRR(XOR_OP, r, tmp);
+        e.aluRR(SUB_OP, r, tmp);
+    }
+    // nonzero signed integer in r to a packed word of the given magnitude mask
+    void toPacked(Reg r, Reg tmp, PackedWord magMask)
+    {
+        e.movRR(tmp, r);
+        e.sar(tmp, 31);
+        e.aluRR(XOR_OP, r, tmp);
+        e.aluRR(SUB_OP, r, tmp);
+        e.aluRI(AND_OP, r, magMask);
+        e.aluRI(AND_OP, tmp, SIGN_BIT);
+        e.aluRR(OR_OP, r, tmp);
+    }
+    // field F of the packed word in r, right-justified
+    void extract(Reg r, Reg tmp, MIXByte field)
+    {
+        const FieldSpec &f = fieldTable[field];
+        bool sign = (f.place & SIGN_BIT) != 0;
+        if (sign) {
+            e.movRR(tmp, r);
+            e.aluRI(AND_OP, tmp, SIGN_BIT);
+        }
+        if (f.shift) e.shr(r, f.shift);
+        e.aluRI(AND_OP, r, f.mask);
+        if (sign) e.aluRR(OR_OP, r, tmp);
+    }
+    // set the overflow toggle if the signed value in r does not fit in a word
+    void checkOverflow(Reg r)
+    {
+        int fits = e.newLabel();
+        e.movRR(EDX, r);
+        e.movRR(EDI, r);
+        e.sar(EDI, 31);
+        e.aluRR(XOR_OP, EDX, EDI);
+        e.aluRR(SUB_OP, EDX, EDI);
+        e.aluRI(CMP_OP, EDX, MAG_MASK);
+        e.jcc(CC_BE, fits);
+        e.storeField8Imm(offsetof(MIXMachine, overflowToggle), 1);
+        e.bind(fits);
+    }
+    // jump to the location in ecx: stay in the block if the target is in it
+    void jumpTo(const MIXInstr &in)
+    {
+        if (in.index == 0 && in.addr >= start && in.addr < end) {
+            e.jmp(instrLabel[in.addr - start]);
+        } else {
+            e.movRR(EAX, ECX);
+            e.jmp(epilogueLabel);
+        }
+    }
+    MIXInstr *copy(const MIXInstr &in) { pool[used] = in; return &pool[used++]; }
+
+    void instruction(int a, const MIXInstr &in)
+    {
+        int oc = in.oc;
+        if (oc == NOP) return;
+        if (oc == ADD || oc == SUB) addSub(a, in);
+        else if (oc == MUL || oc == DIV) {
+            effectiveAddress(a, in, true);
+            e.callHandler(in.op, copy(in));
+        } else if (oc >= LDA && oc <= LDXN) load(a, in);
+        else if (oc >= STA && oc <= STZ) store(a, in);
+        else if (oc == JMP) jump(a, in);
+        else if (oc <= JXN) regJump(a, in);
+        else if (oc <= INCX) immediate(in);
+        else compare(a, in);
+    }
+
+    void addSub(int a, const MIXInstr &in)
+    {
+        effectiveAddress(a, in, true);
+        e.loadMem(EAX, ECX);
+        extract(EAX, EDX, in.field);
+        toSigned(EAX, EDX);
+        if (in.oc == SUB) e.neg(EAX);
+        e.loadReg(ESI, REG_A);
+        e.movRR(ECX, ESI);
+        toSigned(ECX, EDX);
+        e.aluRR(ADD_OP, EAX, ECX);
+        checkOverflow(EAX);
+        result(EAX, ESI, MAG_MASK); // a zero sum keeps the sign of rA
+        e.storeReg(REG_A, EAX);
+    }
+    // signed r to packed; zero takes the sign of the packed word in old
+    void result(Reg r, Reg old, PackedWord magMask)
+    {
+        int nonzero = e.newLabel(), done = e.newLabel();
+        e.testRR(r, r);
+        e.jcc(CC_NE, nonzero);
+        e.movRR(r, old);
+        e.aluRI(AND_OP, r, SIGN_BIT);
+        e.jmp(done);
+        e.bind(nonzero);
+        toPacked(r, EDX, magMask);
+        e.bind(done);
+    }
+
+    void load(int a, const MIXInstr &in)
+    {
+        int reg = in.variant & REGISTER_BITS;
+        effectiveAddress(a, in, true);
+        e.loadMem(EAX, ECX);
+        extract(EAX, EDX, in.field);
+        if (in.variant & LOAD_NEGATIVE) e.aluRI(XOR_OP, EAX, SIGN_BIT); // LDxN
+        if (registerMask[reg] != MAG_MASK) {
+            // too big for an index register: let the interpreter report it
+            e.testRI(EAX, MAG_MASK & ~registerMask[reg]);
+            e.jcc(CC_NE, exitLabel(a));
+        }
+        e.storeReg(reg, EAX);
+    }
+
+    // stores into words no block covers are done inline; the rest go
+    // through the handler, which kills the blocks
+    void store(int a, const MIXInstr &in)
+    {
+        static_assert(sizeof(MIXInstr) == 24 && offsetof(MIXInstr, op) == 0, "MIXInstr layout");
+        const FieldSpec &f = fieldTable[in.field];
+        bool sign = (f.place & SIGN_BIT) != 0;
+        int covered = e.newLabel(), done = e.newLabel();
+        effectiveAddress(a, in, true);
+        e.loadTable16(jit.jitCovered);
+        e.testRR(EAX, EAX);
+        e.jcc(CC_NE, covered);
+
+        // the rightmost bytes (and the sign) of the register into field F
+        e.loadReg(EAX, in.variant);
+        if (sign) {
+            e.movRR(ESI, EAX);
+            e.aluRI(AND_OP, ESI, SIGN_BIT);
+        }
+        e.aluRI(AND_OP, EAX, f.mask);
+        if (f.shift) e.shl(EAX, f.shift);
+        if (sign) e.aluRR(OR_OP, EAX, ESI);
+        e.loadMem(EDX, ECX);
+        e.aluRI(AND_OP, EDX, ~f.place);
+        e.aluRR(OR_OP, EDX, EAX);
+        e.storeMem(ECX, EDX);
+        e.loadField64(EDX, offsetof(MIXMachine, Decoded));
+        e.invalidateDecoded();
+        e.jmp(done);
+
+        e.bind(covered);
+        e.callHandler(in.op, copy(in));
+        // leave if the store modified compiled code
+        e.cmpGlobal8Imm(&jit.jitKilled, 0);
+        e.jcc(CC_NE, exitLabel(a+1));
+        e.bind(done);
+    }
+
+    void immediate(const MIXInstr &in)
+    {
+        enum { INC_F, DEC_F, ENT_F, ENN_F };
+        int reg = in.variant & REGISTER_BITS;
+        PackedWord magMask = registerMask[reg];
+        effectiveAddress(0, in, false);
+        if (in.field == DEC_F || in.field == ENN_F) e.neg(ECX);
+        if (in.field >= ENT_F) {
+            PackedWord zeroSign = (in.variant & NEG_ZERO_ADDR) ? SIGN_BIT : 0;
+            if (in.field == ENN_F) zeroSign ^= SIGN_BIT;
+            e.movRI(ESI, zeroSign);
+            e.movRR(EAX, ECX);
+            result(EAX, ESI, magMask);
+        } else {
+            e.loadReg(ESI, reg);
+            e.movRR(EAX, ESI);
+            toSigned(EAX, EDX);
+            e.aluRR(ADD_OP, EAX, ECX);
+            if (magMask == MAG_MASK) checkOverflow(EAX); // (an index register cannot overflow)
+            result(EAX, ESI, magMask);
+        }
+        e.storeReg(reg, EAX);
+    }
+
+    void compare(int a, const MIXInstr &in)
+    {
+        effectiveAddress(a, in, true);
+        e.loadMem(EAX, ECX);
+        extract(EAX, EDX, in.field);
+        toSigned(EAX, EDX);
+        e.loadReg(ESI, in.variant);
+        extract(ESI, EDX, in.field);
+        toSigned(ESI, EDX);
+        e.aluRR(CMP_OP, ESI, EAX);
+        e.setcc(CC_G, ECX);
+        e.setcc(CC_L, EDX);
+        e.subR8(ECX, EDX);
+        e.storeField8(offsetof(MIXMachine, compIndicator), ECX);
+    }
+
+    void jump(int a, const MIXInstr &in)
+    {
+        enum { UNCOND, UNCOND_SAVE, OV, NOV, LESS, EQ, GREATER, GE, NE, LE };
+        // jcc that skips the jump when the condition fails
+        static const Cond skip[10] = { CC_E, CC_E, CC_E, CC_NE, CC_GE, CC_NE, CC_LE, CC_L, CC_E, CC_G };
+        int notTaken = e.newLabel();
+        effectiveAddress(a, in, false);
+        if (in.field == OV || in.field == NOV) {
+            e.loadField8u(EAX, offsetof(MIXMachine, overflowToggle));
+            e.storeField8Imm(offsetof(MIXMachine, overflowToggle), 0);
+            e.testRR(EAX, EAX);
+            e.jcc(skip[in.field], notTaken);
+        } else if (in.field >= LESS) {
+            e.loadField8s(EAX, offsetof(MIXMachine, compIndicator));
+            e.testRR(EAX, EAX);
+            e.jcc(skip[in.field], notTaken);
+        }
+        if (in.field != UNCOND_SAVE) e.storeRegImm(REG_J, a+1);
+        jumpTo(in);
+        e.bind(notTaken);
+    }
+
+    void regJump(int a, const MIXInstr &in)
+    {
+        // NEG, ZERO, POS, NONNEG, NONZERO, NONPOS
+        static const Cond skip[6] = { CC_GE, CC_NE, CC_LE, CC_L, CC_E, CC_G };
+        int notTaken = e.newLabel();
+        effectiveAddress(a, in, false);
+        e.loadReg(EAX, in.variant);
+        toSigned(EAX, EDX);
+        e.testRR(EAX, EAX);
+        e.jcc(skip[in.field], notTaken);
+        e.storeRegImm(REG_J, a+1);
+        jumpTo(in);
+        e.bind(notTaken);
+    }
+
+    Emitter &e;
+    MIXMachine &m;
+    JitState &jit;
+    int start, end;
+    MIXInstr *pool;
+    int used;
+    int epilogueLabel;
+    std::vector<int> instrLabel;
+    std::vector<std::pair<int, int> > stubs;
+};
+
+// forget all compiled code
+void flushAll(JitState &jit)
+{
+    for (int i = 0; i < ADDR_CAP; i++) {
+        jit.jitEntry[i] = nullptr;
+        jit.jitCovered[i] = 0;
+        jit.hotness[i] = 0;
+    }
+    jit.blocks.clear();
+    jit.arenaUsed = 0;
+}
+
+bool compileBlock(MIXMachine &m, int pc)
+{
+    JitState &jit = *m.jit;
+    // the run of supported instructions starting at pc
+    int end = pc;
+    while (end < ADDR_CAP && end - pc < MAX_BLOCK) {
+        if (!m.Decoded[end].op) decodeInstruction(m, end);
+        const MIXInstr &in = m.Decoded[end];
+        if (!BlockCompiler::supported(in)) break;
+        end++;
+        if (BlockCompiler::endsBlock(in)) break;
+    }
+    if (end == pc) return false;
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        // the copies of instructions passed to handlers go in front of the code
+        size_t poolBytes = (end - pc) * sizeof(MIXInstr);
+        size_t codeStart = (jit.arenaUsed + poolBytes + 15) & ~size_t(15);
+        if (codeStart < ARENA_SIZE) {
+            MIXInstr *pool = reinterpret_cast<MIXInstr*>(jit.arena + jit.arenaUsed);
+            Emitter e(jit.arena + codeStart, ARENA_SIZE - codeStart);
+            BlockCompiler c(e, m, pc, pool);
+            c.compile(end);
+            if (e.finish()) {
+                jit.jitEntry[pc] = reinterpret_cast<JitBlock>(jit.arena + codeStart);
+                jit.arenaUsed = (codeStart + e.size() + 15) & ~size_t(15);
+                BlockInfo b = { pc, end, true };
+                jit.blocks.push_back(b);
+                for (int a = pc; a < end; a++) jit.jitCovered[a]++;
+                return true;
+            }
+        }
+        flushAll(jit); // out of room: start over
+    }
+    return false;
+}
+
+unsigned char *mapArena()
+{
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_JIT
+    flags |= MAP_JIT;
+#endif
+    void *p = mmap(nullptr, ARENA_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, flags, -1, 0);
+    return p == MAP_FAILED ? nullptr : static_cast<unsigned char*>(p);
+}
+
+// set up the compiled code of m on first use; false if the system refuses
+// executable memory
+bool jitReady(MIXMachine &m)
+{
+    if (m.jit) return true;
+    unsigned char *arena = mapArena();
+    if (!arena) return false;
+    JitState *jit = new JitState();
+    jit->arena = arena;
+    m.jit = jit;
+    m.jitCovered = jit->jitCovered;
+    return true;
+}
+
+} // namespace
+
+bool haveJit()
+{
+    // (executable memory may be forbidden)
+    static const bool canMap = [] {
+        unsigned char *p = mapArena();
+        if (p) munmap(p, ARENA_SIZE);
+        return p != nullptr;
+    }();
+    return canMap;
+}
+
+void jitRelease(MIXMachine &m)
+{
+    if (!m.jit) return;
+    munmap(m.jit->arena, ARENA_SIZE);
+    delete m.jit;
+    m.jit = nullptr;
+}
+
+// a word covered by compiled code was written: kill the blocks that include it
+void jitInvalidate(MIXMachine &m, int loc)
+{
+    JitState &jit = *m.jit;
+    for (size_t i = 0; i < jit.blocks.size(); i++) {
+        BlockInfo &b = jit.blocks[i];
+        if (!b.live || loc < b.start || loc >= b.end) continue;
+        b.live = false;
+        jit.jitEntry[b.start] = nullptr;
+        jit.hotness[b.start] = 0;
+        for (int a = b.start; a < b.end; a++) jit.jitCovered[a]--;
+    }
+    jit.jitKilled = true;
+}
+
+Stop runJit(MIXMachine &m)
+{
+    if (!jitReady(m)) return runThreaded(m);
+    JitState &jit = *m.jit;
+    m.stop = Stop::Running;
+    int pc = m.programCounter;
+    for (;;) {
+        if (static_cast<unsigned>(pc) >= ADDR_CAP) return fetchFault(m, pc);
+        if (JitBlock b = jit.jitEntry[pc]) {
+            int next = b(&m);
+            jit.jitKilled = false;
+            // a block that leaves before its first instruction (an operand
+            // outside memory) would only be entered again: that instruction
+            // goes to the interpreter below
+            if (next != pc) {
+                pc = next;
+                continue;
+            }
+        } else if (jit.hotness[pc] < JIT_THRESHOLD && ++jit.hotness[pc] == JIT_THRESHOLD && compileBlock(m, pc)) {
+            continue;
+        }
+
+        // interpret up to the next jump (or compiled code)
+        m.programCounter = pc;
+        for (;;) {
+            const MIXInstr &in = m.Decoded[m.programCounter];
+            if (!in.op) decodeInstruction(m, m.programCounter);
+            Opcode oc = in.oc;
+            in.op(m, in);
+            if (m.stop != Stop::Running) {
+                m.programCounter = m.stopLocation;
+                return m.stop;
+            }
+            if (isJumpOpcode(oc)) break;
+            if (++m.programCounter >= ADDR_CAP || jit.jitEntry[m.programCounter]) break;
+        }
+        pc = m.programCounter;
+    }
+}
+
+#else
+
+bool haveJit() { return false; }
+void jitRelease(MIXMachine &m) { }
+void jitInvalidate(MIXMachine &m, int loc) { }
+Stop runJit(MIXMachine &m) { return runThreaded(m); }
+
+#endif
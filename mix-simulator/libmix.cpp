@@ -0,0 +1,130 @@
+//
+//  libmix.cpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+#include "libmix.h"
+#include "libmix.hpp"
+#include "mix.h"
+#include "mixop-table.hpp"
+#include "interpreter.hpp"
+#include "image.hpp"
+#include "variants.hpp"
+#include <new>
+
+static_assert(MIX_SIGN_BIT == SIGN_BIT && MIX_MEMORY_WORDS == ADDR_CAP, "the words are the machine's");
+static_assert(MIX_HALTED == int(Stop::Halted) && MIX_ADDRESS_FAULT == int(Stop::AddressFault) &&
+              MIX_BAD_OPCODE == int(Stop::BadOpcode) && MIX_DEVICE_ERROR == int(Stop::DeviceError) &&
+              MIX_BUDGET == int(Stop::Budget), "mix_run returns a Stop");
+static_assert(int(MIX_I1) == REG_I1 && int(MIX_I6) == REG_I6 && int(MIX_A) == REG_A &&
+              int(MIX_X) == REG_X && int(MIX_J) == REG_J, "the registers are numbered as in the register file");
+
+struct mix_machine {
+    MIXMachine m;
+};
+
+namespace {
+
+constexpr PackedWord WORD_BITS = SIGN_BIT | MAG_MASK;
+
+bool inMemory(int first, int count)
+{
+    return first >= 0 && count >= 0 && count <= ADDR_CAP - first;
+}
+
+} // namespace
+
+// (MIXMachine allocates its tables itself, so it is bad_alloc that says
+// there is not memory enough)
+mix_machine *mix_create(void)
+{
+    try {
+        return new mix_machine;
+    } catch (const std::bad_alloc &) {
+        return nullptr;
+    }
+}
+
+void mix_destroy(mix_machine *m)
+{
+    delete m;
+}
+
+MIXMachine &machineOf(mix_machine *m)
+{
+    return m->m;
+}
+
+int mix_load(mix_machine *m, const void *data, size_t size)
+{
+    return loadBuffer(data, size, m->m) ? 0 : -1;
+}
+
+// on the checked loop: a program that goes wrong stops the machine, and
+// cannot take the process it runs in down with it
+int mix_run(mix_machine *m, long long budget, long long *steps)
+{
+    long long n = 0;
+    Stop stop = runChecked(m->m, budget, n);
+    if (steps) *steps += n;
+    return int(stop);
+}
+
+const char *mix_stop_name(int stop)
+{
+    return stop >= 0 && stop <= int(Stop::Waiting) ? stopName(Stop(stop)) : "unknown";
+}
+
+mix_word mix_register(const mix_machine *m, int reg)
+{
+    return reg >= 0 && reg < REGISTERS ? m->m.Reg[reg].w : 0;
+}
+
+// (rJ has no sign)
+int mix_set_register(mix_machine *m, int reg, mix_word w)
+{
+    if (reg < REG_I1 || reg >= REGISTERS) return -1;
+    m->m.Reg[reg].w = w & (registerMask[reg] | (reg == REG_J ? 0 : SIGN_BIT));
+    return 0;
+}
+
+int mix_location(const mix_machine *m)
+{
+    return m->m.programCounter;
+}
+
+int mix_set_location(mix_machine *m, int loc)
+{
+    if (!inMemory(loc, 1)) return -1;
+    m->m.programCounter = loc;
+    return 0;
+}
+
+int mix_comparison(const mix_machine *m)
+{
+    return m->m.compIndicator;
+}
+
+int mix_overflow(const mix_machine *m)
+{
+    return m->m.overflowToggle;
+}
+
+int mix_read_memory(const mix_machine *m, int first, int count, mix_word *words)
+{
+    if (!inMemory(first, count)) return -1;
+    for (int i = 0; i < count; i++) words[i] = m->m.Memory[first + i].w;
+    return 0;
+}
+
+int mix_write_memory(mix_machine *m, int first, int count, const mix_word *words)
+{
+    if (!inMemory(first, count)) return -1;
+    for (int i = 0; i < count; i++) {
+        m->m.Memory[first + i].w = words[i] & WORD_BITS;
+        invalidateDecoded(m->m, first + i);
+    }
+    return 0;
+}
@@ -0,0 +1,101 @@
+//
+//  libmix.h
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+#ifndef libmix_h
+#define libmix_h
+
+/* the machine as a library, for C and C++ programs that run MIX code in
+   their own process. each mix_machine is separate from every other, so
+   different threads may use different machines at the same time; one
+   machine is for one thread at a time. nothing here reads or writes the
+   standard streams, and a machine has no I/O units (IN, OUT, IOC, JBUS and
+   JRED stop it with MIX_DEVICE_ERROR).
+
+   words are passed as packed MIX words: the sign in bit 30 (set for minus)
+   and the five bytes in bits 29-0, the first byte highest. mix_value gives
+   the number a word stands for. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mix_machine mix_machine;
+typedef uint32_t mix_word;
+
+#define MIX_SIGN_BIT ((mix_word)1 << 30)
+#define MIX_MEMORY_WORDS 4000
+
+/* why a run stopped, as mix_run returns it */
+enum mix_stop {
+    MIX_HALTED = 1,        /* HLT */
+    MIX_ADDRESS_FAULT = 2, /* an invalid address, or running outside memory */
+    MIX_BAD_OPCODE = 3,    /* an instruction that is invalid or not implemented */
+    MIX_DEVICE_ERROR = 4,  /* an I/O instruction */
+    MIX_BUDGET = 5         /* the step budget ran out */
+};
+
+/* the registers, numbered as mix_register and mix_set_register take them */
+enum mix_register {
+    MIX_I1 = 1, MIX_I2, MIX_I3, MIX_I4, MIX_I5, MIX_I6,
+    MIX_A, MIX_X, MIX_J
+};
+
+/* a machine with every register and word of memory +0, at location 0;
+   null if there is not memory enough */
+mix_machine *mix_create(void);
+void mix_destroy(mix_machine *m);
+
+/* load the size bytes at data into m: a machine image (as --save writes
+   it), which sets everything, or an octal dump ("0012: +1 01 44 00 05 10"
+   a line, as --state prints it), which sets memory only. 0, or -1 (with m
+   left alone) if it is neither */
+int mix_load(mix_machine *m, const void *data, size_t size);
+
+/* run m from its location for at most budget instructions (0 for no
+   limit), and return why it stopped (enum mix_stop). if steps is not null
+   the number executed is added to it. every operand and jump is checked
+   before the instruction runs, so an invalid address stops the run with
+   MIX_ADDRESS_FAULT whatever the program does. a run stopped by its budget
+   goes on from there when run again */
+int mix_run(mix_machine *m, long long budget, long long *steps);
+
+/* the name of a reason for stopping, e.g. "halted" */
+const char *mix_stop_name(int stop);
+
+/* a register (enum mix_register; 0 reads as +0) */
+mix_word mix_register(const mix_machine *m, int reg);
+/* set a register, masked to the bytes it holds; -1 if there is no such one */
+int mix_set_register(mix_machine *m, int reg, mix_word w);
+
+/* the location of the next instruction (or where a run stopped), and set it */
+int mix_location(const mix_machine *m);
+int mix_set_location(mix_machine *m, int loc);
+/* the comparison indicator (-1 LESS, 0 EQUAL, 1 GREATER), and the overflow
+   toggle (0 or 1) */
+int mix_comparison(const mix_machine *m);
+int mix_overflow(const mix_machine *m);
+
+/* copy count words of memory from first into words, or from words into
+   memory; -1 (copying nothing) if they are not all in memory */
+int mix_read_memory(const mix_machine *m, int first, int count, mix_word *words);
+int mix_write_memory(mix_machine *m, int first, int count, const mix_word *words);
+
+/* the number a word stands for (-0 is 0) */
+static inline long mix_value(mix_word w)
+{
+    long v = (long)(w & (MIX_SIGN_BIT - 1));
+    return w & MIX_SIGN_BIT ? -v : v;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* libmix_h */
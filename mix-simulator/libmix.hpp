@@ -0,0 +1,20 @@
+//
+//  libmix.hpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+#ifndef libmix_hpp
+#define libmix_hpp
+
+#include "libmix.h"
+#include "mix.h"
+
+// the C++ side of libmix, for the simulator's own programs: the machine
+// inside a mix_machine, for what the C API does not cover (the I/O units,
+// the engines, the debugger, history and traces). everything else goes
+// through libmix.h
+MIXMachine &machineOf(mix_machine *m);
+
+#endif /* libmix_hpp */
@@ -0,0 +1,580 @@
+//
+//  lockstep.cpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+// each step checks that every lane in lockstep holds the same instruction
+// word (the result is kept until a store writes the word), decodes it once
+// and runs a kernel over the lanes eight at a time: one 256-bit vector holds
+// the same register or memory word of eight lanes, and a mask of the lanes
+// still in lockstep decides which of them are written back. a lane leaves
+// the lockstep either before an instruction (it would fault, or its word
+// differs), so that the scalar interpreter runs that instruction again, or
+// after a jump that it took differently from the rest.
+
+#include "lockstep.hpp"
+#include "interpreter.hpp"
+#include "variants.hpp"
+#include "mixop-table.hpp"
+#include <algorithm>
+
+Lockstep::Lockstep(int lanes)
+: n(lanes), width((lanes + 7) & ~7),
+  mem(static_cast<std::size_t>(ADDR_CAP) * width), reg(REGISTERS * width),
+  ci(width), ov(width), active(width), pc(width),
+  budget(width), count(width), together(width),
+  state(width, Done), stops(width, Stop::Halted),
+  where(0), leader(0), steps_(0), nextBudget(-1),
+  decoded(ADDR_CAP), same(ADDR_CAP), target(width), taken(width)
+{ }
+
+void Lockstep::putLane(int l, const MIXMachine &m)
+{
+    for (int loc = 0; loc < ADDR_CAP; loc++) mem[loc*width + l] = m.Memory[loc].w;
+    for (int r = 0; r < REGISTERS; r++) reg[r*width + l] = m.Reg[r].w;
+    ci[l] = m.compIndicator;
+    ov[l] = m.overflowToggle;
+    pc[l] = m.programCounter;
+}
+
+void Lockstep::setLane(int l, const MIXMachine &m, long long budget)
+{
+    putLane(l, m);
+    this->budget[l] = budget;
+    count[l] = together[l] = 0;
+    state[l] = Together;
+    stops[l] = Stop::Halted;
+}
+
+void Lockstep::getLane(int l, MIXMachine &m) const
+{
+    for (int loc = 0; loc < ADDR_CAP; loc++) {
+        m.Memory[loc].w = mem[loc*width + l];
+        invalidateDecoded(m, loc);
+    }
+    for (int r = 0; r < REGISTERS; r++) m.Reg[r].w = reg[r*width + l];
+    m.compIndicator = static_cast<signed char>(ci[l]);
+    m.overflowToggle = ov[l] != 0;
+    m.programCounter = pc[l];
+    stopAt(m, stops[l], pc[l]);
+}
+
+// lane l goes on alone from next; executed if it has run the current instruction
+void Lockstep::leave(int l, int next, bool executed)
+{
+    active[l] = 0;
+    state[l] = Alone;
+    pc[l] = next;
+    count[l] = together[l] = steps_ + executed;
+    while (leader < width && !active[leader]) leader++;
+}
+
+// the same for each lane from c in the bit mask lanes
+void Lockstep::leaveLanes(int c, unsigned lanes, int next, bool executed)
+{
+    for (int k = 0; k < 8; k++) {
+        if (lanes & (1u << k)) leave(c + k, next, executed);
+    }
+}
+
+void Lockstep::leaveAll()
+{
+    for (int l = leader; l < width; l++) {
+        if (active[l]) leave(l, where, false);
+    }
+}
+
+void Lockstep::finish(int l, Stop s, bool executed)
+{
+    active[l] = 0;
+    state[l] = Done;
+    stops[l] = s;
+    pc[l] = where;
+    count[l] = together[l] = steps_ + executed;
+    while (leader < width && !active[leader]) leader++;
+}
+
+void Lockstep::runAlone(MIXMachine &m, int l)
+{
+    getLane(l, m);
+    long long left = budget[l] ? budget[l] - count[l] : 0;
+    stops[l] = budget[l] && left <= 0 ? Stop::Budget : runChecked(m, left, count[l]);
+    state[l] = Done;
+    putLane(l, m);
+}
+
+void Lockstep::run()
+{
+    // the lanes that start where the first one does go together
+    leader = width;
+    for (int l = 0; l < width; l++) {
+        if (state[l] != Together) continue;
+        if (leader == width) {
+            leader = l;
+            where = pc[l];
+        } else if (pc[l] != where) {
+            state[l] = Alone;
+        }
+    }
+    for (int l = 0; l < width; l++) active[l] = state[l] == Together ? -1 : 0;
+    steps_ = 0;
+    nextBudget = -1;
+    for (int l = leader; l < width; l++) {
+        if (active[l] && budget[l] && (nextBudget < 0 || budget[l] < nextBudget)) nextBudget = budget[l];
+    }
+    std::fill(same.begin(), same.end(), 0);
+
+    if (haveLockstep()) {
+        while (leader < width && step()) { }
+    }
+    leaveAll();
+
+    bool alone = false;
+    for (int l = 0; l < n; l++) alone |= state[l] == Alone;
+    if (!alone) return;
+    MIXMachine m;
+    for (int l = 0; l < n; l++) {
+        if (state[l] == Alone) runAlone(m, l);
+    }
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+
+// the kernels are compiled for AVX2 whatever the rest of the build targets;
+// run() only calls them if the processor has it
+#ifdef __clang__
+#pragma clang attribute push (__attribute__((target("avx2"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+#include <immintrin.h>
+
+bool haveLockstep()
+{
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+}
+
+namespace {
+
+typedef __m256i V;
+
+inline V ld(const void *p) { return _mm256_loadu_si256(static_cast<const V*>(p)); }
+inline void st(void *p, V v) { _mm256_storeu_si256(static_cast<V*>(p), v); }
+inline V splat(PackedWord w) { return _mm256_set1_epi32(static_cast<int>(w)); }
+inline V splat(int i) { return _mm256_set1_epi32(i); }
+inline V zero() { return _mm256_setzero_si256(); }
+// b in the lanes of mask, a elsewhere
+inline V blend(V a, V b, V mask) { return _mm256_blendv_epi8(a, b, mask); }
+inline unsigned bits(V mask) { return _mm256_movemask_ps(_mm256_castsi256_ps(mask)); }
+inline bool none(V mask) { return _mm256_testz_si256(mask, mask); }
+inline V inRange(V M)
+{
+    return _mm256_and_si256(_mm256_cmpgt_epi32(M, splat(-1)), _mm256_cmpgt_epi32(splat(ADDR_CAP), M));
+}
+
+// packedValue and packValue of eight words
+inline V value(V w)
+{
+    V mag = _mm256_and_si256(w, splat(MAG_MASK));
+    V neg = _mm256_sub_epi32(zero(), _mm256_srli_epi32(w, 30));
+    return _mm256_sub_epi32(_mm256_xor_si256(mag, neg), neg);
+}
+
+inline V pack(V v)
+{
+    V mag = _mm256_and_si256(_mm256_abs_epi32(v), splat(MAG_MASK));
+    return _mm256_or_si256(mag, _mm256_and_si256(_mm256_srai_epi32(v, 1), splat(SIGN_BIT)));
+}
+
+// fieldExtract and fieldInsert
+inline V extract(V w, const FieldSpec &f)
+{
+    V r = _mm256_and_si256(_mm256_srl_epi32(w, _mm_cvtsi32_si128(f.shift)), splat(f.mask));
+    return _mm256_or_si256(r, _mm256_and_si256(w, splat(f.place & SIGN_BIT)));
+}
+
+inline V insert(V dest, V src, const FieldSpec &f)
+{
+    V bits = _mm256_sll_epi32(_mm256_and_si256(src, splat(f.mask)), _mm_cvtsi32_si128(f.shift));
+    bits = _mm256_or_si256(bits, _mm256_and_si256(src, splat(SIGN_BIT)));
+    return _mm256_or_si256(_mm256_andnot_si256(splat(f.place), dest), _mm256_and_si256(bits, splat(f.place)));
+}
+
+} // namespace
+
+// the words at M of the lanes from c, into w (and M itself, if asked for).
+// lanes whose M is out of range leave first. returns M if it is the same
+// for all the lanes from c (as it mostly is), Scattered if not, or NoLanes
+// if none of them is in lockstep
+enum { Scattered = -1, NoLanes = -2 };
+
+int Lockstep::operands(const MIXInstr &in, int c, PackedWord *w, std::int32_t *M)
+{
+    V act = ld(&active[c]);
+    if (none(act)) return NoLanes;
+    int at = in.addr;
+    if (in.index) {
+        V addr = _mm256_add_epi32(splat(at), value(ld(&reg[in.index*width + c])));
+        unsigned bad = bits(_mm256_andnot_si256(inRange(addr), act));
+        if (bad) {
+            leaveLanes(c, bad, where, false);
+            act = ld(&active[c]);
+            if (none(act)) return NoLanes;
+        }
+        at = _mm256_cvtsi256_si32(addr);
+        if (bits(_mm256_andnot_si256(_mm256_cmpeq_epi32(addr, splat(at)), act))) {
+            V lane = _mm256_add_epi32(splat(c), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+            V index = _mm256_add_epi32(_mm256_mullo_epi32(addr, splat(width)), lane);
+            st(w, _mm256_mask_i32gather_epi32(zero(), reinterpret_cast<const int*>(mem.data()), index, act, 4));
+            if (M) st(M, addr);
+            return Scattered;
+        }
+    }
+    // (step has checked an address without index)
+    st(w, ld(&mem[at*width + c]));
+    return at;
+}
+
+// ADD and SUB
+void Lockstep::arithmetic(const MIXInstr &in)
+{
+    const FieldSpec &f = fieldTable[in.field];
+    alignas(32) PackedWord w[8];
+    for (int c = 0; c < width; c += 8) {
+        if (operands(in, c, w, nullptr) == NoLanes) continue;
+        V act = ld(&active[c]);
+        V a = ld(&reg[REG_A*width + c]);
+        V v = value(extract(ld(w), f));
+        V s = in.oc == ADD ? _mm256_add_epi32(value(a), v) : _mm256_sub_epi32(value(a), v);
+        V over = _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_abs_epi32(s), splat(MAG_MASK)), act);
+        st(&ov[c], _mm256_or_si256(ld(&ov[c]), _mm256_and_si256(over, splat(1))));
+        // a zero result keeps the sign of rA
+        V r = blend(pack(s), _mm256_and_si256(a, splat(SIGN_BIT)), _mm256_cmpeq_epi32(s, zero()));
+        st(&reg[REG_A*width + c], blend(a, r, act));
+    }
+}
+
+// the 60-bit products are formed four at a time, from the even and the odd lanes
+void Lockstep::multiply(const MIXInstr &in)
+{
+    const FieldSpec &f = fieldTable[in.field];
+    alignas(32) PackedWord w[8];
+    for (int c = 0; c < width; c += 8) {
+        if (operands(in, c, w, nullptr) == NoLanes) continue;
+        V act = ld(&active[c]);
+        V a = ld(&reg[REG_A*width + c]);
+        V v = extract(ld(w), f);
+        V am = _mm256_and_si256(a, splat(MAG_MASK)), vm = _mm256_and_si256(v, splat(MAG_MASK));
+        V even = _mm256_mul_epu32(am, vm);
+        V odd = _mm256_mul_epu32(_mm256_srli_epi64(am, 32), _mm256_srli_epi64(vm, 32));
+        V hi = _mm256_blend_epi32(_mm256_srli_epi64(even, 30), _mm256_slli_epi64(_mm256_srli_epi64(odd, 30), 32), 0xAA);
+        V lo = _mm256_and_si256(_mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA), splat(MAG_MASK));
+        V sgn = _mm256_and_si256(_mm256_xor_si256(a, v), splat(SIGN_BIT));
+        st(&reg[REG_A*width + c], blend(a, _mm256_or_si256(sgn, hi), act));
+        st(&reg[REG_X*width + c], blend(ld(&reg[REG_X*width + c]), _mm256_or_si256(sgn, lo), act));
+    }
+}
+
+// there is no vector division, so each lane divides on its own
+void Lockstep::divide(const MIXInstr &in)
+{
+    alignas(32) PackedWord w[8];
+    for (int c = 0; c < width; c += 8) {
+        if (operands(in, c, w, nullptr) == NoLanes) continue;
+        for (int k = 0; k < 8; k++) {
+            int l = c + k;
+            if (!active[l]) continue;
+            PackedWord v = fieldExtract(w[k], in.field);
+            unsigned long long val = v & MAG_MASK;
+            unsigned long long aReg = reg[REG_A*width + l] & MAG_MASK;
+            if (val != 0 && aReg < val) {
+                unsigned long long dividend = (aReg << 30) | (reg[REG_X*width + l] & MAG_MASK);
+                PackedWord oldsgn = reg[REG_A*width + l] & SIGN_BIT;
+                reg[REG_A*width + l] = ((v & SIGN_BIT) ^ oldsgn) | static_cast<PackedWord>(dividend/val);
+                reg[REG_X*width + l] = oldsgn | static_cast<PackedWord>(dividend % val);
+            } else {
+                ov[l] = 1;
+            }
+        }
+    }
+}
+
+void Lockstep::load(const MIXInstr &in)
+{
+    const FieldSpec &f = fieldTable[in.field];
+    int r = in.variant & REGISTER_BITS;
+    PackedWord flip = (in.variant & LOAD_NEGATIVE) ? SIGN_BIT : 0;
+    alignas(32) PackedWord w[8];
+    for (int c = 0; c < width; c += 8) {
+        if (operands(in, c, w, nullptr) == NoLanes) continue;
+        V act = ld(&active[c]);
+        V val = _mm256_xor_si256(extract(ld(w), f), splat(flip));
+        if (registerMask[r] != MAG_MASK) {
+            // an index register holds two bytes; more is an address violation
+            V big = _mm256_cmpgt_epi32(_mm256_and_si256(val, splat(MAG_MASK)), splat(registerMask[r]));
+            unsigned bad = bits(_mm256_and_si256(big, act));
+            if (bad) {
+                leaveLanes(c, bad, where, false);
+                act = ld(&active[c]);
+            }
+        }
+        st(&reg[r*width + c], blend(ld(&reg[r*width + c]), val, act));
+    }
+}
+
+void Lockstep::store(const MIXInstr &in)
+{
+    const FieldSpec &f = fieldTable[in.field];
+    int r = in.variant;
+    // no scatter in AVX2: lanes at different addresses are written one by one
+    alignas(32) PackedWord w[8];
+    alignas(32) std::int32_t M[8];
+    for (int c = 0; c < width; c += 8) {
+        int at = operands(in, c, w, M);
+        if (at == NoLanes) continue;
+        V old = ld(w);
+        V word = insert(old, ld(&reg[r*width + c]), f);
+        if (at >= 0) {
+            st(&mem[at*width + c], blend(old, word, ld(&active[c])));
+            same[at] = 0;
+            continue;
+        }
+        st(w, word);
+        for (int k = 0; k < 8; k++) {
+            if (!active[c + k]) continue;
+            mem[M[k]*width + c + k] = w[k];
+            same[M[k]] = 0;
+        }
+    }
+}
+
+// INC, DEC, ENT and ENN
+void Lockstep::immediate(const MIXInstr &in)
+{
+    enum { INC_F, DEC_F, ENT_F, ENN_F };
+    int r = in.variant & REGISTER_BITS;
+    bool add = in.field <= DEC_F;
+    bool negate = in.field == ENN_F || in.field == DEC_F;
+    // ENT of a zero M takes the sign of the instruction (so ENTA -0 gives -0)
+    PackedWord zeroSign = ((in.variant & NEG_ZERO_ADDR) ? SIGN_BIT : 0) ^ (negate ? SIGN_BIT : 0);
+    for (int c = 0; c < width; c += 8) {
+        V act = ld(&active[c]);
+        if (none(act)) continue;
+        V val = splat(static_cast<int>(in.addr));
+        if (in.index) val = _mm256_add_epi32(val, value(ld(&reg[in.index*width + c])));
+        if (negate) val = _mm256_sub_epi32(zero(), val);
+        V old = ld(&reg[r*width + c]);
+        if (add) val = _mm256_add_epi32(val, value(old));
+        V res = pack(val);
+        res = _mm256_and_si256(res, splat(SIGN_BIT | registerMask[r]));
+        if (add && registerMask[r] == MAG_MASK) { // (an index register cannot overflow)
+            V over = _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_abs_epi32(val), splat(MAG_MASK)), act);
+            st(&ov[c], _mm256_or_si256(ld(&ov[c]), _mm256_and_si256(over, splat(1))));
+        }
+        V zeroRes = add ? _mm256_and_si256(old, splat(SIGN_BIT)) : splat(zeroSign);
+        res = blend(res, zeroRes, _mm256_cmpeq_epi32(val, zero()));
+        st(&reg[r*width + c], blend(old, res, act));
+    }
+}
+
+void Lockstep::compare(const MIXInstr &in)
+{
+    const FieldSpec &f = fieldTable[in.field];
+    int r = in.variant;
+    alignas(32) PackedWord w[8];
+    for (int c = 0; c < width; c += 8) {
+        if (operands(in, c, w, nullptr) == NoLanes) continue;
+        V act = ld(&active[c]);
+        V v = value(extract(ld(w), f));
+        V rv = value(extract(ld(&reg[r*width + c]), f));
+        // -1, 0 or 1 as the register is less, equal or greater
+        V res = _mm256_sub_epi32(_mm256_cmpgt_epi32(v, rv), _mm256_cmpgt_epi32(rv, v));
+        st(&ci[c], blend(ld(&ci[c]), res, act));
+    }
+}
+
+// JMP to JXN. when the lanes go both ways, the larger group stays in lockstep
+// and the others leave with the jump done. false if that leaves no lane
+bool Lockstep::jump(const MIXInstr &in)
+{
+    enum { UNCOND, UNCOND_SAVE, OV, NOV, LESS, EQ, GREATER, GE, NE, LE };
+    enum { NEG, ZERO, POS, NONNEG, NONZERO, NONPOS };
+    bool indicators = in.oc == JMP;
+    bool saveJ = !(indicators && in.field == UNCOND_SAVE);
+    int r = in.variant;
+    V nextJ = splat(MIXAddr(where + 1).w);
+    int lead = in.addr + (in.index ? packedValue(reg[in.index*width + leader]) : 0);
+    int nTaken = 0, nStay = 0;
+    bool scattered = false;
+    for (int c = 0; c < width; c += 8) {
+        V act = ld(&active[c]);
+        if (none(act)) continue;
+        V M = splat(static_cast<int>(in.addr));
+        if (in.index) M = _mm256_add_epi32(M, value(ld(&reg[in.index*width + c])));
+
+        V cond;
+        if (indicators) {
+            V x = ld(in.field == OV || in.field == NOV ? &ov[c] : &ci[c]);
+            switch (in.field) {
+                case OV: cond = _mm256_cmpgt_epi32(x, zero()); break;
+                case NOV: cond = _mm256_cmpeq_epi32(x, zero()); break;
+                case LESS: cond = _mm256_cmpgt_epi32(zero(), x); break;
+                case EQ: cond = _mm256_cmpeq_epi32(x, zero()); break;
+                case GREATER: cond = _mm256_cmpgt_epi32(x, zero()); break;
+                case GE: cond = _mm256_cmpgt_epi32(x, splat(-1)); break;
+                case NE: cond = _mm256_xor_si256(_mm256_cmpeq_epi32(x, zero()), splat(-1)); break;
+                case LE: cond = _mm256_cmpgt_epi32(splat(1), x); break;
+                default: cond = splat(-1); break;
+            }
+        } else {
+            V x = value(ld(&reg[r*width + c]));
+            switch (in.field) {
+                case NEG: cond = _mm256_cmpgt_epi32(zero(), x); break;
+                case ZERO: cond = _mm256_cmpeq_epi32(x, zero()); break;
+                case POS: cond = _mm256_cmpgt_epi32(x, zero()); break;
+                case NONNEG: cond = _mm256_cmpgt_epi32(x, splat(-1)); break;
+                case NONZERO: cond = _mm256_xor_si256(_mm256_cmpeq_epi32(x, zero()), splat(-1)); break;
+                default: cond = _mm256_cmpgt_epi32(splat(1), x); break;
+            }
+        }
+        V tk = _mm256_and_si256(cond, act);
+
+        // lanes that would jump out of memory fault before the jump
+        unsigned bad = bits(_mm256_andnot_si256(inRange(M), tk));
+        if (bad) {
+            leaveLanes(c, bad, where, false);
+            act = ld(&active[c]);
+            tk = _mm256_and_si256(tk, act);
+        }
+        // JOV and JNOV turn the toggle off
+        if (indicators && (in.field == OV || in.field == NOV)) st(&ov[c], _mm256_andnot_si256(act, ld(&ov[c])));
+        if (saveJ) st(&reg[REG_J*width + c], blend(ld(&reg[REG_J*width + c]), nextJ, tk));
+
+        unsigned t = bits(tk), a = bits(act);
+        nTaken += __builtin_popcount(t);
+        nStay += __builtin_popcount(a & ~t);
+        scattered |= bits(_mm256_andnot_si256(_mm256_cmpeq_epi32(M, splat(lead)), tk)) != 0;
+        st(&target[c], M);
+        st(&taken[c], tk);
+    }
+
+    int next = where + 1;
+    if (nTaken && (nStay || scattered)) {
+        // split: the larger group goes on together
+        if (nTaken > nStay) {
+            int l = leader;
+            while (!active[l] || !taken[l]) l++;
+            next = target[l];
+        }
+        for (int l = leader; l < width; l++) {
+            if (!active[l]) continue;
+            int own = taken[l] ? target[l] : where + 1;
+            if (own != next) leave(l, own, true);
+        }
+    } else if (nTaken) {
+        next = lead;
+    }
+    steps_++;
+    where = next;
+    return leader < width;
+}
+
+// lanes whose word at where differs from the leader's leave; the word is
+// then decoded for all of them
+void Lockstep::sameWord()
+{
+    PackedWord w = mem[where*width + leader];
+    V lead = splat(w);
+    for (int c = leader & ~7; c < width; c += 8) {
+        V act = ld(&active[c]);
+        unsigned bad = bits(_mm256_andnot_si256(_mm256_cmpeq_epi32(ld(&mem[where*width + c]), lead), act));
+        if (bad) leaveLanes(c, bad, where, false);
+    }
+    decodeWord(w, decoded[where]);
+    same[where] = 1;
+}
+
+// one instruction for all lanes in lockstep; false when the lockstep is over
+// (the lanes still in it then go on alone)
+bool Lockstep::step()
+{
+    if (steps_ == nextBudget) {
+        nextBudget = -1;
+        for (int l = leader; l < width; l++) {
+            if (!active[l] || !budget[l]) continue;
+            if (budget[l] == steps_) finish(l, Stop::Budget, false);
+            else if (nextBudget < 0 || budget[l] < nextBudget) nextBudget = budget[l];
+        }
+        if (leader == width) return false;
+    }
+    // (falling off the end of memory is left to the interpreter)
+    if (where >= ADDR_CAP - 1) return false;
+    if (!same[where]) sameWord();
+    const MIXInstr &in = decoded[where];
+
+    // the kernels cover the instructions that are not I/O, conversions or
+    // shifts, with valid fields and index registers
+    if (in.index > 6) return false;
+    bool memory = (in.oc >= ADD && in.oc <= DIV) || (in.oc >= LDA && in.oc <= STZ)
+                  || (in.oc >= CMPA && in.oc <= CMPX);
+    if (memory && !in.index && (in.addr < 0 || in.addr >= ADDR_CAP)) return false;
+    switch (in.oc) {
+        case NOP:
+            break;
+        case ADD:
+        case SUB:
+            arithmetic(in);
+            break;
+        case MUL:
+            multiply(in);
+            break;
+        case DIV:
+            divide(in);
+            break;
+        case HLT:
+            if (in.field != 2) return false;
+            for (int l = leader; l < width; l++) {
+                if (active[l]) finish(l, Stop::Halted, true);
+            }
+            return false;
+        case JMP:
+            if (in.field > 9) return false;
+            return jump(in);
+        default:
+            if (in.oc >= LDA && in.oc <= LDXN) load(in);
+            else if (in.oc >= STA && in.oc <= STZ) store(in);
+            else if (in.oc >= JAN && in.oc <= JXN && in.field <= 5) return jump(in);
+            else if (in.oc >= INCA && in.oc <= INCX && in.field <= 3) immediate(in);
+            else if (in.oc >= CMPA && in.oc <= CMPX) compare(in);
+            else return false;
+            break;
+    }
+    steps_++;
+    where++;
+    return leader < width;
+}
+
+#ifdef __clang__
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#else
+
+bool haveLockstep()
+{
+    return false;
+}
+
+bool Lockstep::step()
+{
+    return false;
+}
+
+#endif
@@ -0,0 +1,93 @@
+//
+//  lockstep.hpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+#ifndef lockstep_hpp
+#define lockstep_hpp
+
+#include "mix.h"
+#include <vector>
+
+// lockstep execution: many copies of one program, each with its own data,
+// run as the lanes of one vector machine. the registers and memory are kept
+// as structure of arrays (word loc of every lane side by side), and each
+// instruction is decoded once and executed for all lanes at a time with
+// AVX2 kernels.
+//
+// lanes stay together as long as they execute the same instructions. when
+// a conditional jump goes both ways, the larger group carries on and the
+// others are masked out of the lockstep; so is any lane that would fault,
+// and every lane at an instruction the kernels do not handle. lanes that
+// left are finished one at a time by the scalar interpreter, so every lane
+// ends exactly as it would have run on its own.
+class Lockstep {
+public:
+    explicit Lockstep(int lanes);
+    int lanes() const { return n; }
+
+    // start lane l from the state of m (memory, registers, indicators and
+    // location), to run at most budget instructions (0 for no limit).
+    // lanes that do not start at the location of lane 0 run on their own
+    void setLane(int l, const MIXMachine &m, long long budget);
+    // run every lane until it stops
+    void run();
+
+    // how lane l ended, and its final state (with the stop reason, as for
+    // a machine run on its own)
+    Stop stop(int l) const { return stops[l]; }
+    long long steps(int l) const { return count[l]; }
+    void getLane(int l, MIXMachine &m) const;
+
+    // instructions lane l executed in lockstep (the rest ran on their own)
+    long long lockstepSteps(int l) const { return together[l]; }
+
+private:
+    enum LaneState : unsigned char { Together, Alone, Done };
+
+    int n, width;                    // lanes, and lanes rounded up to a vector
+    std::vector<PackedWord> mem;     // word loc of lane l at mem[loc*width + l]
+    std::vector<PackedWord> reg;     // register r (see Register) of lane l at reg[r*width + l]
+    std::vector<std::int32_t> ci, ov;
+    std::vector<std::int32_t> active; // all ones for the lanes in lockstep
+    std::vector<int> pc;             // location of each lane that is not in lockstep
+    std::vector<long long> budget, count, together;
+    std::vector<LaneState> state;
+    std::vector<Stop> stops;
+
+    // the lockstep itself
+    int where;                       // the location of all lanes in lockstep
+    int leader;                      // the first lane in lockstep
+    long long steps_;                // instructions each of them has executed
+    long long nextBudget;            // the smallest budget still to run out
+    std::vector<MIXInstr> decoded;   // the shared decoded stream, valid where
+    std::vector<char> same;          // every lane in lockstep holds the same word
+    std::vector<std::int32_t> target, taken; // (for splitting at a jump)
+
+    void putLane(int l, const MIXMachine &m);
+    void leave(int l, int next, bool executed);
+    void leaveLanes(int c, unsigned lanes, int next, bool executed);
+    void leaveAll();
+    void finish(int l, Stop s, bool executed);
+    void runAlone(MIXMachine &m, int l);
+
+    bool step();
+    void sameWord();
+    int operands(const MIXInstr &in, int c, PackedWord *w, std::int32_t *M);
+    void arithmetic(const MIXInstr &in);
+    void multiply(const MIXInstr &in);
+    void divide(const MIXInstr &in);
+    void load(const MIXInstr &in);
+    void store(const MIXInstr &in);
+    void immediate(const MIXInstr &in);
+    void compare(const MIXInstr &in);
+    bool jump(const MIXInstr &in);
+};
+
+// true if this machine has the AVX2 kernels; without them run() takes
+// every lane through the scalar interpreter
+bool haveLockstep();
+
+#endif /* lockstep_hpp */
@@ -7,65 +7,223 @@
 //
 
 #include <iostream>
+#include <fstream>
 #include <iomanip>
-#include "mix.h"
+#include <cstring>
+#include "libmix.hpp"
+#include "interpreter.hpp"
+#include "aot.hpp"
+#include "batch.hpp"
+#include "variants.hpp"
+#include "devices.hpp"
+#include "image.hpp"
+#include "assembler.hpp"
+#include "fork.hpp"
+#include "trace.hpp"
+#include "history.hpp"
+#include "console.hpp"
+#include <thread>
+#include <cstdlib>
+#include <memory>
 
-
-
-int programCounter;
-
-void octalDump();
-void octalEntry();
+void octalEntry(MIXMachine &m);
 
 int main(int argc, const char * argv[])
 {
+    // choose the execution engine: --engine=threaded (the default), table or jit
+    Engine engine = Engine::Threaded;
+    // --aot=file.cpp translates the program to C++ instead of running it,
+    // --aot-build=exe also compiles it; --state prints the final state.
+    // --batch=manifest runs the jobs of a manifest (see batch.hpp) on
+    // --threads=n threads (default: all cores) into --results=file,
+    // with --lockstep[=lanes] running jobs on the same image together, or
+    // --coroutines[=slice] running each thread's jobs as coroutines that
+    // take turns of slice instructions (10000 if not given) and do I/O.
+    // --variant=list runs a specialized table interpreter instead (see
+    // variants.hpp): checked or unchecked, with trace, profile and stats.
+    // --unit=n:path puts I/O unit n on a file other than its default.
+    // --load=image runs a machine image (or octal dump) once, without
+    // prompting; --save=image writes the machine out as an image after a
+    // run, so that --load can go on from there; --budget=n stops a run
+    // after n instructions (run checked, as mix_run does).
+    // --assemble=prog.mixal assembles a MIXAL source and runs it the same
+    // way, or with --output=image writes it out as a machine image instead.
+    // --trace=file records every instruction run into a binary trace (see
+    // trace.hpp and tools/mixtrace.cpp), with the table loop and --budget;
+    // for a batch, of every job. --history[=megabytes] keeps an undo log of
+    // the run (see history.hpp) instead, and --back=n then takes back its
+    // last n instructions, or --back=@loc goes back to the last time the
+    // instruction at loc was about to run, before --state and --save.
+    // without --load or --assemble, or with --debug, it takes debugger
+    // commands instead (see console.hpp), with a history of --history
+    // megabytes (64 if not given, 0 for none)
+    const char *aotSource = nullptr, *aotExe = nullptr;
+    const char *manifest = nullptr, *results = "results.txt";
+    unsigned threads = std::thread::hardware_concurrency();
+    int lanes = 0;
+    long long slice = 0;
+    bool showState = false;
+    Variant variant;
+    bool useVariant = false;
+    DeviceFiles deviceFiles;
+    const char *loadPath = nullptr, *savePath = nullptr;
+    const char *sourcePath = nullptr, *outputPath = nullptr;
+    const char *tracePath = nullptr;
+    long long historyMegabytes = -1; // (not asked for)
+    bool debugging = false;
+    long long backSteps = 0;
+    int backTo = -1;
+    long long budget = 0;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--engine=table") == 0) engine = Engine::Table;
+        else if (std::strcmp(argv[i], "--engine=threaded") == 0) engine = Engine::Threaded;
+        else if (std::strcmp(argv[i], "--engine=jit") == 0) engine = Engine::Jit;
+        else if (std::strncmp(argv[i], "--aot=", 6) == 0) aotSource = argv[i] + 6;
+        else if (std::strncmp(argv[i], "--aot-build=", 12) == 0) aotExe = argv[i] + 12;
+        else if (std::strcmp(argv[i], "--state") == 0) showState = true;
+        else if (std::strncmp(argv[i], "--batch=", 8) == 0) manifest = argv[i] + 8;
+        else if (std::strncmp(argv[i], "--results=", 10) == 0) results = argv[i] + 10;
+        else if (std::strncmp(argv[i], "--threads=", 10) == 0) threads = std::atoi(argv[i] + 10);
+        else if (std::strcmp(argv[i], "--lockstep") == 0) lanes = 64;
+        else if (std::strncmp(argv[i], "--lockstep=", 11) == 0) lanes = std::atoi(argv[i] + 11);
+        else if (std::strcmp(argv[i], "--coroutines") == 0) slice = 10000;
+        else if (std::strncmp(argv[i], "--coroutines=", 13) == 0) slice = std::atoll(argv[i] + 13);
+        else if (std::strncmp(argv[i], "--variant=", 10) == 0 && parseVariant(argv[i] + 10, variant)) useVariant = true;
+        else if (std::strncmp(argv[i], "--unit=", 7) == 0 && parseUnit(argv[i] + 7, deviceFiles)) continue;
+        else if (std::strncmp(argv[i], "--load=", 7) == 0) loadPath = argv[i] + 7;
+        else if (std::strncmp(argv[i], "--save=", 7) == 0) savePath = argv[i] + 7;
+        else if (std::strncmp(argv[i], "--budget=", 9) == 0) budget = std::atoll(argv[i] + 9);
+        else if (std::strncmp(argv[i], "--assemble=", 11) == 0) sourcePath = argv[i] + 11;
+        else if (std::strncmp(argv[i], "--output=", 9) == 0) outputPath = argv[i] + 9;
+        else if (std::strncmp(argv[i], "--trace=", 8) == 0) tracePath = argv[i] + 8;
+        else if (std::strcmp(argv[i], "--history") == 0) historyMegabytes = 64;
+        else if (std::strncmp(argv[i], "--history=", 10) == 0) historyMegabytes = std::atoll(argv[i] + 10);
+        else if (std::strcmp(argv[i], "--debug") == 0) debugging = true;
+        else if (std::strncmp(argv[i], "--back=@", 8) == 0) backTo = std::atoi(argv[i] + 8);
+        else if (std::strncmp(argv[i], "--back=", 7) == 0) backSteps = std::atoll(argv[i] + 7);
+        else {
+            std::cerr << "usage: " << argv[0] << " [--engine=threaded|table|jit] [--state] [--history[=megabytes]]\n"
+                      << "       " << argv[0] << " --variant=checked|unchecked[,trace][,profile][,stats] [--state]\n"
+                      << "       " << argv[0] << " [--unit=n:file ...] [--load=image] [--save=image] [--budget=n] [--trace=file]\n"
+                      << "           [--history[=megabytes]] [--back=n|@loc] [--debug]\n"
+                      << "           (with either of the above)\n"
+                      << "       " << argv[0] << " --assemble=prog.mixal [--output=image] (or with the above)\n"
+                      << "       " << argv[0] << " --aot=file.cpp | --aot-build=exe [--load=image | --assemble=prog.mixal]\n"
+                      << "       " << argv[0] << " --batch=manifest [--results=file] [--threads=n] [--lockstep[=lanes]] [--trace=file]\n"
+                      << "           [--coroutines[=slice]]\n";
+            return 1;
+        }
+    }
     
-    // read file to load memory at address zero
-    while (true) {
-        octalEntry();
-        try {
-            // main event loop: read the next instruction and interpret it
-            while ( true ) {
-                MIXWord V = Memory[programCounter]; // get the value
-                Opcode oc = Opcode(V.byte[4]); // get the opcode
-                MIXAddr AA(V); // get the address (first two bytes)
-                opTable[oc](AA,V.byte[2],V.byte[3],oc); // call the op table
-                // (this is the concept of "interpretive routine")
-                
-                // if it is a jump instruction, set the location of the next instruction accordingly
-                if (static_cast<int>(oc) >= static_cast<int>(JMP)
-                    &&static_cast<int>(oc) <= static_cast<int>(JXN))  {
-                    if (oc != JSJ) JReg = MIXAddr(programCounter);
-                } else { // otherwise just increment the program counter
-                    ++programCounter;
-                }
-                // rudimentary managed environment:
-                if (programCounter >= ADDR_CAP) throw memory_access_violation();
+    if (manifest) {
+        if (slice && (lanes || tracePath)) {
+            std::cerr << "--coroutines does not go with --lockstep or --trace.\n";
+            return 1;
+        }
+        return runBatch(manifest, results, threads, lanes, tracePath, slice);
+    }
+    
+    // the machine is libmix's; the rest of what it does (I/O units, the
+    // engines, the debugger...) is not in the C API, and takes the machine
+    // inside (see libmix.hpp)
+    std::unique_ptr<mix_machine, void (*)(mix_machine *)> handle(mix_create(), mix_destroy);
+    if (!handle) {
+        std::cerr << "Not enough memory for the machine.\n";
+        return 1;
+    }
+    MIXMachine &machine = machineOf(handle.get());
+    
+    if (loadPath && !loadMachine(loadPath, machine)) {
+        std::cerr << "Cannot load " << loadPath << ".\n";
+        return 1;
+    }
+    
+    if (sourcePath) {
+        std::unique_ptr<MachineImage> image(new MachineImage());
+        std::vector<AssemblyError> errors;
+        bool ok = assembleFile(sourcePath, *image, errors);
+        for (const AssemblyError &e : errors) std::cerr << sourcePath << ":" << e.line << ": " << e.message << "\n";
+        if (!ok) return 1;
+        restoreState(machine, *image);
+        if (outputPath) {
+            if (!writeMachineImage(outputPath, machine)) {
+                std::cerr << "Cannot write " << outputPath << ".\n";
+                return 1;
             }
+            if (!aotSource && !aotExe) return 0;
         }
-        catch(halted_exception&) {
-            std::cerr << "Execution finished.\n";
+    }
+    
+    if (aotSource || aotExe) {
+        // (the program to translate is the one loaded or assembled, or
+        // else read in octal)
+        if (!loadPath && !sourcePath) octalEntry(machine);
+        if (aotSource) {
+            std::ofstream out(aotSource);
+            translateImage(out, machine);
+            if (!out) {
+                std::cerr << "Cannot write " << aotSource << ".\n";
+                return 1;
+            }
         }
-        catch(address_violation&) {
-            std::cerr << "Invalid address.\n";
+        if (aotExe && buildImage(machine, aotExe) != 0) {
+            std::cerr << "Building " << aotExe << " failed.\n";
+            return 1;
         }
-        catch(bad_opcode& ex) {
-            std::cerr << ex.what;
+        return 0;
+    }
+    
+    attachDevices(machine, deviceFiles);
+    if (debugging || (!loadPath && !sourcePath)) {
+        if (useVariant || tracePath || backSteps || backTo >= 0) {
+            std::cerr << "--variant, --trace and --back are for a single run (of --load or --assemble).\n";
+            return 1;
         }
-        catch (...) {
-            std::cerr << "Unknown exception occurred.\n";
+        std::size_t historyBytes = static_cast<std::size_t>(historyMegabytes < 0 ? 64 : historyMegabytes) << 20;
+        ConsoleOptions options = {historyBytes, showState, savePath};
+        return runConsole(machine, options, std::cin);
+    }
+    
+    // a single run
+    std::unique_ptr<TraceFile> trace;
+    std::unique_ptr<TraceRing> traceRing;
+    if (tracePath) {
+        trace.reset(new TraceFile(tracePath));
+        if (!trace->ok()) {
+            std::cerr << "Cannot write " << tracePath << ".\n";
+            return 1;
         }
-        octalDump();
-        std::string s;
-        std::cerr << "Run again (Y/N)? ";
-        std::cin >> s;
-        if (s[0]!= 'Y' && s[0] != 'y') break;
+        traceRing.reset(new TraceRing(*trace));
     }
+    std::unique_ptr<History> history;
+    if (historyMegabytes > 0 || backSteps || backTo >= 0) {
+        history.reset(new History(static_cast<std::size_t>(historyMegabytes > 0 ? historyMegabytes : 64) << 20));
+    }
+    
+    Instruments instruments(&std::cout);
+    long long steps = 0;
+    if (history) history->run(machine, budget, steps);
+    else if (traceRing) runTraced(machine, *traceRing, 1, budget, steps);
+    else if (budget) mix_run(handle.get(), budget, &steps);
+    else if (useVariant) runVariant(machine, variant, instruments);
+    else run(machine, engine);
+    finishIO(machine);
+    std::cerr << stopMessage(machine);
+    traceRing.reset();
+    if (trace && !trace->close()) std::cerr << "Cannot write all of " << tracePath << ".\n";
+    if (history && (backSteps || backTo >= 0)) {
+        bool back = backTo >= 0 ? history->reverseContinue(machine, backTo) : history->stepBack(machine, backSteps);
+        if (back) std::cerr << "Went back to step " << history->now() << ", at " << machine.programCounter << ".\n";
+        else std::cerr << "Cannot go back there; the history reaches back to step " << history->oldest() << ".\n";
+    }
+    if (useVariant && !budget && !traceRing && !history) reportInstruments(std::cout, variant, instruments, machine);
+    if (showState) dumpState(std::cout, machine);
+    if (savePath && !writeMachineImage(savePath, machine)) std::cerr << "Cannot write " << savePath << ".\n";
     // write memory to file
     return 0;
 }
 
-void octalEntry()
+void octalEntry(MIXMachine &m)
 {
     for (;;) {
         std::string s;
@@ -84,37 +242,13 @@ void octalEntry()
             int sgn, byte ;
             std::cerr << std::setfill('0') << std::setw(4) << i << ": ";
             std::cin >> sgn;
-            Memory[i].sign = sgn/std::abs(sgn);
+            m.Memory[i].setSign(sgn);
             for (int j = 0; j<5;j++) {
                 std::cin >> std::oct >> byte;
-                Memory[i].byte[j] = static_cast<MIXByte>(byte);
+                m.Memory[i].setByte(j, static_cast<MIXByte>(byte));
             }
+            invalidateDecoded(m, i);
         }
     }
         
 }
-void octalDump()
-{
-    for (;;) {
-        std::string s;
-        std::cerr << "Would you like to see the memory (Y/N)? ";
-        std::cin >>s;
-        if (s[0] != 'Y' && s[0] != 'y') break; // if anything but yes, exit
-        int N, M;
-        std::cerr << "How many memory entries do you want to see? ";
-        std::cin>>  N;
-        std::cerr << "Where do you want to start? ";
-        std::cin>>  M;
-        if (M < 0) M=0;
-        
-        std::cout << "Octal dump starting at location "
-        << M << " for " << N << " entries:" << std::endl;
-        std::cout << std::setfill('0');
-        for (int i= M; i < M+N && i< ADDR_CAP; i++) {
-            MIXWord V = Memory[i];
-            std::cout << std::setw(4) << i << ": ";
-            std::cout << V;
-            std::cout << std::endl;
-        }
-    }
-}
\ No newline at end of file
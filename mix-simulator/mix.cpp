@@ -7,64 +7,195 @@
 //
 
 #include "mix.h"
+#include "debugger.hpp"
 #include <iostream>
 #include <iomanip>
-#
+#include <sstream>
+#include <cstddef>
+#include <sys/mman.h>
+
 
 // implementation file containing data types,
 
-// registers, indicators, and memory
+// and the machine: registers, indicators, and memory
+
+static_assert(offsetof(MIXMachine, Memory) + sizeof(MIXWord*) <= 64,
+              "the registers and indicators should share a cache line");
 
-MIXWord AReg;
-MIXAddr IReg[7];
-MIXWord XReg;
-MIXAddr JReg;
-const MIXAddr ZReg;
+// what jitCovered points to until the JIT compiles something
+static const unsigned short noCompiledBlocks[ADDR_CAP] = {};
+
+MIXMachine::MIXMachine()
+:programCounter(0), compIndicator(0), overflowToggle(false), stop(Stop::Running),
+Memory(new MIXWord[ADDR_CAP]), Decoded(new MIXInstr[ADDR_CAP+1]()),
+jitCovered(noCompiledBlocks), jit(nullptr), devices(nullptr), debug(nullptr), stopLocation(0),
+dirtyPages(0), mappedBytes(0)
+{
+    for (int i = 0; i <= ADDR_CAP; i++) Decoded[i].label = threadedDecodeLabel;
+}
+
+MIXMachine::~MIXMachine()
+{
+    devicesRelease(*this);
+    jitRelease(*this);
+    delete debug;
+    delete [] Decoded;
+    if (mappedBytes) munmap(Memory, mappedBytes);
+    else delete [] Memory;
+}
 
-MIXWord Memory[ADDR_CAP];
+void MIXMachine::reset()
+{
+    for (int r = 0; r < REGISTERS; r++) Reg[r] = MIXWord();
+    programCounter = 0;
+    compIndicator = 0;
+    overflowToggle = false;
+    stop = Stop::Running;
+}
 
-signed char compIndicator;
-bool overflowToggle;
+// each opcode under the first mnemonic that has it
+const char *const opcodeNames[64] = {
+    "NOP", "ADD", "SUB", "MUL", "DIV", "NUM", "SLA", "MOVE",
+    "LDA", "LD1", "LD2", "LD3", "LD4", "LD5", "LD6", "LDX",
+    "LDAN", "LD1N", "LD2N", "LD3N", "LD4N", "LD5N", "LD6N", "LDXN",
+    "STA", "ST1", "ST2", "ST3", "ST4", "ST5", "ST6", "STX",
+    "STJ", "STZ", "JBUS", "IOC", "IN", "OUT", "JRED", "JMP",
+    "JAN", "J1N", "J2N", "J3N", "J4N", "J5N", "J6N", "JXN",
+    "INCA", "INC1", "INC2", "INC3", "INC4", "INC5", "INC6", "INCX",
+    "CMPA", "CMP1", "CMP2", "CMP3", "CMP4", "CMP5", "CMP6", "CMPX"};
 
-MIXWord::MIXWord(int i)
-:sign(1)
+const char *stopName(Stop s)
 {
-    if (i < 0) {
-        sign=-1;
-        i = -i;
+    switch (s) {
+        case Stop::Running: return "running";
+        case Stop::Halted: return "halted";
+        case Stop::AddressFault: return "invalid address";
+        case Stop::BadOpcode: return "bad opcode";
+        case Stop::DeviceError: return "device error";
+        case Stop::Budget: return "step budget exhausted";
+        case Stop::Breakpoint: return "breakpoint";
+        case Stop::Watchpoint: return "watchpoint";
+        case Stop::Waiting: break;
     }
-    
-    for (int j=1; j <=5; j++) {
-        byte[5-j] = i%NUMBASE;
-        i /= NUMBASE;
+    return "waiting for a unit";
+}
+
+std::string stopMessage(const MIXMachine &m)
+{
+    std::ostringstream s;
+    PackedWord w = m.stopInstruction.w;
+    switch (m.stop) {
+        case Stop::Running:
+            break;
+        case Stop::Halted:
+            s << "Execution finished.\n";
+            break;
+        case Stop::AddressFault:
+            s << "Invalid address.\n"
+            "This occurred at memory location " << m.stopLocation << "\n";
+            break;
+        case Stop::BadOpcode:
+            // the program counter and (decoded) instruction fields
+            s << "Opcode " << (w & 077) << " not yet implemented.\n"
+            "This occurred at memory location " << m.stopLocation << "\n"
+            "The address field of the instruction was " << MIXAddr(m.stopInstruction).decode() << ".\n"
+            "And the index and field: " << ((w >> 12) & 077) << ' ' << ((w >> 6) & 077) << "\n";
+            break;
+        case Stop::DeviceError:
+            s << "Unit " << ((w >> 6) & 077) << ": " << deviceError(m) << ".\n"
+            "This occurred at memory location " << m.stopLocation << "\n";
+            break;
+        case Stop::Budget:
+            s << "Step budget exhausted at location " << m.stopLocation << ".\n";
+            break;
+        case Stop::Breakpoint:
+            s << "Breakpoint at location " << m.stopLocation << ".\n";
+            break;
+        case Stop::Watchpoint:
+            s << "Watchpoint: the instruction at location " << m.stopLocation << " is about to "
+            << (m.debug->write ? "write" : "read") << " location " << m.debug->word << ".\n";
+            break;
+        case Stop::Waiting:
+            s << "Waiting for unit " << waitingUnit(m) << " at location " << m.stopLocation << ".\n";
+            break;
     }
+    return s.str();
 }
 
-int MIXWord::decode(int lo,int hi) const
+FieldSpec fieldTable[64];
+
+// build the shift/mask table for all 64 field specifications (L:R).
+// invalid specifications (L > R or R > 5) select nothing.
+static bool makeFieldTable(FieldSpec *table)
 {
-    int total=0;
-    int j = lo==0 ? 0 : lo-1; // field specification
-    for ( ; j<hi; j++) {
-        total = NUMBASE*total +byte[j];
+    for (int L = 0; L < 8; L++) {
+        for (int R = 0; R < 8; R++) {
+            FieldSpec &f = table[8*L+R];
+            f.shift = 0; f.mask = 0; f.place = 0;
+            if (L > R || R > 5) continue;
+            int first = L > 0 ? L : 1; // the sign is not a byte
+            f.shift = 6*(5-R);
+            f.mask = (PackedWord(1) << 6*(R-first+1)) - 1;
+            f.place = (f.mask << f.shift) | (L == 0 ? SIGN_BIT : 0);
+        }
     }
-    return (sign >=0 || lo > 0) ? total : -total;
-    
-    // note: care must be taken to ensure +0 is preserved; this is a problem.
+    return true;
 }
 
-std::ostream &operator <<(std::ostream &os, MIXWord& V)
+static const bool fieldTableReady = makeFieldTable(fieldTable);
+
+std::ostream &operator <<(std::ostream &os, const MIXWord& V)
 {
     // get old flags and state
     std::ios_base::fmtflags old_flags = os.flags();
     os.setf(std::ios::showpos);
-    os << static_cast<int>(V.sign) << ' ';
+    os << V.sign() << ' ';
     os.unsetf(std::ios::showpos);
     for (int j=0; j<5; j++) {
         os.setf(std::ios::oct, std::ios::basefield);
         os.width(2);
-        os << static_cast<unsigned int>(V.byte[j]) << ' ';
+        os << static_cast<unsigned int>(V.byte(j)) << ' ';
     }
     // restore old flags
     os.setf(old_flags);
     return os;
-}
\ No newline at end of file
+}
+
+void dumpRegisters(std::ostream &os, const MIXMachine &m)
+{
+    static const char *const comparisons[] = {"LESS", "EQUAL", "GREATER"};
+    std::ios_base::fmtflags old_flags = os.flags();
+    char old_fill = os.fill('0');
+    os << "A:  " << m.Reg[REG_A] << '\n';
+    os << "X:  " << m.Reg[REG_X] << '\n';
+    for (int i = 1; i <= 7; i++) {
+        MIXAddr r;
+        r.w = m.Reg[i < 7 ? i : REG_J].w;
+        if (i < 7) os << 'I' << i << ": ";
+        else os << "J:  ";
+        os << (r.sign() < 0 ? "-1" : "+1") << ' ';
+        os.setf(std::ios::oct, std::ios::basefield);
+        os.width(2); os << static_cast<unsigned int>(r.byte(0)) << ' ';
+        os.width(2); os << static_cast<unsigned int>(r.byte(1)) << '\n';
+        os.setf(std::ios::dec, std::ios::basefield);
+    }
+    os << "overflow: " << (m.overflowToggle ? "ON" : "OFF")
+       << "  comparison: " << comparisons[m.compIndicator+1]
+       << "  location: " << std::dec << m.programCounter << '\n';
+    os.fill(old_fill);
+    os.flags(old_flags);
+}
+
+void dumpState(std::ostream &os, const MIXMachine &m)
+{
+    dumpRegisters(os, m);
+    std::ios_base::fmtflags old_flags = os.flags();
+    char old_fill = os.fill('0');
+    for (int i = 0; i < ADDR_CAP; i++) {
+        if (m.Memory[i].w == 0) continue;
+        os.width(4);
+        os << std::dec << i << ": " << m.Memory[i] << '\n';
+    }
+    os.fill(old_fill);
+    os.flags(old_flags);
+}
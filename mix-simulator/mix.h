@@ -11,13 +11,8 @@
 
 #include <cstdlib>
 #include <string>
-
-struct bad_opcode { std::string what;
-    bad_opcode(std::string s) : what(s) {}
-};
-struct halted_exception {};
-struct address_violation {};
-struct memory_access_violation : address_violation {};
+#include <cstdint>
+#include <iosfwd>
 
 constexpr int NUMBASE=64;
 constexpr auto ADDR_CAP = 4000;
@@ -25,42 +20,68 @@ constexpr auto ADDR_CAP = 4000;
 typedef unsigned char MIXByte;
 typedef signed char SignedMIXByte;
 
-struct TrueMIXWord {
-    unsigned sign : 1;
-    unsigned b4 : 6;
-    unsigned b3 : 6;
-    unsigned b2 : 6;
-    unsigned b1 : 6;
-    unsigned b0 : 6;
-};
+// a MIX word is kept packed into the low 31 bits of a 32-bit integer:
+// bit 30 is the sign (set means negative, so -0 is representable) and
+// bits 29..0 hold the five 6-bit bytes, byte 1 being the most significant.
+typedef std::uint32_t PackedWord;
 
-struct InstrMIXWord {
-    unsigned sign  : 1;
-    unsigned addr  : 12;
-    unsigned field : 6;
-    unsigned index : 6;
-    unsigned opcode: 6;
+constexpr PackedWord SIGN_BIT = PackedWord(1) << 30;
+constexpr PackedWord MAG_MASK = SIGN_BIT - 1;
+constexpr PackedWord ADDR_MASK = NUMBASE*NUMBASE - 1; // two bytes
+
+// precomputed shift/mask for each of the 64 (L:R) field specifications.
+// a field is extracted as ((w >> shift) & mask), plus the sign when L == 0;
+// "place" is the set of bits the field occupies in the word (sign included).
+struct FieldSpec {
+    unsigned char shift;
+    PackedWord mask;
+    PackedWord place;
 };
 
+extern FieldSpec fieldTable[64];
+
+// contents of field F of w, right-justified (the sign is kept only if L == 0)
+inline PackedWord fieldExtract(PackedWord w, MIXByte field)
+{
+    const FieldSpec &f = fieldTable[field];
+    return ((w >> f.shift) & f.mask) | (w & f.place & SIGN_BIT);
+}
+
+// replace field F of dest by the rightmost bytes (and sign, if L == 0) of src
+inline PackedWord fieldInsert(PackedWord dest, PackedWord src, MIXByte field)
+{
+    const FieldSpec &f = fieldTable[field];
+    return (dest & ~f.place) | ((((src & f.mask) << f.shift) | (src & SIGN_BIT)) & f.place);
+}
+
+// signed integer value of a packed word (-0 decodes as 0)
+inline int packedValue(PackedWord w)
+{
+    int mag = static_cast<int>(w & MAG_MASK);
+    int neg = -static_cast<int>(w >> 30); // all ones if negative
+    return (mag ^ neg) - neg;
+}
+
+// pack an integer, keeping only the low 30 bits of the magnitude
+inline PackedWord packValue(long i)
+{
+    return i < 0 ? (SIGN_BIT | (static_cast<PackedWord>(-i) & MAG_MASK))
+                 : (static_cast<PackedWord>(i) & MAG_MASK);
+}
 
 struct MIXWord;
+
+// an index or jump register: same packed layout as a word, two bytes wide
 struct MIXAddr {
-    SignedMIXByte sign;
-    MIXByte byte[2];
+    PackedWord w;
     
-    explicit MIXAddr(int i) :sign(1) {
-        if (i<0) {
-            sign = -1;
-            i = std::abs(i);
-        }
-        byte[0] = i/NUMBASE;
-        byte[1] = i%NUMBASE;
-    }
+    explicit MIXAddr(int i) :w(i < 0 ? SIGN_BIT | ((-i) & ADDR_MASK) : (i & ADDR_MASK)) {}
     MIXAddr(const MIXAddr& other) = default; // bitwise copy works
-    MIXAddr() :sign(1), byte{0,0} {}
+    MIXAddr() :w(0) {}
     explicit MIXAddr(const MIXWord& other) ;
-    int decode() const {
-        return sign*NUMBASE*byte[0]+byte[1]; }
+    int decode() const { return packedValue(w); }
+    int sign() const { return (w & SIGN_BIT) ? -1 : 1; }
+    MIXByte byte(int j) const { return (w >> (6 - 6*j)) & (NUMBASE-1); }
 };
 
 
@@ -218,43 +239,193 @@ enum Opcode : unsigned char { // opcodes
 
 
 struct MIXWord {
-    SignedMIXByte sign;
-    MIXByte byte[5];
+    PackedWord w;
     
-    MIXWord():sign(1) { byte[0] = byte[1] = byte[2] = byte[3] = byte[4] = 0;}
+    MIXWord() :w(0) {}
     ~MIXWord() = default;
-    MIXWord(MIXAddr addr, MIXByte index, MIXByte field, Opcode oc) :sign(addr.sign)
-    { byte[0] = addr.byte[0]; byte[1] = addr.byte[1];
-        byte[2] = index; byte[3]= field; byte[4]=oc;}
+    // (an index or jump register is a word with the upper three bytes zero)
+    MIXWord(MIXAddr addr) :w(addr.w) {}
+    MIXWord(MIXAddr addr, MIXByte index, MIXByte field, Opcode oc)
+    :w((addr.w & SIGN_BIT) | (addr.w & ADDR_MASK) << 18 | PackedWord(index) << 12 | PackedWord(field) << 6 | oc) {}
     MIXWord(const MIXWord&)= default;
-    explicit MIXWord(int i);
-    int decode(int lo=0,int hi=5) const;
+    explicit MIXWord(int i) :w(packValue(i)) {}
+    int decode(int lo=0,int hi=5) const { return packedValue(fieldExtract(w, 8*lo+hi)); }
     MIXWord& operator=(const MIXWord &other) = default;
+    
+    int sign() const { return (w & SIGN_BIT) ? -1 : 1; }
+    void setSign(int s) { w = s < 0 ? (w | SIGN_BIT) : (w & ~SIGN_BIT); }
+    // bytes are numbered 0 to 4 from the most significant
+    MIXByte byte(int j) const { return (w >> (24 - 6*j)) & (NUMBASE-1); }
+    void setByte(int j, MIXByte b) {
+        int s = 24 - 6*j;
+        w = (w & ~(PackedWord(NUMBASE-1) << s)) | (PackedWord(b & (NUMBASE-1)) << s);
+    }
 };
 
 inline MIXAddr::MIXAddr(const MIXWord& other)
-:sign(other.sign)
+:w((other.w & SIGN_BIT) | ((other.w >> 18) & ADDR_MASK))
+{ }
+
+struct MIXInstr;
+struct MIXMachine;
+typedef void (*MIXOp)(MIXMachine &m, const MIXInstr &in);
+
+// the register file of a machine, numbered so that an index register's
+// number is its place in it: rZ, which is always zero (so index 0 adds
+// nothing, and STZ stores it), rI1 to rI6, rA, rX and rJ. they are all kept
+// as packed words; registerMask (mixop-table.hpp) gives the bytes each holds
+enum Register : unsigned char {
+    REG_Z, REG_I1, REG_I2, REG_I3, REG_I4, REG_I5, REG_I6, REG_A, REG_X, REG_J,
+    REGISTERS
+};
+
+// an instruction word, decoded once: the handler and the pieces it needs.
+// variant is the register for register instructions (the one in REGISTER_BITS,
+// with LOAD_NEGATIVE for LDAN..LDXN), otherwise the field. immediates
+// (INCA..ENNX) also flag an address of -0 in the variant.
+struct MIXInstr {
+    MIXOp op;        // handler; null until the word is decoded
+    short addr;      // signed address field
+    MIXByte index;   // index register number
+    MIXByte field;   // F = 8L+R
+    MIXByte lo, hi;  // F split into (L:R)
+    Opcode oc;       // opcode C
+    MIXByte variant;
+    const void *label; // handler label in the threaded engine (see threaded.cpp)
+};
+
+constexpr MIXByte REGISTER_BITS = 0x0F;
+constexpr MIXByte LOAD_NEGATIVE = 0x40;
+constexpr MIXByte NEG_ZERO_ADDR = 0x80;
+
+// the instructions that set programCounter themselves: the jumps, and JBUS
+// and JRED (a bit for each opcode)
+constexpr std::uint64_t JUMP_OPCODES = (((std::uint64_t(1) << (JXN+1)) - 1) & ~((std::uint64_t(1) << JMP) - 1))
+                                     | std::uint64_t(1) << JBUS | std::uint64_t(1) << JRED;
+
+inline bool isJumpOpcode(Opcode oc)
 {
-    byte[0]=other.byte[0]; byte[1]=other.byte[1];
+    return (JUMP_OPCODES >> oc) & 1;
 }
 
-typedef void (*MIXOp)(MIXAddr addr, MIXByte index, MIXByte field, Opcode oc);//, MIXByte index, MIXByte field, Opcode op);
-
 extern MIXOp opTable[64];
 
-extern MIXWord AReg; //= {0};
-extern MIXAddr IReg[7]; //= {0};
-extern MIXWord XReg;// = {0};
-extern MIXAddr JReg;// = {0};
-extern const MIXAddr ZReg;// = {0};
+// label that (re)decodes an entry in the threaded engine
+extern const void *const threadedDecodeLabel;
 
-extern MIXWord Memory[4000];
+struct JitState;
+struct Devices;
+struct DebugFlags;
+
+// why a machine stopped running
+enum class Stop : unsigned char {
+    Running,      // (it has not)
+    Halted,       // HLT
+    AddressFault, // an invalid address, or running outside memory
+    BadOpcode,    // an instruction that is invalid or not implemented
+    DeviceError,  // an I/O unit that does not exist or cannot do what was asked
+    Budget,       // the step budget ran out
+    Breakpoint,   // an instruction with a breakpoint is next (see debugger.hpp)
+    Watchpoint,   // the next instruction would read or write a watched word
+    Waiting       // the next instruction has to wait for a busy unit (see waitForUnits)
+};
+
+// memory is divided into pages of 64 words, to keep track of the words a
+// machine has written (see fork.hpp)
+constexpr int PAGE_SHIFT = 6;
+constexpr int PAGE_WORDS = 1 << PAGE_SHIFT;
+constexpr int PAGES = (ADDR_CAP + PAGE_WORDS - 1) / PAGE_WORDS;
+static_assert(PAGES <= 64, "a bit of dirtyPages for each page");
+
+// the state of one MIX computer. machines are independent of each other, so
+// any number of them can run in one process (one thread at a time each).
+// the registers, the indicators and the memory pointer share the first 64 bytes.
+struct alignas(64) MIXMachine {
+    MIXWord Reg[REGISTERS]; // (see Register)
+    int programCounter;
+    signed char compIndicator;
+    bool overflowToggle;
+    Stop stop;        // set by a handler to end the run after this instruction
+    
+    MIXWord *Memory;  // ADDR_CAP words
+    // predecoded copy of memory, filled in lazily as instructions are executed.
+    // anything that writes memory must call invalidateDecoded for that word.
+    // the extra entry past the end traps execution running off the end of memory.
+    MIXInstr *Decoded;
+    // number of compiled (JIT) blocks covering each word; see jit.cpp
+    const unsigned short *jitCovered;
+    JitState *jit;
+    // the I/O units, null until attachDevices (see devices.hpp)
+    Devices *devices;
+    // breakpoints and watchpoints, null until one is set (see debugger.hpp)
+    DebugFlags *debug;
+    // where the machine stopped and the instruction word there (the
+    // location is outside memory if that is what the fault was)
+    int stopLocation;
+    MIXWord stopInstruction;
+    // a bit for each page written since the bits were last cleared (set by invalidateDecoded)
+    std::uint64_t dirtyPages;
+    // the size of the mapping Memory is, or 0 if it was allocated with new[]
+    std::size_t mappedBytes;
+    
+    MIXMachine();
+    ~MIXMachine();
+    // registers and indicators back to zero, to start again at location 0
+    void reset();
+    MIXMachine(const MIXMachine&) = delete;
+    MIXMachine& operator=(const MIXMachine&) = delete;
+};
+
+void jitInvalidate(MIXMachine &m, int loc);
+void jitRelease(MIXMachine &m);
+void devicesRelease(MIXMachine &m);
+// what went wrong on the unit that stopped m with Stop::DeviceError
+const char *deviceError(const MIXMachine &m);
+// the unit m waits for when stopped with Stop::Waiting
+int waitingUnit(const MIXMachine &m);
+
+// fill in the decoded form of instruction word w (label excepted)
+void decodeWord(PackedWord w, MIXInstr &in);
+// the handler decodeWord gives in: opTable's, or nullfunc for an invalid index
+// or an INC/DEC/ENT/ENN field above 3
+MIXOp decodedHandler(const MIXInstr &in);
+void decodeInstruction(MIXMachine &m, int loc);
+inline void invalidateDecoded(MIXMachine &m, int loc)
+{
+    m.Decoded[loc].op = nullptr;
+    m.Decoded[loc].label = threadedDecodeLabel;
+    m.dirtyPages |= std::uint64_t(1) << (loc >> PAGE_SHIFT);
+    if (m.jitCovered[loc]) jitInvalidate(m, loc);
+}
+
+// record that m stops at loc, for reason why
+inline void stopAt(MIXMachine &m, Stop why, int loc)
+{
+    m.stop = why;
+    m.stopLocation = loc;
+    m.stopInstruction.w = static_cast<unsigned>(loc) < ADDR_CAP ? m.Memory[loc].w : 0;
+}
+
+// for handlers: stop at the current instruction. the engine finishes the
+// instruction (without moving on) and returns the reason
+inline void stopMachine(MIXMachine &m, Stop why)
+{
+    stopAt(m, why, m.programCounter);
+}
 
-extern signed char compIndicator;
-extern bool overflowToggle;
+// the name of each opcode C, as the first mnemonic that has it (LDA, SLA, JMP...)
+extern const char *const opcodeNames[64];
 
-extern int programCounter;
+// "running", "halted", "invalid address", "bad opcode", "step budget exhausted",
+// "breakpoint" or "watchpoint"
+const char *stopName(Stop s);
+// what to tell the user about the stop of m, formatted only when asked for
+std::string stopMessage(const MIXMachine &m);
 
-std::ostream &operator <<(std::ostream &os, MIXWord& w);
+std::ostream &operator <<(std::ostream &os, const MIXWord& w);
+// print the registers, the indicators and every word of memory that is not +0
+void dumpState(std::ostream &os, const MIXMachine &m);
+// the same without memory
+void dumpRegisters(std::ostream &os, const MIXMachine &m);
 
 #endif /* mix_h */
@@ -7,400 +7,100 @@
 //
 #include "mix.h"
 #include "mixop-table.hpp"
-#include <cstdlib>
-#include <cassert>
-#include <sstream>
-#include <iostream>
+#include "debugger.hpp"
 
-typedef long int LongInt;
-constexpr LongInt WORDBASE = 1073741824L;
+const PackedWord registerMask[REGISTERS] = {0, ADDR_MASK, ADDR_MASK, ADDR_MASK, ADDR_MASK,
+    ADDR_MASK, ADDR_MASK, MAG_MASK, MAG_MASK, ADDR_MASK};
 
-// arrays of void pointers (because the registers are different) for indexing into
-// for load/store operations. Load operations use them as mutable registers, while
-// store operations can use immutable registers.
-
-const void *registers[] = {&AReg, &IReg[1],&IReg[2],&IReg[3],
-    &IReg[4], &IReg[5], &IReg[6], &XReg, &JReg, &ZReg} ;
-
-void *mutable_registers[] = {&AReg, &IReg[1],&IReg[2],&IReg[3],
-    &IReg[4], &IReg[5], &IReg[6], &XReg} ;
-
-
-// the no op ignores everything
-void nop(MIXAddr addr, MIXByte index, MIXByte field, Opcode oc)
-{ }
-
-// sentinel function for instructions not yet implemented
-void nullfunc(MIXAddr addr, MIXByte index, MIXByte field, Opcode oc)
+// sentinel function for instructions not yet implemented. the message is
+// made from the location and word recorded, if anybody asks (stopMessage)
+void nullfunc(MIXMachine &m, const MIXInstr &in)
 {
-    std::ostringstream s;
-    // output the program counter and (decoded) instruction fields
-    s << "Opcode " << static_cast<int>(oc) << " not yet implemented.\n"
-    "This occurred at memory location " << programCounter << "\n"
-    "The address field of the instruction was " << addr.decode() << ".\n"
-    "And the index and field: " << static_cast<int>(index) << ' '
-    << static_cast<int>(field) << "\n";
-    throw bad_opcode(s.str());
+    stopMachine(m, Stop::BadOpcode);
 }
 
-// ADD instruction
-void add(MIXAddr addr, MIXByte index, MIXByte field, Opcode oc)
-{
-    // field specifications
-    int lo = field/8;
-    int hi = field%8;
-    
-    // calculate address plus index register
-    int newAddr = addr.decode()+ IReg[index].decode();
-    
-    // fetch the contents
-    int val = Memory[newAddr].decode(lo,hi);
-    
-    // fetch the A register
-    int aReg = AReg.decode();
-    
-    aReg += val; // increment the accumulator
-    
-    // check that it does not overflow (set the toggle if so)
-    if (abs(aReg) >= WORDBASE) overflowToggle = true;
-    else overflowToggle = false;
-    AReg = MIXWord(aReg); // store result in the A register.
-}
+unsigned char pairValue[4096];
+unsigned short pairChars[100];
 
-// implement it as addition of the negative
-void sub(MIXAddr addr, MIXByte index, MIXByte field, Opcode oc)
+static bool makeDigitTables()
 {
-    AReg.sign = -AReg.sign; // negate
-    add(addr,index,field,oc); // add
-    AReg.sign = -AReg.sign; // negate again.
+    for (int pair = 0; pair < 4096; pair++) pairValue[pair] = (pair >> 6) % 10 * 10 + (pair & 077) % 10;
+    for (int n = 0; n < 100; n++) pairChars[n] = (30 + n/10) << 6 | (30 + n%10);
+    return true;
 }
 
-void mul(MIXAddr addr, MIXByte index, MIXByte field, Opcode oc)
-{
-    // NOTE: may need to adjust if long ints are not large enough
-    // other method is to use the Cauchy product.
-    int lo = field/8;
-    int hi = field%8;
-    int newAddr = addr.decode() + IReg[index].decode();
-    LongInt val = std::abs(Memory[newAddr].decode(lo,hi)); // full decoding and promotion
-    signed char valsgn =  (lo > 0 ? 1 : Memory[newAddr].sign); // if field includes sign or not
-    LongInt aReg = std::abs(AReg.decode());
-    signed char sgn = AReg.sign;
-    
-    LongInt result = val*aReg;
-    
-    if (result >= WORDBASE*WORDBASE) {
-        overflowToggle = true; // trip the overflow
-    } else {
-        overflowToggle = false;
-    }
-    // 10-byte product in rAX (A gets hi word, X gets lo word)
-    int hiWord = static_cast<int>(result/WORDBASE);
-    int loWord = result % WORDBASE;
-    
-    AReg = MIXWord(hiWord);
-    XReg = MIXWord(loWord);
-    XReg.sign = AReg.sign = sgn*valsgn;
-    
-}
+static const bool digitTablesReady = makeDigitTables();
 
-// integer division. register rA and rX combine to form a 10-byte product.
-// divide out by the (field of the) addressed value
-void div(MIXAddr addr, MIXByte index, MIXByte field, Opcode oc)
+// The actual optable
+MIXOp opTable[64] = {&nop, &add, &sub, &mul, &div, &numChar, &shift, &move, // 0 to 7 : arithmetic and special
+                    &load, &load, &load, &load, &load, &load, &load, &load, // 8 to 15 : load ops
+                    &load, &load, &load, &load, &load, &load, &load, &load, // 16 to 23 : load neg ops
+                     &store, &store, &store, &store, &store, &store, &store, &store, // 24 to 31 : store ops
+      &store, &store, &jumpBusy, &ioControl, &input, &output, &jumpReady, &jump, // 32 to 39 : store, I/O, jump on indicators
+&jumpRegCond, &jumpRegCond, &jumpRegCond, &jumpRegCond, &jumpRegCond, &jumpRegCond, &jumpRegCond, &jumpRegCond, // 40 to 47 : jump on registers
+&immed, &immed, &immed, &immed, &immed, &immed, &immed, &immed, // 48 to 55 :  immediates
+&compare, &compare, &compare, &compare, &compare, &compare, &compare, &compare}; // 55 to 63 : comparison
+
+const unsigned char timeTable[64] = {
+     1,  2,  2, 10, 12, 10,  2,  1, // NOP ADD SUB MUL DIV NUM/CHAR/HLT shifts MOVE
+     2,  2,  2,  2,  2,  2,  2,  2, // loads
+     2,  2,  2,  2,  2,  2,  2,  2, // negative loads
+     2,  2,  2,  2,  2,  2,  2,  2, // stores
+     2,  2,  1,  1,  1,  1,  1,  1, // STJ STZ JBUS IOC IN OUT JRED, jumps
+     1,  1,  1,  1,  1,  1,  1,  1, // register jumps
+     1,  1,  1,  1,  1,  1,  1,  1, // address transfers
+     2,  2,  2,  2,  2,  2,  2,  2}; // comparisons
+
+// decode an instruction word (leaving the threaded label alone)
+void decodeWord(PackedWord w, MIXInstr &in)
 {
-    int lo = field/8;
-    int hi = field%8;
-
-    int newAddr = addr.decode()+ IReg[index].decode();
-    int val =std::abs(Memory[newAddr].decode(lo,hi)); // full decoding and promotion
-    signed char valsgn = (lo > 0 ? 1 : Memory[newAddr].sign);
-    LongInt aReg = std::abs(AReg.decode());
-    LongInt xReg = std::abs(XReg.decode());
-    LongInt dividend = WORDBASE*aReg +xReg;
-    
-    if (val!=0) {
-        if (aReg >= val) {
-            overflowToggle = true;
-        } else {
-            overflowToggle = false;
-        }
-        signed char oldsgn = AReg.sign;
-        aReg = dividend/val;
-        xReg = dividend% val;
-        
-        AReg = MIXWord(static_cast<int>(aReg));
-        AReg.sign = valsgn*oldsgn;
-        XReg = MIXWord(static_cast<int>(xReg));
-        XReg.sign = oldsgn;
-        
+    // the first opcode of each register family, from which the register is
+    // counted: A, I1-I6, X, then J and Z for the stores
+    static const Opcode familyBase[64] = {
+        NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP,
+        LDA, LDA, LDA, LDA, LDA, LDA, LDA, LDA,
+        LDA, LDA, LDA, LDA, LDA, LDA, LDA, LDA,
+        STA, STA, STA, STA, STA, STA, STA, STA,
+        STA, STA, NOP, NOP, NOP, NOP, NOP, NOP,
+        JAN, JAN, JAN, JAN, JAN, JAN, JAN, JAN,
+        INCA, INCA, INCA, INCA, INCA, INCA, INCA, INCA,
+        CMPA, CMPA, CMPA, CMPA, CMPA, CMPA, CMPA, CMPA};
+    static const MIXByte familyRegister[10] = {REG_A, REG_I1, REG_I2, REG_I3, REG_I4, REG_I5, REG_I6,
+        REG_X, REG_J, REG_Z};
+    
+    in.oc = Opcode(w & 077);
+    in.field = (w >> 6) & 077;
+    in.index = (w >> 12) & 077;
+    in.addr = static_cast<short>(packedValue((w & SIGN_BIT) | ((w >> 18) & ADDR_MASK)));
+    in.lo = in.field/8;
+    in.hi = in.field%8;
+    if (familyBase[in.oc] != NOP) {
+        int offset = in.oc - familyBase[in.oc];
+        // LDAN..LDXN are the second eight loads
+        if (familyBase[in.oc] == LDA && offset >= 8) in.variant = familyRegister[offset - 8] | LOAD_NEGATIVE;
+        else in.variant = familyRegister[offset];
+        // immediates need to tell ENTA -0 from ENTA +0
+        if (familyBase[in.oc] == INCA && (w & (SIGN_BIT | (ADDR_MASK << 18))) == SIGN_BIT)
+            in.variant |= NEG_ZERO_ADDR;
     } else {
-        overflowToggle = true;
-    }
-}
-
-// special instruction: conversions and halt
-void numChar(MIXAddr addr, MIXByte index, MIXByte field, Opcode oc)
-{
-    if (field==2) throw halted_exception();
-     nullfunc(addr, index,field,oc); // not yet implemented
-}
-
-
-void shift(MIXAddr addr, MIXByte index, MIXByte field, Opcode oc)
-{
-    nullfunc(addr,index,field,oc); // call nullfunc; not implemented yet
-}
-
-// Load instructions:
-// This function covers all register cases, possibly with sign change.
-// It uses indirection and some flags to avoid code duplication
-// In other words, this handles about 16 different instructions
-void load(MIXAddr addr, MIXByte index, MIXByte field, Opcode oc)
-{
-    int lo = field/8;
-    int hi = field%8;
-    bool loadneg=false;
-    
-    int newAddr = addr.decode()+ IReg[index].decode();
-    int val = Memory[newAddr].decode(lo,hi); // full decoding and promotion
-    
-    // index into the array of registers (LDA is at the base)
-    int whichReg = static_cast<int>(oc) - static_cast<int>(LDA);
-    if (whichReg >=8) {
-        whichReg -= 8; // the case of loading with negative: set a flag
-        loadneg = true;
-    }
-    
-    // if it is an index register, i.e., only two bytes
-    if (whichReg > 0 && whichReg < 7) {
-        MIXAddr *r = static_cast<MIXAddr*>(mutable_registers[whichReg]);
-        // managed environment: throw an address violation.
-        if (val >= NUMBASE*NUMBASE) throw address_violation(); // two bytes
-        // set the register
-        *r = MIXAddr(val);
-        if (loadneg) r->sign = -r->sign; // swap sign if it is warranted
-        
-    } else { // A or X register: a full word
-        MIXWord *r = static_cast<MIXWord*>(mutable_registers[whichReg]);
-        // set the register
-        *r = MIXWord(val); // this automatically takes care of field spec
-        r->sign = (lo > 0 ? 1: Memory[newAddr].sign); //set sign
-        if (loadneg) r->sign = -r->sign; // swap
-        // preserve negative zero, unless the field spec forbids it
-    }
-}
-
-void store(MIXAddr addr, MIXByte index, MIXByte field, Opcode oc)
-{
-    int lo = field/8;
-    int hi = field%8;
-    
-    int newAddr = addr.decode()+ IReg[index].decode();
-    // same as in load: compute the offset into the (immutable) register array
-    int whichReg = static_cast<int>(oc) - static_cast<int>(STA);
-    
-    // if it is an index register, or jump, i.e., only two bytes
-    MIXWord toStore;
-    if ((whichReg > 0 && whichReg < 7) || whichReg == 8) {
-        // get the data as MIXAddr
-        const MIXAddr *r = static_cast<const MIXAddr*>(registers[whichReg]);
-        
-        // change the word's sign if field specification warrants it
-        toStore.sign = (lo>0? 1: r->sign);
-        
-        // set the high bytes to 0
-        toStore.byte[0] = toStore.byte[1] = toStore.byte[2] = 0;
-        toStore.byte[3]= r->byte[0];
-        toStore.byte[4]= r->byte[1];
-    } else { // A or X
-        toStore = *static_cast<const MIXWord*>(registers[whichReg]);
-        // preserve negative zero, unless the field spec forbids it
-    }
-    int newHi = lo > 0 ? hi-lo +1 : hi-lo;
-    
-    // shift the field to the left to fit
-    int noSgnLo = lo > 0 ? lo-1 : 0; // start at 0 regardless
-    // the purpose of this is to left shift it into place
-    for (int j = 0; j < newHi; j++) {
-        Memory[newAddr].byte[j] = toStore.byte[noSgnLo+j];
-    }
-    // also note that any bytes not referred to in the field spec
-    // are unmodified. In particular, STJ will store the jump register
-    // into the address field (0:2) of the memory word
-    Memory[newAddr].sign = (lo >0 ? 1 : toStore.sign);
-}
-
-void move(MIXAddr addr, MIXByte index, MIXByte field, Opcode oc) {
-    nullfunc(addr, index, field, oc); // again call nullfunc
-}
-
-void jump(MIXAddr addr, MIXByte index, MIXByte field, Opcode oc)
-{
-    int newAddr = addr.decode() + IReg[index].decode();
-    bool jumpcond = false;
-    enum {
-        UNCOND,
-        UNCOND_SAVE,
-        OV,
-        NOV,
-        LESS,
-        EQ,
-        GREATER,
-        GE,
-        NE,
-        LE
-    };
-    switch (field) {
-        case UNCOND:
-        case UNCOND_SAVE:
-            jumpcond=true;
-            break;
-        case OV:
-            jumpcond = overflowToggle;
-            overflowToggle = false;
-            break;
-        case NOV:
-            jumpcond = !overflowToggle;
-            overflowToggle = false;
-            break;
-        case LESS:
-            jumpcond =  compIndicator < 0;
-            break;
-        case EQ:
-            jumpcond = compIndicator == 0;
-            break;
-        case GREATER:
-            jumpcond = compIndicator > 0;
-            break;
-        case GE:
-            jumpcond = compIndicator >=0;
-            break;
-        case NE:
-            jumpcond = compIndicator != 0;
-            break;
-        case LE:
-            jumpcond = compIndicator <= 0;
-            break;
-        default:
-            std::clog << "Should not have gotten to default in jump instruction.\n";
-            assert(0);
-            break;
-    }
-    // if the condition is satisfied, update the program counter accordingly
-    if (jumpcond) programCounter = newAddr;
-    // otherwise just increment it
-    else programCounter++;
-}
-
-void jumpRegCond(MIXAddr addr, MIXByte index, MIXByte field, Opcode oc)
-{
-    enum {
-        NEG,
-        ZERO,
-        POS,
-        NONNEG,
-        NONZERO,
-        NONPOS
-    };
-    bool jumpcond = false;
-    int newAddr = addr.decode()+ IReg[index].decode();
-   // int val = Memory[newAddr].decode(lo,hi); // full decoding and promotion
-    
-    // index into the array of registers (LDA is at the base)
-    int whichReg = static_cast<int>(oc) - static_cast<int>(JAN);
-    
-    int val =0;
-    if ((whichReg > 0 && whichReg < 7) ) {
-        // get the data as MIXAddr
-        const MIXAddr *r = static_cast<const MIXAddr*>(registers[whichReg]);
-        val = r->decode();
-    } else { // A or X
-        const MIXWord *r = static_cast<const MIXWord*>(registers[whichReg]);
-        val = r->decode();
-    }
-
-    switch (field) {
-        case NEG:
-            jumpcond= val<0;
-            break;
-        case ZERO:
-            jumpcond = val ==0;
-            break;
-        case POS:
-            jumpcond = val > 0;
-            break;
-        case NONNEG:
-            jumpcond =  val >= 0;
-            break;
-        case NONZERO:
-            jumpcond = val!=0;
-            break;
-        case NONPOS:
-            jumpcond = val <= 0;
-            break;
-            
-        default:
-            std::clog << "Should not have gotten to default in jump instruction.\n";
-            assert(0);
-            break;
+        in.variant = in.field;
     }
-    if (jumpcond) programCounter = newAddr;
-    // otherwise just increment it
-    else programCounter++;
+    in.op = decodedHandler(in);
 }
 
-void immed(MIXAddr addr, MIXByte index, MIXByte field, Opcode oc)
+// the index must be one of I1-I6 (or 0), and INC, DEC, ENT and ENN (F = 0
+// to 3) are all there is of opcodes 48-55: anything else stops with a bad
+// opcode, found once here rather than by every effectiveAddress or immed
+MIXOp decodedHandler(const MIXInstr &in)
 {
-    enum {
-        ENT_F,
-        ENN_F,
-        INC_F,
-        DEC_F
-    };
-    int whichReg = static_cast<int>(oc) - static_cast<int>(INCA);
-    int val = addr.decode() + IReg[index].decode();
-    if (field == ENN_F || field == DEC_F) val = -val; // negate
-    
-    if ((whichReg > 0 && whichReg < 7) ) {
-        MIXAddr *r = static_cast<MIXAddr*>(mutable_registers[whichReg]);
-        if (field >= INC_F) val += r->decode(); // add what's there
-        *r = MIXAddr(val);
-    } else { // A or X
-        MIXWord *r = static_cast<MIXWord*>(mutable_registers[whichReg]);
-        if (field >= INC_F) val += r->decode();
-        *r = MIXWord(val);
-    }
+    if (in.oc >= INCA && in.oc <= INCX && in.field > 3) return nullfunc;
+    return in.index > 6 && in.oc != NOP ? nullfunc : opTable[in.oc];
 }
 
-void compare(MIXAddr addr, MIXByte index, MIXByte field, Opcode oc)
+// decode the word at loc into Decoded[loc]
+// (or into a trap, if a breakpoint or watchpoint calls for one)
+void decodeInstruction(MIXMachine &m, int loc)
 {
-    int lo = field/8;
-    int hi = field%8;
-    
-    int newAddr = addr.decode()+ IReg[index].decode();
-    int val = Memory[newAddr].decode(lo,hi); // full decoding and promotion
-
-    int whichReg = static_cast<int>(oc) - static_cast<int>(CMPA);
-    
-    int regVal;
-    if ((whichReg > 0 && whichReg < 7) ) {
-        const MIXAddr *r = static_cast<const MIXAddr*>(registers[whichReg]);
-        regVal = r->decode();
-    } else { // A or X
-        const MIXWord *r = static_cast<const MIXWord*>(registers[whichReg]);
-        regVal = r->decode();
-    }
-    if (val < regVal) compIndicator = -1;
-    else if (val == regVal) compIndicator = 0;
-    else compIndicator = 1;
+    decodeWord(m.Memory[loc].w, m.Decoded[loc]);
+    if (m.debug && loc < ADDR_CAP && needsTrap(m, m.Decoded[loc], loc)) m.Decoded[loc].op = debugTrap;
 }
-
-// The actual optable
-MIXOp opTable[64] = {&nop, &add, &sub, &mul, &div, &numChar, &shift, &move, // 0 to 7 : arithmetic and special
-                    &load, &load, &load, &load, &load, &load, &load, &load, // 8 to 15 : load ops
-                    &load, &load, &load, &load, &load, &load, &load, &load, // 16 to 23 : load neg ops
-                     &store, &store, &store, &store, &store, &store, &store, &store, // 24 to 31 : store ops
-      &store, &store, &nullfunc, &nullfunc, &nullfunc, &nullfunc, &nullfunc, &jump, // 32 to 39 : store, I/O, jump on indicators
-&jumpRegCond, &jumpRegCond, &jumpRegCond, &jumpRegCond, &jumpRegCond, &jumpRegCond, &jumpRegCond, &jumpRegCond, // 40 to 47 : jump on registers
-&immed, &immed, &immed, &immed, &immed, &immed, &immed, &immed, // 48 to 55 :  immediates
-&compare, &compare, &compare, &compare, &compare, &compare, &compare, &compare}; // 55 to 63 : comparison
\ No newline at end of file
@@ -9,6 +9,471 @@
 #ifndef mixop_table_hpp
 #define mixop_table_hpp
 
-#include <stdio.h>
+#include "mix.h"
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+
+// the instruction handlers. they are defined inline here so that execution
+// engines other than the opTable loop can expand them in place; opTable
+// itself holds pointers to these same functions.
+
+typedef long int LongInt;
+constexpr LongInt WORDBASE = 1073741824L;
+
+// the width of each register (see Register), as the magnitude bits it can
+// hold: five bytes for rA and rX, two for the index registers and rJ, and
+// none for rZ. the handlers index the register file with the variant and
+// mask with this, so they do not have to tell the kinds apart
+extern const PackedWord registerMask[REGISTERS];
+
+// sentinel function for instructions not yet implemented
+void nullfunc(MIXMachine &m, const MIXInstr &in);
+
+// M: the address field plus the contents of the index register
+inline int effectiveAddress(MIXMachine &m, const MIXInstr &in)
+{
+    return in.addr + packedValue(m.Reg[in.index].w);
+}
+
+// M for an instruction that reads or writes the word there. outside memory
+// it stops the machine with an address fault, and the handler does nothing
+// (false), whatever engine it runs on
+inline bool operandAddress(MIXMachine &m, const MIXInstr &in, int &M)
+{
+    M = effectiveAddress(m, in);
+    if (static_cast<unsigned>(M) < ADDR_CAP) return true;
+    stopMachine(m, Stop::AddressFault);
+    return false;
+}
+
+// the no op ignores everything
+inline void nop(MIXMachine &m, const MIXInstr &in)
+{ }
+
+// ADD instruction
+inline void add(MIXMachine &m, const MIXInstr &in)
+{
+    // calculate address plus index register
+    int newAddr;
+    if (!operandAddress(m, in, newAddr)) return;
+    
+    // fetch the contents of the field
+    int val = packedValue(fieldExtract(m.Memory[newAddr].w, in.field));
+    
+    // fetch the A register
+    LongInt aReg = packedValue(m.Reg[REG_A].w);
+    
+    aReg += val; // increment the accumulator
+    
+    // check that it does not overflow (set the toggle if so)
+    if (aReg >= WORDBASE || aReg <= -WORDBASE) m.overflowToggle = true;
+    // store result in the A register. a zero result keeps the sign of rA
+    if (aReg != 0) m.Reg[REG_A].w = packValue(aReg);
+    else m.Reg[REG_A].w &= SIGN_BIT;
+}
+
+// implement it as addition of the negative
+inline void sub(MIXMachine &m, const MIXInstr &in)
+{
+    m.Reg[REG_A].w ^= SIGN_BIT; // negate
+    add(m, in); // add
+    m.Reg[REG_A].w ^= SIGN_BIT; // negate again.
+}
+
+inline void mul(MIXMachine &m, const MIXInstr &in)
+{
+    int newAddr;
+    if (!operandAddress(m, in, newAddr)) return;
+    PackedWord v = fieldExtract(m.Memory[newAddr].w, in.field); // sign only if field includes it
+    
+    // 60-bit product of the magnitudes always fits in a long long
+    unsigned long long result = static_cast<unsigned long long>(v & MAG_MASK) * (m.Reg[REG_A].w & MAG_MASK);
+    PackedWord sgn = (v ^ m.Reg[REG_A].w) & SIGN_BIT;
+    
+    // 10-byte product in rAX (A gets hi word, X gets lo word)
+    m.Reg[REG_A].w = sgn | static_cast<PackedWord>(result >> 30);
+    m.Reg[REG_X].w = sgn | static_cast<PackedWord>(result & MAG_MASK);
+}
+
+// integer division. register rA and rX combine to form a 10-byte product.
+// divide out by the (field of the) addressed value
+inline void div(MIXMachine &m, const MIXInstr &in)
+{
+    int newAddr;
+    if (!operandAddress(m, in, newAddr)) return;
+    PackedWord v = fieldExtract(m.Memory[newAddr].w, in.field);
+    unsigned long long val = v & MAG_MASK;
+    unsigned long long aReg = m.Reg[REG_A].w & MAG_MASK;
+    
+    if (val!=0 && aReg < val) {
+        unsigned long long dividend = (aReg << 30) | (m.Reg[REG_X].w & MAG_MASK);
+        PackedWord oldsgn = m.Reg[REG_A].w & SIGN_BIT;
+        
+        m.Reg[REG_A].w = ((v & SIGN_BIT) ^ oldsgn) | static_cast<PackedWord>(dividend/val);
+        m.Reg[REG_X].w = oldsgn | static_cast<PackedWord>(dividend % val);
+    } else {
+        // quotient does not fit in one word (or division by zero):
+        // contents of rA and rX are undefined, so leave them alone
+        m.overflowToggle = true;
+    }
+}
+
+// NUM and CHAR go two digits at a time: the number (0 to 99) made by a
+// pair of bytes, each standing for its value mod 10 (indexed by the 12 bits
+// of the pair), and the character codes of a two-digit number (as a pair of
+// bytes, 30 being the code of 0)
+extern unsigned char pairValue[4096];
+extern unsigned short pairChars[100];
+
+// the five character codes of a number less than 100000
+inline PackedWord decimalChars(unsigned n)
+{
+    return PackedWord(30 + n/10000) << 24 | PackedWord(pairChars[n/100 % 100]) << 12 | pairChars[n % 100];
+}
+
+// special instruction: conversions and halt
+inline void numChar(MIXMachine &m, const MIXInstr &in)
+{
+    enum {
+        NUM_F,
+        CHAR_F,
+        HLT_F
+    };
+    switch (in.field) {
+        case NUM_F: {
+            // the ten bytes of rAX as a decimal number, into rA (mod 64^5)
+            unsigned long long ax = static_cast<unsigned long long>(m.Reg[REG_A].w & MAG_MASK) << 30 | (m.Reg[REG_X].w & MAG_MASK);
+            unsigned long long val = 0;
+            for (int s = 48; s >= 0; s -= 12) val = val*100 + pairValue[(ax >> s) & 07777];
+            m.Reg[REG_A].w = (m.Reg[REG_A].w & SIGN_BIT) | static_cast<PackedWord>(val & MAG_MASK);
+            break;
+        }
+        case CHAR_F: {
+            // the ten decimal digits of rA, as characters into rAX
+            unsigned val = m.Reg[REG_A].w & MAG_MASK;
+            m.Reg[REG_A].w = (m.Reg[REG_A].w & SIGN_BIT) | decimalChars(val / 100000);
+            m.Reg[REG_X].w = (m.Reg[REG_X].w & SIGN_BIT) | decimalChars(val % 100000);
+            break;
+        }
+        case HLT_F:
+            stopMachine(m, Stop::Halted);
+            break;
+        default:
+            nullfunc(m, in); // not a valid field
+            break;
+    }
+}
+
+
+// shifts by M bytes, of rA alone or of rA and rX together as one 60-bit
+// number (rA on the left). the signs stay where they are
+inline void shift(MIXMachine &m, const MIXInstr &in)
+{
+    enum {
+        SLA_F,
+        SRA_F,
+        SLAX_F,
+        SRAX_F,
+        SLC_F,
+        SRC_F
+    };
+    constexpr unsigned long long AX_MASK = (1ULL << 60) - 1;
+    int count = effectiveAddress(m, in);
+    if (count < 0 || in.field > SRC_F) {
+        nullfunc(m, in); // a negative count is not defined
+        return;
+    }
+    unsigned long long a = m.Reg[REG_A].w & MAG_MASK;
+    unsigned long long ax = a << 30 | (m.Reg[REG_X].w & MAG_MASK);
+    // 10 bytes or more shift everything out (and a shift by 64 is undefined in C++)
+    unsigned bits = 6 * (count < 10 ? count : 10);
+    unsigned rotate = 6 * (count % 10);
+    switch (in.field) {
+        case SLA_F:
+            m.Reg[REG_A].w = (m.Reg[REG_A].w & SIGN_BIT) | static_cast<PackedWord>((a << bits) & MAG_MASK);
+            return;
+        case SRA_F:
+            m.Reg[REG_A].w = (m.Reg[REG_A].w & SIGN_BIT) | static_cast<PackedWord>(a >> bits);
+            return;
+        case SLAX_F:
+            ax = (ax << bits) & AX_MASK;
+            break;
+        case SRAX_F:
+            ax >>= bits;
+            break;
+        case SLC_F:
+            ax = ((ax << rotate) | (ax >> (60 - rotate))) & AX_MASK;
+            break;
+        case SRC_F:
+            ax = ((ax >> rotate) | (ax << (60 - rotate))) & AX_MASK;
+            break;
+    }
+    m.Reg[REG_A].w = (m.Reg[REG_A].w & SIGN_BIT) | static_cast<PackedWord>(ax >> 30);
+    m.Reg[REG_X].w = (m.Reg[REG_X].w & SIGN_BIT) | static_cast<PackedWord>(ax & MAG_MASK);
+}
+
+// Load instructions:
+// This function covers all register cases, possibly with sign change.
+// In other words, this handles 16 different instructions
+inline void load(MIXMachine &m, const MIXInstr &in)
+{
+    int newAddr;
+    if (!operandAddress(m, in, newAddr)) return;
+    // field, right-justified; the sign is + unless the field includes it
+    PackedWord val = fieldExtract(m.Memory[newAddr].w, in.field);
+    if (in.variant & LOAD_NEGATIVE) val ^= SIGN_BIT; // swap sign if it is warranted
+    
+    int whichReg = in.variant & REGISTER_BITS;
+    // managed environment: more than an index register holds (two bytes)
+    // stops with an address violation
+    if (val & MAG_MASK & ~registerMask[whichReg]) {
+        stopMachine(m, Stop::AddressFault);
+        return;
+    }
+    // set the register (negative zero is preserved)
+    m.Reg[whichReg].w = val;
+}
+
+inline void store(MIXMachine &m, const MIXInstr &in)
+{
+    int newAddr;
+    if (!operandAddress(m, in, newAddr)) return;
+    // the rightmost bytes of the register replace field (L:R) of the word.
+    // any bytes not referred to in the field spec are unmodified. In particular,
+    // STJ will store the jump register into the address field (0:2) of the memory word
+    // (index and jump registers hold their two bytes as the low bytes of a word)
+    m.Memory[newAddr].w = fieldInsert(m.Memory[newAddr].w, m.Reg[in.variant].w, in.field);
+    invalidateDecoded(m, newAddr); // the word may be code (self-modifying programs)
+}
+
+// MOVE: F words from M on go to the location in rI1 and up, one after the
+// other, and rI1 goes up by F. so a block moved up by less than its length
+// repeats its first words (MOVE 1000(63) with rI1 = 1001 fills 63 words
+// with the word at 1000). the words are copied as a few blocks, not one by one
+inline void move(MIXMachine &m, const MIXInstr &in)
+{
+    int from = effectiveAddress(m, in);
+    int to = packedValue(m.Reg[REG_I1].w);
+    int count = in.field;
+    if (count == 0) return;
+    if (from < 0 || from + count > ADDR_CAP || to < 0 || to + count > ADDR_CAP) {
+        stopMachine(m, Stop::AddressFault);
+        return;
+    }
+    MIXWord *mem = m.Memory;
+    if (to <= from || to >= from + count) {
+        std::memmove(mem + to, mem + from, count * sizeof(MIXWord));
+    } else {
+        // the words from 'from' to 'to' repeat: copy them once, then
+        // keep doubling what has been done
+        int done = to - from;
+        std::memcpy(mem + to, mem + from, done * sizeof(MIXWord));
+        while (done < count) {
+            int n = std::min(done, count - done);
+            std::memcpy(mem + to + done, mem + to, n * sizeof(MIXWord));
+            done += n;
+        }
+    }
+    m.Reg[REG_I1] = MIXAddr(to + count);
+    for (int i = to; i < to + count; i++) invalidateDecoded(m, i);
+}
+
+// I/O on unit F (see devices.cpp). these stop the machine if the unit does
+// not exist or cannot do it
+void input(MIXMachine &m, const MIXInstr &in);     // IN
+void output(MIXMachine &m, const MIXInstr &in);    // OUT
+void ioControl(MIXMachine &m, const MIXInstr &in); // IOC
+bool unitBusy(MIXMachine &m, const MIXInstr &in);
+
+// JBUS and JRED: jump on the state of the unit, saving rJ like JMP
+inline void jumpBusy(MIXMachine &m, const MIXInstr &in)
+{
+    if (unitBusy(m, in)) {
+        m.Reg[REG_J] = MIXAddr(m.programCounter+1);
+        m.programCounter = effectiveAddress(m, in);
+    }
+    else m.programCounter++;
+}
+
+inline void jumpReady(MIXMachine &m, const MIXInstr &in)
+{
+    bool busy = unitBusy(m, in);
+    if (!busy && m.stop == Stop::Running) {
+        m.Reg[REG_J] = MIXAddr(m.programCounter+1);
+        m.programCounter = effectiveAddress(m, in);
+    }
+    else m.programCounter++;
+}
+
+// condition of a jump on the indicators (opcode JMP); JOV and JNOV also
+// turn off the overflow toggle
+inline bool jumpCondition(MIXMachine &m, const MIXInstr &in)
+{
+    bool jumpcond = false;
+    enum {
+        UNCOND,
+        UNCOND_SAVE,
+        OV,
+        NOV,
+        LESS,
+        EQ,
+        GREATER,
+        GE,
+        NE,
+        LE
+    };
+    switch (in.field) {
+        case UNCOND:
+        case UNCOND_SAVE:
+            jumpcond=true;
+            break;
+        case OV:
+            jumpcond = m.overflowToggle;
+            m.overflowToggle = false;
+            break;
+        case NOV:
+            jumpcond = !m.overflowToggle;
+            m.overflowToggle = false;
+            break;
+        case LESS:
+            jumpcond =  m.compIndicator < 0;
+            break;
+        case EQ:
+            jumpcond = m.compIndicator == 0;
+            break;
+        case GREATER:
+            jumpcond = m.compIndicator > 0;
+            break;
+        case GE:
+            jumpcond = m.compIndicator >=0;
+            break;
+        case NE:
+            jumpcond = m.compIndicator != 0;
+            break;
+        case LE:
+            jumpcond = m.compIndicator <= 0;
+            break;
+        default:
+            nullfunc(m, in); // not a valid jump condition
+            break;
+    }
+    return jumpcond;
+}
+
+// condition of a jump on a register (opcodes JAN to JXN)
+inline bool regJumpCondition(MIXMachine &m, const MIXInstr &in)
+{
+    enum {
+        NEG,
+        ZERO,
+        POS,
+        NONNEG,
+        NONZERO,
+        NONPOS
+    };
+    bool jumpcond = false;
+    int val = packedValue(m.Reg[in.variant].w);
+
+    switch (in.field) {
+        case NEG:
+            jumpcond= val<0;
+            break;
+        case ZERO:
+            jumpcond = val ==0;
+            break;
+        case POS:
+            jumpcond = val > 0;
+            break;
+        case NONNEG:
+            jumpcond =  val >= 0;
+            break;
+        case NONZERO:
+            jumpcond = val!=0;
+            break;
+        case NONPOS:
+            jumpcond = val <= 0;
+            break;
+            
+        default:
+            nullfunc(m, in); // not a valid jump condition
+            break;
+    }
+    return jumpcond;
+}
+
+inline void jump(MIXMachine &m, const MIXInstr &in)
+{
+    // if the condition is satisfied, update the program counter accordingly
+    // (saving the return address in rJ, except for JSJ)
+    if (jumpCondition(m, in)) {
+        if (in.field != 1) m.Reg[REG_J] = MIXAddr(m.programCounter+1);
+        m.programCounter = effectiveAddress(m, in);
+    }
+    // otherwise just increment it
+    else m.programCounter++;
+}
+
+inline void jumpRegCond(MIXMachine &m, const MIXInstr &in)
+{
+    if (regJumpCondition(m, in)) {
+        m.Reg[REG_J] = MIXAddr(m.programCounter+1);
+        m.programCounter = effectiveAddress(m, in);
+    }
+    // otherwise just increment it
+    else m.programCounter++;
+}
+
+inline void immed(MIXMachine &m, const MIXInstr &in)
+{
+    enum {
+        INC_F,
+        DEC_F,
+        ENT_F,
+        ENN_F
+    };
+    MIXWord &r = m.Reg[in.variant & REGISTER_BITS];
+    LongInt val = effectiveAddress(m, in);
+    // ENT of a zero M takes the sign of the instruction (so ENTA -0 gives -0)
+    PackedWord zeroSign = (in.variant & NEG_ZERO_ADDR) ? SIGN_BIT : 0;
+    if (in.field == ENN_F || in.field == DEC_F) {
+        val = -val; // negate
+        zeroSign ^= SIGN_BIT;
+    }
+    
+    if (in.field <= DEC_F) {
+        val += r.decode(); // add what's there
+        // (only rA and rX can get this far: an index register is cut to two bytes)
+        if (val >= WORDBASE || val <= -WORDBASE) m.overflowToggle = true;
+    }
+    r.w = val != 0 ? static_cast<PackedWord>(packValue(val) & (SIGN_BIT | registerMask[in.variant & REGISTER_BITS]))
+                   : (in.field <= DEC_F ? (r.w & SIGN_BIT) : zeroSign);
+}
+
+inline void compare(MIXMachine &m, const MIXInstr &in)
+{
+    int newAddr;
+    if (!operandAddress(m, in, newAddr)) return;
+    int val = packedValue(fieldExtract(m.Memory[newAddr].w, in.field)); // full decoding and promotion
+
+    // the same field of the register is compared against memory
+    PackedWord reg = m.Reg[in.variant].w;
+    int regVal = packedValue(fieldExtract(reg, in.field));
+    
+    // the indicator records how the register compares to memory (+0 == -0)
+    if (regVal < val) m.compIndicator = -1;
+    else if (regVal == val) m.compIndicator = 0;
+    else m.compIndicator = 1;
+}
+
+// execution time of each opcode in units of u, as given by Knuth (TAOCP
+// 1.3.1). the I/O instructions are counted without the wait for the unit
+extern const unsigned char timeTable[64];
+
+// the time of one instruction: MOVE takes 1+2F
+inline int mixTime(const MIXInstr &in)
+{
+    return in.oc == MOVE ? 1 + 2*in.field : timeTable[in.oc];
+}
 
 #endif /* mixop_table_hpp */
@@ -0,0 +1,156 @@
+//
+//  scheduler.cpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+// the coroutines are C++20 ones, each a loop around runChecked. only the
+// scheduler's thread resumes them, and only it touches the ready queue; the
+// host thread's part is to say which units have become ready (unitDone),
+// through woken. a machine waiting for a unit says so in its waiting (under
+// the lock) before it suspends, and whichever of it and the host thread
+// first finds the unit ready there takes it back out and sees it resumed:
+// the unit may have become ready in between, with no one to hear of it.
+
+#include "scheduler.hpp"
+#include "interpreter.hpp"
+#include "variants.hpp"
+#include <algorithm>
+#include <coroutine>
+#include <exception>
+
+struct Scheduler::Machine {
+    MIXMachine &m;
+    long long budget, steps;
+    std::function<void(Stop, long long)> finished;
+    std::coroutine_handle<> coroutine;
+    int waiting; // the unit it is suspended for, or -1 (under lock)
+};
+
+// the coroutine of a machine: it starts suspended, for run to resume, and
+// stays suspended at the end, for run to destroy
+struct Scheduler::Task {
+    struct promise_type {
+        Task get_return_object() { return Task{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+    std::coroutine_handle<promise_type> handle;
+};
+
+// go to the back of the ready queue
+struct Scheduler::Yield {
+    Scheduler &s;
+    Machine &machine;
+    bool await_ready() const { return false; }
+    void await_suspend(std::coroutine_handle<>) { s.ready.push_back(&machine); }
+    void await_resume() const {}
+};
+
+// wait for a unit to be ready (false from await_suspend goes on at once)
+struct Scheduler::UnitReady {
+    Scheduler &s;
+    Machine &machine;
+    int unit;
+    bool await_ready() const { return unitReady(machine.m, unit); }
+    bool await_suspend(std::coroutine_handle<>)
+    {
+        {
+            std::lock_guard<std::mutex> g(s.lock);
+            machine.waiting = unit;
+        }
+        return !(unitReady(machine.m, unit) && s.claim(machine, unit));
+    }
+    void await_resume() const {}
+};
+
+Scheduler::Scheduler(long long slice)
+:slice(slice > 0 ? slice : 1), live(0), waitCount(0), sliceCount(0)
+{
+}
+
+Scheduler::~Scheduler()
+{
+    // (those never run to the end)
+    for (std::unique_ptr<Machine> &machine : machines) {
+        if (machine->coroutine) machine->coroutine.destroy();
+    }
+}
+
+void Scheduler::add(MIXMachine &m, const DeviceFiles &files, long long budget,
+                    std::function<void(Stop, long long)> finished)
+{
+    machines.push_back(std::unique_ptr<Machine>(new Machine{m, budget, 0, std::move(finished), nullptr, -1}));
+    Machine &machine = *machines.back();
+    attachDevices(m, files, &host);
+    waitForUnits(m, [this, &machine](int unit) { unitDone(machine, unit); });
+    machine.coroutine = execute(machine).handle;
+    ready.push_back(&machine);
+    live++;
+}
+
+void Scheduler::run()
+{
+    while (live) {
+        {
+            std::unique_lock<std::mutex> g(lock);
+            if (ready.empty()) woke.wait(g, [this] { return !woken.empty(); });
+            ready.insert(ready.end(), woken.begin(), woken.end());
+            woken.clear();
+        }
+        Machine *machine = ready.front();
+        ready.pop_front();
+        machine->coroutine.resume();
+        if (machine->coroutine.done()) {
+            machine->coroutine.destroy();
+            machine->coroutine = nullptr;
+            live--;
+        }
+    }
+}
+
+Scheduler::Task Scheduler::execute(Machine &machine)
+{
+    MIXMachine &m = machine.m;
+    Stop stop;
+    for (;;) {
+        long long left = machine.budget ? machine.budget - machine.steps : slice;
+        stop = runChecked(m, std::min(slice, left), machine.steps);
+        if (stop == Stop::Waiting) {
+            waitCount++;
+            co_await UnitReady{*this, machine, waitingUnit(m)};
+        } else if (stop == Stop::Budget && machine.steps != machine.budget) {
+            sliceCount++;
+            co_await Yield{*this, machine};
+        } else {
+            break;
+        }
+    }
+    // (so that finishIO has nothing to wait for)
+    for (int unit = 0; unit < UNITS; unit++) co_await UnitReady{*this, machine, unit};
+    finishIO(m);
+    devicesRelease(m);
+    machine.finished(stop, machine.steps);
+}
+
+// on the host thread
+void Scheduler::unitDone(Machine &machine, int unit)
+{
+    std::lock_guard<std::mutex> g(lock);
+    if (machine.waiting != unit) return;
+    machine.waiting = -1;
+    woken.push_back(&machine);
+    woke.notify_one();
+}
+
+// true if the machine is still waiting for unit, which it now is not
+bool Scheduler::claim(Machine &machine, int unit)
+{
+    std::lock_guard<std::mutex> g(lock);
+    if (machine.waiting != unit) return false;
+    machine.waiting = -1;
+    return true;
+}
@@ -0,0 +1,73 @@
+//
+//  scheduler.hpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+#ifndef scheduler_hpp
+#define scheduler_hpp
+
+#include "mix.h"
+#include "devices.hpp"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// many machines on one thread. each runs as a coroutine that executes
+// slices of at most slice instructions with the checked loop (runChecked),
+// and is suspended at the end of a slice, to give the others a turn, and
+// whenever it has to wait for a busy I/O unit (see waitForUnits). one
+// waiting for a unit is only resumed once the host thread has finished
+// with it, so a machine that spends its time in a JBUS loop costs nothing
+// while it waits, where on a thread of its own it would spin.
+//
+// the machines all do their I/O on one host thread of the scheduler's.
+class Scheduler {
+public:
+    explicit Scheduler(long long slice = 10000);
+    ~Scheduler();
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    // give m the I/O units of files and run it from its programCounter for
+    // at most budget instructions (0 for no limit) once run is called.
+    // finished(stop, steps) is called when it has stopped, and its I/O is
+    // done (see finishIO); m must last until then
+    void add(MIXMachine &m, const DeviceFiles &files, long long budget,
+             std::function<void(Stop, long long)> finished);
+    // run the machines added until they have all stopped
+    void run();
+
+    // the number of times a machine was suspended to wait for a unit, and
+    // at the end of a slice
+    long long waits() const { return waitCount; }
+    long long slices() const { return sliceCount; }
+
+private:
+    struct Machine;
+    struct Task;
+    struct Yield;
+    struct UnitReady;
+
+    long long slice;
+    IOHost host;
+    std::vector<std::unique_ptr<Machine> > machines;
+    std::deque<Machine*> ready;    // to be resumed, in turn
+    std::size_t live;              // machines that have not finished
+    long long waitCount, sliceCount;
+
+    // machines whose units have become ready, handed over by the host thread
+    std::mutex lock;
+    std::condition_variable woke;
+    std::vector<Machine*> woken;
+
+    Task execute(Machine &machine);
+    void unitDone(Machine &machine, int unit);
+    bool claim(Machine &machine, int unit);
+};
+
+#endif /* scheduler_hpp */
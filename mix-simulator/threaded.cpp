@@ -0,0 +1,198 @@
+//
+//  threaded.cpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+// direct-threaded execution engine. every entry of Decoded[] carries the
+// address of the label that executes it, and each handler ends by advancing
+// the program counter itself and jumping straight to the next entry's label,
+// so there is no central loop, no call through opTable and no test on the
+// opcode to decide how the program counter moves.
+// needs the "labels as values" extension (gcc and clang).
+
+#include "interpreter.hpp"
+#include "mixop-table.hpp"
+#include "debugger.hpp"
+
+#if defined(__GNUC__)
+
+// the addresses of the labels are only the same in every call if the
+// engine is neither inlined nor cloned
+#if defined(__clang__)
+#define ENGINE_ATTRIBUTES __attribute__((noinline))
+#else
+#define ENGINE_ATTRIBUTES __attribute__((noinline, noclone))
+#endif
+
+namespace {
+
+// the engine. with no machine it only points decodeLabel at the label
+// that decodes an entry
+ENGINE_ATTRIBUTES Stop threaded(MIXMachine *machine, const void *const **decodeLabel)
+{
+    static const void *const labels[64] = {
+        &&L_nop, &&L_add, &&L_sub, &&L_mul, &&L_div, &&L_numChar, &&L_shift, &&L_move,
+        &&L_load, &&L_load, &&L_load, &&L_load, &&L_load, &&L_load, &&L_load, &&L_load,
+        &&L_load, &&L_load, &&L_load, &&L_load, &&L_load, &&L_load, &&L_load, &&L_load,
+        &&L_store, &&L_store, &&L_store, &&L_store, &&L_store, &&L_store, &&L_store, &&L_store,
+        &&L_store, &&L_store, &&L_jumpIO, &&L_io, &&L_io, &&L_io, &&L_jumpIO, &&L_jump,
+        &&L_jumpReg, &&L_jumpReg, &&L_jumpReg, &&L_jumpReg, &&L_jumpReg, &&L_jumpReg, &&L_jumpReg, &&L_jumpReg,
+        &&L_immed, &&L_immed, &&L_immed, &&L_immed, &&L_immed, &&L_immed, &&L_immed, &&L_immed,
+        &&L_compare, &&L_compare, &&L_compare, &&L_compare, &&L_compare, &&L_compare, &&L_compare, &&L_compare};
+    static const void *const decode = &&L_decode;
+    
+    if (!machine) {
+        *decodeLabel = &decode;
+        return Stop::Running;
+    }
+    MIXMachine &m = *machine;
+    MIXInstr *const Decoded = m.Decoded;
+    if (Decoded[ADDR_CAP].label != &&L_end) {
+        // first run on this machine: entries of a machine made before
+        // threadedDecodeLabel was set (during static initialization) have
+        // no label yet
+        for (int i = 0; i < ADDR_CAP; i++) {
+            if (!Decoded[i].label) Decoded[i].label = &&L_decode;
+        }
+        // falling off the end of memory lands here
+        Decoded[ADDR_CAP].label = &&L_end;
+    }
+    
+    // the program counter lives in a local (a register) while running, and is
+    // written back to programCounter before anything that might read it
+    int pc = m.programCounter;
+    const MIXInstr *ip;
+    
+// go to the instruction at pc
+#define DISPATCH() do { ip = &Decoded[pc]; goto *ip->label; } while (0)
+// go to the next instruction in sequence
+#define NEXT() do { ++pc; DISPATCH(); } while (0)
+// after a taken jump: the target may be anywhere
+#define JUMP_TO(target) do { \
+        pc = (target); \
+        if (static_cast<unsigned>(pc) >= ADDR_CAP) return fetchFault(m, pc); \
+        DISPATCH(); \
+    } while (0)
+// after a handler that may stop the machine
+#define CHECK_STOP() do { if (m.stop != Stop::Running) goto L_stopped; } while (0)
+    
+    if (!startRun(m)) return m.stop;
+    DISPATCH();
+    
+L_decode:
+    {
+        MIXInstr &in = Decoded[pc];
+        if (!in.op) decodeInstruction(m, pc);
+        in.label = in.op != opTable[in.oc] ? &&L_trap : labels[in.oc];
+        goto *in.label;
+    }
+L_nop:
+    NEXT();
+// (the handlers with an operand fault on one outside memory)
+L_add:
+    m.programCounter = pc;
+    add(m, *ip); CHECK_STOP(); NEXT();
+L_sub:
+    m.programCounter = pc;
+    sub(m, *ip); CHECK_STOP(); NEXT();
+L_mul:
+    m.programCounter = pc;
+    mul(m, *ip); CHECK_STOP(); NEXT();
+L_div:
+    m.programCounter = pc;
+    div(m, *ip); CHECK_STOP(); NEXT();
+L_numChar:
+    m.programCounter = pc; // halts here
+    numChar(m, *ip); CHECK_STOP(); NEXT();
+L_shift:
+    m.programCounter = pc;
+    shift(m, *ip); CHECK_STOP(); NEXT();
+L_move:
+    m.programCounter = pc;
+    move(m, *ip); CHECK_STOP(); NEXT();
+L_load:
+    m.programCounter = pc; // may fault
+    load(m, *ip); CHECK_STOP(); NEXT();
+L_store:
+    m.programCounter = pc;
+    store(m, *ip); CHECK_STOP(); NEXT();
+L_jump:
+    m.programCounter = pc; // for the error report on a bad condition
+    if (jumpCondition(m, *ip)) {
+        if (ip->field != 1) m.Reg[REG_J] = MIXAddr(pc+1); // not JSJ
+        JUMP_TO(effectiveAddress(m, *ip));
+    }
+    CHECK_STOP(); NEXT();
+L_jumpReg:
+    m.programCounter = pc;
+    if (regJumpCondition(m, *ip)) {
+        m.Reg[REG_J] = MIXAddr(pc+1);
+        JUMP_TO(effectiveAddress(m, *ip));
+    }
+    CHECK_STOP(); NEXT();
+L_io:
+    m.programCounter = pc;
+    ip->op(m, *ip); CHECK_STOP(); NEXT();
+L_jumpIO:
+    m.programCounter = pc; // JBUS and JRED set it themselves
+    ip->op(m, *ip); CHECK_STOP();
+    JUMP_TO(m.programCounter);
+L_immed:
+    immed(m, *ip); NEXT();
+L_compare:
+    m.programCounter = pc;
+    compare(m, *ip); CHECK_STOP(); NEXT();
+L_trap:
+    // a breakpoint or watchpoint: the trap stops, or runs the instruction
+    // as the table loop would. (an invalid index has nullfunc, which stops)
+    m.programCounter = pc;
+    ip->op(m, *ip); CHECK_STOP();
+    if (isJumpOpcode(ip->oc)) JUMP_TO(m.programCounter);
+    NEXT();
+L_end:
+    return fetchFault(m, pc);
+L_stopped:
+    m.programCounter = m.stopLocation;
+    return m.stop;
+    
+#undef DISPATCH
+#undef NEXT
+#undef JUMP_TO
+#undef CHECK_STOP
+}
+
+const void *decodeLabel()
+{
+    const void *const *label = nullptr;
+    threaded(nullptr, &label);
+    return *label;
+}
+
+} // namespace
+
+// label that (re)decodes an entry; invalidateDecoded puts it back in place.
+// it is the same for every machine, and set once, before main, so that
+// machines on different threads only ever read it
+const void *const threadedDecodeLabel = decodeLabel();
+
+bool haveThreadedEngine() { return true; }
+
+Stop runThreaded(MIXMachine &m)
+{
+    return threaded(&m, nullptr);
+}
+
+#else
+
+const void *const threadedDecodeLabel = nullptr;
+
+bool haveThreadedEngine() { return false; }
+
+Stop runThreaded(MIXMachine &m)
+{
+    return runTable(m);
+}
+
+#endif
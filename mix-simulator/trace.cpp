@@ -0,0 +1,426 @@
+//
+//  trace.cpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+// the running thread only fills in records: it knows from the opcode which
+// registers an instruction writes (nearly always one) and which words
+// (those of a store or a MOVE), and copies them out without looking at
+// what was there before. compression and writing happen on the host thread
+// of the TraceFile, a block at a time (or only writing, while it is behind).
+//
+// in a compressed block, each record is told from the last one in the
+// block at the same location: the next time round a loop, an instruction
+// record differs from the last one only in the value, if that, and its
+// location is the one that came after the location before it last time.
+// such a record is a tag byte and the bytes of the value that changed.
+
+#include "trace.hpp"
+#include "interpreter.hpp"
+#include "variants.hpp"
+#include <bit>
+#include <cstring>
+
+namespace {
+
+const char TRACE_MAGIC[8] = {'M', 'I', 'X', 'T', 'R', 'A', 'C', 'E'};
+constexpr int RECORD_BYTES = sizeof(TraceRecord);
+constexpr int MAX_PACKED = TRACE_BLOCK * (RECORD_BYTES + 2);
+constexpr int LOCATIONS = 4096; // (locations are looked up modulo this)
+
+inline std::uint8_t indicators(const MIXMachine &m)
+{
+    return static_cast<std::uint8_t>((m.compIndicator + 1) | (m.overflowToggle ? 4 : 0));
+}
+
+// the most records one instruction can make: a MOVE of 63 words and I1
+constexpr int MAX_STEP_RECORDS = 64;
+
+inline TraceRecord record(int location, std::uint8_t what, std::uint8_t ind, std::uint32_t instruction,
+                          std::uint32_t value, int address)
+{
+    TraceRecord r;
+    r.location = static_cast<std::uint16_t>(location);
+    r.what = what;
+    r.indicators = ind;
+    r.instruction = instruction;
+    r.value = value;
+    r.address = static_cast<std::uint16_t>(address);
+    r.reserved = 0;
+    return r;
+}
+
+inline void put(TraceRing &ring, const TraceRecord &r)
+{
+    *ring.reserve(1) = r;
+    ring.take(1);
+}
+
+// a record as two 64-bit halves, the location in the low 16 bits of the first
+// and the value in the low 32 of the second (on a little-endian host;
+// elsewhere the scheme works the same, only less well)
+struct Halves {
+    std::uint64_t lo, hi;
+};
+static_assert(sizeof(Halves) == sizeof(TraceRecord), "a record is two halves");
+
+// the first half of a record, and a record made of two halves: two 8-byte
+// stores, where filling it in field by field and copying it would stall
+// on the copy
+inline std::uint64_t halfOf(int location, std::uint8_t what, std::uint8_t ind, std::uint32_t instruction)
+{
+    return static_cast<std::uint16_t>(location) | std::uint64_t(what) << 16 | std::uint64_t(ind) << 24
+        | std::uint64_t(instruction) << 32;
+}
+
+inline void store(TraceRecord *p, std::uint64_t lo, std::uint64_t hi)
+{
+    if constexpr (std::endian::native == std::endian::little) {
+        Halves h = {lo, hi};
+        std::memcpy(p, &h, sizeof h);
+    } else {
+        *p = record(static_cast<int>(lo & 0xFFFF), static_cast<std::uint8_t>(lo >> 16), static_cast<std::uint8_t>(lo >> 24),
+                    static_cast<std::uint32_t>(lo >> 32), static_cast<std::uint32_t>(hi), static_cast<int>(hi >> 32 & 0xFFFF));
+    }
+}
+
+// the tag byte of a compressed record: what follows it
+enum : unsigned {
+    NEW_LOCATION = 1,    // 2 bytes: the location, not the one guessed
+    NEW_INSTRUCTION = 2, // 6 bytes: what, indicators and instruction
+    NEW_ADDRESS = 4,     // 4 bytes: the address (and the reserved bytes)
+    VALUE_SHIFT = 3      // and the bytes of value XOR the last one, 0 to 4
+};
+
+inline void putBytes(unsigned char *p, std::uint64_t x, int n)
+{
+    for (int j = 0; j < n; j++) p[j] = static_cast<unsigned char>(x >> 8 * j);
+}
+
+inline std::uint64_t getBytes(const unsigned char *p, int n)
+{
+    std::uint64_t x = 0;
+    for (int j = 0; j < n; j++) x |= static_cast<std::uint64_t>(p[j]) << 8 * j;
+    return x;
+}
+
+// compress n records into out; the number of bytes
+size_t compress(const TraceRecord *records, int n, unsigned char *out)
+{
+    static thread_local Halves last[LOCATIONS];
+    static thread_local std::uint16_t next[LOCATIONS];
+    std::memset(last, 0, sizeof last);
+    std::memset(next, 0, sizeof next);
+    unsigned char *p = out;
+    std::uint64_t previous = 0;
+    for (int i = 0; i < n; i++) {
+        Halves b;
+        std::memcpy(&b, &records[i], sizeof b);
+        std::uint16_t location = static_cast<std::uint16_t>(b.lo);
+        std::uint16_t &guess = next[previous % LOCATIONS];
+        Halves &ref = last[location % LOCATIONS];
+        unsigned char *tag = p++;
+        unsigned t = 0;
+        if (location != guess) {
+            t |= NEW_LOCATION;
+            putBytes(p, location, 2);
+            p += 2;
+            guess = location;
+        }
+        if ((b.lo ^ ref.lo) >> 16) {
+            t |= NEW_INSTRUCTION;
+            putBytes(p, b.lo >> 16, 6);
+            p += 6;
+        }
+        // (all four bytes are written, and only those that count kept)
+        std::uint32_t value = static_cast<std::uint32_t>(b.hi ^ ref.hi);
+        int k = (std::bit_width(value) + 7) / 8;
+        putBytes(p, value, 4);
+        p += k;
+        t |= k << VALUE_SHIFT;
+        if ((b.hi ^ ref.hi) >> 32) {
+            t |= NEW_ADDRESS;
+            putBytes(p, b.hi >> 32, 4);
+            p += 4;
+        }
+        *tag = static_cast<unsigned char>(t);
+        ref = b;
+        previous = location;
+    }
+    return p - out;
+}
+
+// the other way; false if the bytes do not make n records exactly
+bool decompress(const unsigned char *p, size_t size, int n, TraceRecord *records)
+{
+    static thread_local Halves last[LOCATIONS];
+    static thread_local std::uint16_t next[LOCATIONS];
+    std::memset(last, 0, sizeof last);
+    std::memset(next, 0, sizeof next);
+    const unsigned char *end = p + size;
+    std::uint64_t previous = 0;
+    for (int i = 0; i < n; i++) {
+        if (end - p < 1) return false;
+        unsigned t = *p++;
+        int k = t >> VALUE_SHIFT;
+        int bytes = (t & NEW_LOCATION ? 2 : 0) + (t & NEW_INSTRUCTION ? 6 : 0) + k + (t & NEW_ADDRESS ? 4 : 0);
+        if (k > 4 || end - p < bytes) return false;
+        std::uint16_t &guess = next[previous % LOCATIONS];
+        if (t & NEW_LOCATION) {
+            guess = static_cast<std::uint16_t>(getBytes(p, 2));
+            p += 2;
+        }
+        std::uint16_t location = guess;
+        Halves &ref = last[location % LOCATIONS];
+        Halves b = ref;
+        if (t & NEW_INSTRUCTION) {
+            b.lo = getBytes(p, 6) << 16;
+            p += 6;
+        }
+        b.lo = (b.lo & ~0xFFFFULL) | location;
+        b.hi ^= getBytes(p, k);
+        p += k;
+        if (t & NEW_ADDRESS) {
+            b.hi = (b.hi & 0xFFFFFFFFULL) | getBytes(p, 4) << 32;
+            p += 4;
+        }
+        std::memcpy(&records[i], &b, sizeof b);
+        ref = b;
+        previous = location;
+    }
+    return p == end;
+}
+
+} // namespace
+
+RegisterWrites::RegisterWrites()
+{
+    for (int c = 0; c < 64; c++) {
+        int r = TraceNothing, r2 = TraceNothing;
+        if (c == ADD || c == SUB) r = TraceA;
+        else if (c == MUL || c == DIV || c == NUM || c == SLA) r = TraceA, r2 = TraceX;
+        else if (c == MOVE) r = TraceI1;
+        else if (c >= LDA && c <= LDX) r = TraceA + c - LDA;
+        else if (c >= LDAN && c <= LDXN) r = TraceA + c - LDAN;
+        else if (c == JBUS || c == JRED || (c >= JMP && c <= JXN)) r = TraceJ;
+        else if (c >= INCA && c <= INCX) r = TraceA + c - INCA;
+        first[c] = static_cast<std::uint8_t>(r);
+        second[c] = static_cast<std::uint8_t>(r2);
+    }
+}
+
+const RegisterWrites registerWrites;
+
+RegisterMap::RegisterMap(MIXMachine &m)
+{
+    at[TraceNothing] = &m.Reg[REG_Z].w;
+    at[TraceA] = &m.Reg[REG_A].w;
+    for (int i = 1; i <= 6; i++) at[TraceI1 + i - 1] = &m.Reg[i].w;
+    at[TraceX] = &m.Reg[REG_X].w;
+    at[TraceJ] = &m.Reg[REG_J].w;
+}
+
+TraceFile::TraceFile(const char *path)
+:out(std::fopen(path, "wb")), streams(0), quit(false), failed(false)
+{
+    std::uint32_t size = RECORD_BYTES;
+    if (out && (std::fwrite(TRACE_MAGIC, sizeof TRACE_MAGIC, 1, out) != 1 || std::fwrite(&size, sizeof size, 1, out) != 1)) {
+        std::fclose(out);
+        out = nullptr;
+    }
+    thread = std::thread(&TraceFile::work, this);
+}
+
+TraceFile::~TraceFile()
+{
+    close();
+}
+
+bool TraceFile::close()
+{
+    if (thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> g(lock);
+            quit = true;
+        }
+        wake.notify_one();
+        thread.join();
+    }
+    if (out && std::fclose(out) != 0) failed = true;
+    out = nullptr;
+    return !failed;
+}
+
+void TraceFile::submit(TraceRing *ring, int block, int records)
+{
+    ring->busy[block].store(true, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> g(lock);
+        queue.push_back(Work{ring, block, records});
+    }
+    wake.notify_one();
+}
+
+void TraceFile::work()
+{
+    std::vector<unsigned char> packed(MAX_PACKED);
+    std::unique_lock<std::mutex> g(lock);
+    for (;;) {
+        wake.wait(g, [this] { return quit || !queue.empty(); });
+        if (queue.empty()) return;
+        Work w = queue.front();
+        queue.pop_front();
+        bool behind = queue.size() >= TRACE_RING_BLOCKS / 2;
+        g.unlock();
+        if (out && !failed) {
+            const TraceRecord *records = &w.ring->records[w.block * TRACE_BLOCK];
+            TraceBlockHeader h;
+            h.stream = w.ring->stream;
+            h.records = static_cast<std::uint32_t>(w.records);
+            const void *bytes = records;
+            if (behind) {
+                h.records |= TRACE_STORED;
+                h.bytes = static_cast<std::uint32_t>(w.records * RECORD_BYTES);
+            } else {
+                h.bytes = static_cast<std::uint32_t>(compress(records, w.records, packed.data()));
+                bytes = packed.data();
+            }
+            // (a failed write leaves the rest of the file out: close() says so)
+            if (std::fwrite(&h, sizeof h, 1, out) != 1 || std::fwrite(bytes, 1, h.bytes, out) != h.bytes) failed = true;
+        }
+        g.lock();
+        w.ring->busy[w.block].store(false, std::memory_order_release);
+        written.notify_all();
+    }
+}
+
+TraceRing::TraceRing(TraceFile &file)
+:file(file), records(TRACE_RING_BLOCKS * TRACE_BLOCK), block(0), used(0)
+{
+    for (int i = 0; i < TRACE_RING_BLOCKS; i++) busy[i].store(false, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> g(file.lock);
+    stream = file.streams++;
+}
+
+TraceRing::~TraceRing()
+{
+    flush();
+    std::unique_lock<std::mutex> g(file.lock);
+    for (int i = 0; i < TRACE_RING_BLOCKS; i++) {
+        file.written.wait(g, [this, i] { return !busy[i].load(std::memory_order_acquire); });
+    }
+}
+
+void TraceRing::flush()
+{
+    if (used) handOver();
+}
+
+// the block is full (or flushed): on to the next, once it has been written
+void TraceRing::handOver()
+{
+    file.submit(this, block, used);
+    block = (block + 1) % TRACE_RING_BLOCKS;
+    used = 0;
+    if (busy[block].load(std::memory_order_acquire)) {
+        std::unique_lock<std::mutex> g(file.lock);
+        file.written.wait(g, [this] { return !busy[block].load(std::memory_order_acquire); });
+    }
+}
+
+Stop runTraced(MIXMachine &m, TraceRing &ring, std::uint32_t run, long long budget, long long &steps)
+{
+    put(ring, record(m.programCounter, TraceStart, indicators(m), 0, run, 0));
+    if (startRun(m)) {
+        const RegisterMap reg(m);
+        // the records go straight into the ring's block, taken a block at a time
+        TraceRecord *taken = ring.reserve(MAX_STEP_RECORDS), *p = taken;
+        TraceRecord *full = taken + ring.room() - MAX_STEP_RECORDS;
+        long long n = 0;
+        for (; !budget || n < budget; n++) {
+            int pc = m.programCounter;
+            const MIXInstr &in = m.Decoded[pc];
+            if (!in.op) decodeInstruction(m, pc);
+            Opcode oc = in.oc;
+            std::uint32_t word = m.Memory[pc].w;
+            int target, count = wordsWritten(m, in, target);
+
+            bool running = stepChecked(m);
+            // an instruction that faulted did nothing, and is only in the TraceStop record (a
+            // fault after it, running off the end of memory, is not one of its own)
+            if (!running && m.stopLocation == pc && m.stop != Stop::Halted) break;
+            // the registers the opcode writes, as they are now (changed or not: comparing
+            // them costs the running thread more than the compressed bytes of an unchanged
+            // value), then the words it stored
+            std::uint64_t head = halfOf(pc, 0, indicators(m), word), step = std::uint64_t(TRACE_STEP) << 16;
+            int first = registerWrites.first[oc], second = registerWrites.second[oc];
+            if (first || !count) {
+                store(p++, head | step | std::uint64_t(first) << 16, *reg.at[first]);
+                step = 0;
+            }
+            if (second) store(p++, head | std::uint64_t(second) << 16, *reg.at[second]);
+            for (int k = 0; k < count && static_cast<unsigned>(target + k) < ADDR_CAP; k++) {
+                store(p++, head | step | std::uint64_t(TraceMemory) << 16,
+                      m.Memory[target + k].w | std::uint64_t(target + k) << 32);
+                step = 0;
+            }
+            if (p > full) {
+                ring.take(static_cast<int>(p - taken));
+                taken = p = ring.reserve(MAX_STEP_RECORDS);
+                full = taken + ring.room() - MAX_STEP_RECORDS;
+            }
+            if (!running) {
+                if (m.stop == Stop::Halted) steps++;
+                break;
+            }
+            steps++;
+        }
+        ring.take(static_cast<int>(p - taken));
+        if (budget && n == budget) stopAt(m, Stop::Budget, m.programCounter);
+    }
+    put(ring, record(m.stopLocation, TraceStop, indicators(m), m.stopInstruction.w,
+                     static_cast<std::uint32_t>(m.stop), m.stopLocation));
+    return m.stop;
+}
+
+TraceReader::TraceReader(const char *path)
+:in(std::fopen(path, "rb")), damaged(false), packed(MAX_PACKED)
+{
+    char magic[sizeof TRACE_MAGIC];
+    std::uint32_t size;
+    if (in && (std::fread(magic, sizeof magic, 1, in) != 1 || std::memcmp(magic, TRACE_MAGIC, sizeof magic) != 0
+               || std::fread(&size, sizeof size, 1, in) != 1 || size != RECORD_BYTES)) {
+        std::fclose(in);
+        in = nullptr;
+    }
+}
+
+TraceReader::~TraceReader()
+{
+    if (in) std::fclose(in);
+}
+
+bool TraceReader::nextBlock(std::uint32_t &stream, std::vector<TraceRecord> &records)
+{
+    if (!in || damaged) return false;
+    TraceBlockHeader h;
+    size_t got = std::fread(&h, 1, sizeof h, in);
+    if (got == 0) return false;
+    bool stored = (h.records & TRACE_STORED) != 0;
+    std::uint32_t n = h.records & ~TRACE_STORED;
+    if (got != sizeof h || n > TRACE_BLOCK || h.bytes > MAX_PACKED || (stored && h.bytes != n * RECORD_BYTES)) {
+        damaged = true;
+        return false;
+    }
+    records.resize(n);
+    void *to = stored ? static_cast<void *>(records.data()) : packed.data();
+    if (std::fread(to, 1, h.bytes, in) != h.bytes
+        || (!stored && !decompress(packed.data(), h.bytes, static_cast<int>(n), records.data()))) {
+        damaged = true;
+        return false;
+    }
+    stream = h.stream;
+    return true;
+}
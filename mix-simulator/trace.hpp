@@ -0,0 +1,215 @@
+//
+//  trace.hpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+#ifndef trace_hpp
+#define trace_hpp
+
+#include "mix.h"
+#include "mixop-table.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// a binary execution trace: for each instruction run, a fixed-width record
+// of where it was, the instruction word and what it wrote: the register
+// its opcode writes, as it is after the instruction (whether or not it
+// changed; TraceNothing for none), or the word it stored. an instruction
+// that writes more than one thing (MUL, DIV and the shifts write rA and
+// rX, MOVE a register and a block of words) has a record for each, the
+// first marked TRACE_STEP. a run starts with a TraceStart
+// record (value: the run or job number) and ends with a TraceStop one
+// (value: the Stop, address: where it stopped, instruction: the word
+// there); an instruction that stops the run with a fault has no other.
+//
+// the words that IN brings into memory are not in the trace (they arrive
+// when the unit is found ready, not at any one instruction); the IN is.
+enum TraceWhat : std::uint8_t {
+    TraceNothing,      // (a jump not taken, a comparison, an I/O operation...)
+    TraceA,
+    TraceI1,           // TraceI1 + i - 1 for Ii
+    TraceX = TraceI1 + 6,
+    TraceJ,
+    TraceMemory,       // the word at address
+    TraceStart,
+    TraceStop
+};
+constexpr std::uint8_t TRACE_STEP = 0x80; // set in what on the first record of an instruction
+
+struct TraceRecord {
+    std::uint16_t location;    // of the instruction
+    std::uint8_t what;         // a TraceWhat, with TRACE_STEP
+    std::uint8_t indicators;   // after it: the comparison + 1 (0 to 2), and 4 if overflow is on
+    std::uint32_t instruction; // the instruction word (a PackedWord)
+    std::uint32_t value;       // the new value of what changed (a PackedWord)
+    std::uint16_t address;     // the word changed, for TraceMemory
+    std::uint16_t reserved;
+};
+static_assert(sizeof(TraceRecord) == 16, "trace records are 16 bytes");
+
+// what an instruction can change, for the trace and for History (see
+// history.hpp): the registers, as up to two TraceWhats for each opcode
+// (TraceNothing for none)
+struct RegisterWrites {
+    std::uint8_t first[64], second[64];
+    RegisterWrites();
+};
+extern const RegisterWrites registerWrites;
+
+// where each of TraceA to TraceJ is kept in m (at[TraceNothing] is rZ,
+// which is always zero, so that it can be read the same way)
+struct RegisterMap {
+    PackedWord *at[TraceJ + 1];
+    explicit RegisterMap(MIXMachine &m);
+};
+
+// and the words: the number in stores to if the instruction in is carried
+// out (one for a store, the field for MOVE), and the first of them in target
+inline int wordsWritten(MIXMachine &m, const MIXInstr &in, int &target)
+{
+    target = 0;
+    if (in.oc >= STA && in.oc <= STZ && in.index <= 6) {
+        target = effectiveAddress(m, in);
+        return 1;
+    }
+    if (in.oc == MOVE) {
+        target = packedValue(m.Reg[REG_I1].w);
+        return in.field;
+    }
+    return 0;
+}
+
+// the file a trace goes to, with the host thread that writes it. records
+// are collected by TraceRings, a block of TRACE_BLOCK records at a time;
+// each full block is handed to the host thread, which compresses it and
+// writes it out while the ring fills the next.
+//
+// the file is a header ("MIXTRACE", then the record size as a uint32)
+// followed by blocks, each a TraceBlockHeader and the compressed records.
+// the blocks of each ring are in order; blocks of different rings (one for
+// each thread of a batch) are interleaved. a compressed record is a tag
+// byte, then the location if it is not the one that followed the location
+// before it last time, the what, indicators and instruction if they are
+// not those of the last record in the block at the same location (or
+// zero), the bytes of the value XOR that record's that are not leading
+// zeros, and the address if it is not that record's: a loop comes to 1 or
+// 2 bytes a record. when the host thread cannot keep up
+// (half a ring of blocks is waiting for it), it writes blocks as they are
+// instead, marked TRACE_STORED, so that the running threads do not wait
+// on it.
+constexpr int TRACE_BLOCK = 4096;
+constexpr int TRACE_RING_BLOCKS = 8;
+constexpr std::uint32_t TRACE_STORED = 0x80000000; // set in records if they are not compressed
+
+struct TraceBlockHeader {
+    std::uint32_t stream;  // the ring it came from, counted from 0
+    std::uint32_t records; // with TRACE_STORED
+    std::uint32_t bytes;   // of (compressed) records that follow
+};
+
+class TraceRing;
+
+class TraceFile {
+public:
+    // start the trace in path (ok() is false if it cannot be written)
+    explicit TraceFile(const char *path);
+    // close() if that has not been done
+    ~TraceFile();
+    TraceFile(const TraceFile&) = delete;
+    TraceFile& operator=(const TraceFile&) = delete;
+
+    bool ok() const { return out != nullptr; }
+    // write out everything handed over, and close the file; false if any
+    // of it could not be written (the disk is full...). the rings must be
+    // gone first
+    bool close();
+
+private:
+    friend class TraceRing;
+    struct Work {
+        TraceRing *ring;
+        int block;
+        int records;
+    };
+
+    std::FILE *out;
+    std::uint32_t streams;
+    std::mutex lock;
+    std::condition_variable wake, written;
+    std::deque<Work> queue;
+    std::thread thread;
+    bool quit, failed;
+
+    void submit(TraceRing *ring, int block, int records);
+    void work();
+};
+
+// the records of one thread: a ring of TRACE_RING_BLOCKS blocks, filled
+// in turn. the thread only waits when it has filled every block before
+// the host thread has written out the oldest one
+class TraceRing {
+public:
+    explicit TraceRing(TraceFile &file);
+    // hand over the records still in the ring, and wait until they are written
+    ~TraceRing();
+    TraceRing(const TraceRing&) = delete;
+    TraceRing& operator=(const TraceRing&) = delete;
+
+    // room for up to n (at most TRACE_BLOCK) records in a row: fill in
+    // some of them, then take() that many
+    TraceRecord *reserve(int n)
+    {
+        if (used + n > TRACE_BLOCK) handOver();
+        return &records[block * TRACE_BLOCK + used];
+    }
+    void take(int n) { used += n; }
+    // the records from reserve() on that are free in this block
+    int room() const { return TRACE_BLOCK - used; }
+    // hand over the records collected so far, without waiting
+    void flush();
+
+private:
+    friend class TraceFile;
+    TraceFile &file;
+    std::uint32_t stream;
+    std::vector<TraceRecord> records; // TRACE_RING_BLOCKS blocks
+    std::atomic<bool> busy[TRACE_RING_BLOCKS]; // handed over and not yet written
+    int block, used;
+
+    void handOver();
+};
+
+// run m like runChecked, with a record in ring for every instruction,
+// between a TraceStart record for run and a TraceStop one
+Stop runTraced(MIXMachine &m, TraceRing &ring, std::uint32_t run, long long budget, long long &steps);
+
+// the records of a trace file, a block at a time
+class TraceReader {
+public:
+    explicit TraceReader(const char *path);
+    ~TraceReader();
+    TraceReader(const TraceReader&) = delete;
+    TraceReader& operator=(const TraceReader&) = delete;
+
+    // false if the file cannot be read or is not a trace
+    bool ok() const { return in != nullptr; }
+    // the next block, into records; false at the end (or if the rest of
+    // the file is damaged, when error() is also true)
+    bool nextBlock(std::uint32_t &stream, std::vector<TraceRecord> &records);
+    bool error() const { return damaged; }
+
+private:
+    std::FILE *in;
+    bool damaged;
+    std::vector<unsigned char> packed;
+};
+
+#endif /* trace_hpp */
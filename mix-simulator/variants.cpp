@@ -0,0 +1,286 @@
+//
+//  variants.cpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+// the loop is a template over one class for each policy. a policy that is
+// off is a class of empty inline functions, which the compiler drops; the
+// sixteen instantiations are picked from at run time, once per run.
+
+#include "variants.hpp"
+#include "interpreter.hpp"
+#include "mixop-table.hpp"
+#include "devices.hpp"
+#include <iostream>
+#include <iomanip>
+#include <string>
+
+namespace {
+
+// how an instruction uses M, for the address checks
+enum Operand : unsigned char {
+    NoOperand, // NOP and NUM/CHAR/HLT ignore it
+    Value,     // shifts, jumps and address transfers (a jump is checked when taken)
+    Address,   // a word of memory
+    Block,     // MOVE: F words from M to the location in I1
+    Transfer   // IN and OUT: a block of the size of unit F
+};
+
+struct OperandTable {
+    Operand kind[64];
+    OperandTable() {
+        for (int c = 0; c < 64; c++) {
+            if (c == NOP || c == NUM) kind[c] = NoOperand;
+            else if (c == MOVE) kind[c] = Block;
+            else if (c == IN || c == OUT) kind[c] = Transfer;
+            else if ((c >= ADD && c <= DIV) || (c >= LDA && c <= STZ) || c >= CMPA) kind[c] = Address;
+            else kind[c] = Value;
+        }
+    }
+};
+
+const OperandTable operands;
+
+inline bool inMemory(int loc, int words)
+{
+    return loc >= 0 && loc + words <= ADDR_CAP;
+}
+
+// address checking
+// (the handlers fault on an operand outside memory themselves, and a jump
+// outside it is caught here as in every engine)
+struct Unchecked {
+    static bool operands(MIXMachine &m, const MIXInstr &in) { return true; }
+    static bool fetch(int pc) { return static_cast<unsigned>(pc) < ADDR_CAP; }
+};
+
+struct Checked {
+    static bool operands(MIXMachine &m, const MIXInstr &in)
+    {
+        Operand kind = ::operands.kind[in.oc];
+        if (kind == NoOperand) return true;
+        if (in.index > 6) return false;
+        if (kind == Address) return inMemory(effectiveAddress(m, in), 1);
+        if (kind == Block) {
+            return in.field == 0 || (inMemory(effectiveAddress(m, in), in.field)
+                && inMemory(packedValue(m.Reg[REG_I1].w), in.field));
+        }
+        // (a unit that does not exist is left to the handler)
+        if (kind == Transfer) return inMemory(effectiveAddress(m, in), blockSize(in.field));
+        return true;
+    }
+    static bool fetch(int pc) { return static_cast<unsigned>(pc) < ADDR_CAP; }
+};
+
+// tracing
+struct Untraced {
+    static void trace(Instruments &ins, const MIXMachine &m) { }
+};
+
+struct Traced {
+    static void trace(Instruments &ins, const MIXMachine &m)
+    {
+        std::ostream &os = *ins.trace;
+        char old_fill = os.fill('0');
+        os << std::setw(4) << m.programCounter << ": " << m.Memory[m.programCounter]
+           << " A " << m.Reg[REG_A] << "X " << m.Reg[REG_X];
+        for (int i = 1; i < 7; i++) os << 'I' << i << ' ' << packedValue(m.Reg[i].w) << ' ';
+        os << "J " << packedValue(m.Reg[REG_J].w) << '\n';
+        os.fill(old_fill);
+    }
+};
+
+// profiling
+struct Unprofiled {
+    static void count(Instruments &ins, int pc, const MIXInstr &in) { }
+};
+
+struct Profiled {
+    static void count(Instruments &ins, int pc, const MIXInstr &in)
+    {
+        ins.profile[pc]++;
+        ins.cycles[pc] += mixTime(in);
+    }
+};
+
+// statistics
+struct NoStats {
+    static void count(Instruments &ins, const MIXInstr &in) { }
+};
+
+struct Stats {
+    static void count(Instruments &ins, const MIXInstr &in) { ins.opcodes[in.oc]++; }
+};
+
+// counting the instructions run, for runChecked (the variants do not)
+struct Uncounted {
+    bool spent() const { return false; }
+    void count() { }
+};
+
+struct Counted {
+    long long budget, steps;
+    bool spent() const { return budget && steps == budget; }
+    void count() { steps++; }
+};
+
+template <class Check, class Trace, class Profile, class Stat, class Count>
+Stop runLoop(MIXMachine &m, Instruments &ins, Count &counter)
+{
+    if (!startRun(m)) return m.stop;
+    for (;;) {
+        if (counter.spent()) {
+            stopAt(m, Stop::Budget, m.programCounter);
+            return Stop::Budget;
+        }
+        int pc = m.programCounter;
+        const MIXInstr &in = m.Decoded[pc];
+        if (!in.op) {
+            // Decoded[ADDR_CAP] is never filled in, so running off the
+            // end of memory ends up here
+            if (pc == ADDR_CAP) return fetchFault(m, pc);
+            decodeInstruction(m, pc);
+        }
+        Trace::trace(ins, m);
+        if (!Check::operands(m, in)) {
+            stopMachine(m, Stop::AddressFault);
+            return m.stop;
+        }
+        Profile::count(ins, pc, in);
+        Stat::count(ins, in);
+
+        Opcode oc = in.oc; // (may be invalidated by a store to itself)
+        in.op(m, in);
+        if (m.stop != Stop::Running) {
+            if (m.stop == Stop::Halted) counter.count(); // (the HLT)
+            m.programCounter = m.stopLocation;
+            return m.stop;
+        }
+        if (!isJumpOpcode(oc)) {
+            ++m.programCounter;
+        } else if (!Check::fetch(m.programCounter)) {
+            return fetchFault(m, m.programCounter);
+        }
+        counter.count();
+    }
+}
+
+template <class Check, class Trace, class Profile, class Stat>
+Stop runPolicies(MIXMachine &m, Instruments &ins)
+{
+    Uncounted counter;
+    return runLoop<Check, Trace, Profile, Stat>(m, ins, counter);
+}
+
+typedef Stop (*Runner)(MIXMachine &m, Instruments &ins);
+
+// one policy at a time, from the last to the first
+template <class C, class T, class P>
+Runner pick(const Variant &v)
+{
+    return v.stats ? runPolicies<C, T, P, Stats> : runPolicies<C, T, P, NoStats>;
+}
+
+template <class C, class T>
+Runner pick(const Variant &v)
+{
+    return v.profiled ? pick<C, T, Profiled>(v) : pick<C, T, Unprofiled>(v);
+}
+
+template <class C>
+Runner pick(const Variant &v)
+{
+    return v.traced ? pick<C, Traced>(v) : pick<C, Untraced>(v);
+}
+
+} // namespace
+
+bool parseVariant(const char *list, Variant &v)
+{
+    std::string s(list);
+    size_t start = 0;
+    for (;;) {
+        size_t comma = s.find(',', start);
+        std::string name = s.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+        if (name == "checked") v.checked = true;
+        else if (name == "unchecked") v.checked = false;
+        else if (name == "trace") v.traced = true;
+        else if (name == "profile") v.profiled = true;
+        else if (name == "stats") v.stats = true;
+        else return false;
+        if (comma == std::string::npos) return true;
+        start = comma + 1;
+    }
+}
+
+Stop runVariant(MIXMachine &m, const Variant &v, Instruments &ins)
+{
+    Runner run = v.checked ? pick<Checked>(v) : pick<Unchecked>(v);
+    return run(m, ins);
+}
+
+Stop runChecked(MIXMachine &m, long long budget, long long &steps)
+{
+    // (nothing is collected, so one set of instruments does for every
+    // machine and thread)
+    static Instruments none;
+    Counted counter = {budget, 0};
+    Stop stop = runLoop<Checked, Untraced, Unprofiled, NoStats>(m, none, counter);
+    steps += counter.steps;
+    return stop;
+}
+
+bool stepChecked(MIXMachine &m)
+{
+    int pc = m.programCounter;
+    const MIXInstr &in = m.Decoded[pc];
+    if (!in.op) decodeInstruction(m, pc);
+    if (!Checked::operands(m, in)) {
+        stopMachine(m, Stop::AddressFault);
+        return false;
+    }
+    return stepTable(m);
+}
+
+void reportInstruments(std::ostream &os, const Variant &v, const Instruments &ins, const MIXMachine &m)
+{
+    std::ios_base::fmtflags old_flags = os.flags();
+    char old_fill = os.fill(' ');
+    std::streamsize old_precision = os.precision();
+    if (v.profiled) {
+        long long count = 0, time = 0;
+        for (int i = 0; i < ADDR_CAP; i++) {
+            count += ins.profile[i];
+            time += ins.cycles[i];
+        }
+        os << "Profile: " << count << " instructions in " << time << "u\n"
+           << "loc   word                    count        time   share\n";
+        // a blank line between runs of code, so that loops stand out
+        for (int i = 0, last = -1; i < ADDR_CAP; i++) {
+            if (!ins.profile[i]) continue;
+            if (last >= 0 && i != last + 1) os << '\n';
+            last = i;
+            os << std::setfill('0') << std::setw(4) << i << ": " << m.Memory[i]
+               << std::setfill(' ') << std::setw(11) << ins.profile[i]
+               << std::setw(11) << ins.cycles[i] << 'u'
+               << std::fixed << std::setprecision(1) << std::setw(7)
+               << 100.0 * ins.cycles[i] / time << "%\n";
+        }
+    }
+    if (v.stats) {
+        long long total = 0;
+        for (int c = 0; c < 64; c++) total += ins.opcodes[c];
+        os << "Statistics: " << total << " instructions\n";
+        for (int c = 0; c < 64; c++) {
+            if (!ins.opcodes[c]) continue;
+            os << std::left << std::setw(6) << opcodeNames[c] << std::right
+               << std::setw(12) << ins.opcodes[c] << std::fixed << std::setprecision(1)
+               << std::setw(7) << 100.0 * ins.opcodes[c] / total << "%\n";
+        }
+    }
+    os.precision(old_precision);
+    os.fill(old_fill);
+    os.flags(old_flags);
+}
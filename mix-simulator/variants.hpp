@@ -0,0 +1,63 @@
+//
+//  variants.hpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+#ifndef variants_hpp
+#define variants_hpp
+
+#include "mix.h"
+#include <iosfwd>
+#include <vector>
+
+// the table interpreter, specialized at compile time for every combination
+// of four policies: address checking, tracing, profiling and statistics.
+// each combination is a loop of its own, so one without a policy has no
+// trace of it, not even a branch.
+//
+// a checked variant stops with an address fault on an index register
+// other than I1-I6, on an operand address outside memory (for MOVE, the
+// whole block) and on a jump outside memory, before the instruction runs.
+// an unchecked one leaves that to the handlers and the loop, as the other
+// engines do: the fault is the same, only found a little later.
+struct Variant {
+    bool checked = true;
+    bool traced = false;   // write each instruction and the registers before it
+    bool profiled = false; // count the executions and time of each location
+    bool stats = false;    // count the executions of each opcode
+};
+
+// what the instrumented variants collect
+struct Instruments {
+    std::ostream *trace;            // where the traced variants write
+    std::vector<long long> profile; // executions of each location
+    std::vector<long long> cycles;  // time spent at each location, in u (see mixTime)
+    long long opcodes[64];          // executions of each opcode C
+
+    explicit Instruments(std::ostream *trace = nullptr)
+    :trace(trace), profile(ADDR_CAP), cycles(ADDR_CAP), opcodes() {}
+};
+
+// parse a comma separated list of checked, unchecked, trace, profile and
+// stats into v; false on anything else
+bool parseVariant(const char *list, Variant &v);
+
+// run m with the variant v, as runTable does
+Stop runVariant(MIXMachine &m, const Variant &v, Instruments &ins);
+
+// run m checked, without instruments, for at most budget instructions (0
+// for no limit), adding the number completed to steps as runCounted does
+Stop runChecked(MIXMachine &m, long long budget, long long &steps);
+
+// one instruction of m, as stepTable, checked first as the checked
+// variants check it; false if the machine has stopped
+bool stepChecked(MIXMachine &m);
+
+// print the profile and statistics collected (if v collects them). the
+// profile is a listing of every location that ran, with its frequency
+// count and time, in the manner of TAOCP
+void reportInstruments(std::ostream &os, const Variant &v, const Instruments &ins, const MIXMachine &m);
+
+#endif /* variants_hpp */
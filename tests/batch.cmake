@@ -0,0 +1,15 @@
+# runs the manifest in tests/batch with SIMULATOR and the options in
+# OPTIONS, and compares the results with expected.txt: the faulting job
+# must stop with an invalid address, and the jobs around it still run
+set(dir ${CMAKE_CURRENT_LIST_DIR}/batch)
+separate_arguments(options UNIX_COMMAND "${OPTIONS}")
+execute_process(COMMAND ${SIMULATOR} --batch=manifest.txt --results=${RESULTS} ${options}
+    WORKING_DIRECTORY ${dir} RESULT_VARIABLE status OUTPUT_QUIET)
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "batch run failed: ${status}")
+endif()
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${RESULTS} ${dir}/expected.txt
+    RESULT_VARIABLE differ)
+if(differ)
+    message(FATAL_ERROR "${RESULTS} differs from ${dir}/expected.txt")
+endif()
@@ -0,0 +1,232 @@
+//
+//  mixtrace.cpp
+//  mix-simulator
+//
+//  Copyright © 2015 Chris. All rights reserved.
+//
+
+// reads a binary trace written with --trace (see trace.hpp) and lists the
+// instructions in it, or with --summary sums it up. build from this
+// directory with
+//
+//     c++ -O2 -std=c++11 -pthread -I../mix-simulator -o mixtrace mixtrace.cpp
+//         ../mix-simulator/{mix,mixop-table,interpreter,threaded,jit,devices,trace,debugger}.cpp
+//
+// (all on one line). usage:
+//
+//     mixtrace [--job=n] [--from=step] [--to=step] [--at=loc] [--writes=loc] [--summary] trace
+//
+// --job keeps the run (or batch job) n only; --from and --to the steps in
+// that range (counted from 1 in each run); --at the instructions at
+// location loc; --writes the instructions that stored into the word at loc.
+// the summary is of the records that pass the filters: the steps and the
+// stop of each run, the opcodes, the busiest locations and the words
+// written most often.
+
+#include "mix.h"
+#include "trace.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <vector>
+
+namespace {
+
+struct Filter {
+    long long job = -1, from = 1, to = -1;
+    int at = -1, writes = -1;
+};
+
+// one instruction and what it wrote (all of its records)
+struct Step {
+    std::vector<TraceRecord> records;
+    bool writes(int loc) const
+    {
+        for (const TraceRecord &r : records) {
+            if ((r.what & ~TRACE_STEP) == TraceMemory && r.address == loc) return true;
+        }
+        return false;
+    }
+};
+
+// where each stream is: its run, and the steps so far
+struct Stream {
+    long long job = 0, steps = 0;
+    Step step;
+};
+
+struct Summary {
+    struct Run {
+        long long steps = 0;
+        Stop stop = Stop::Running;
+        int location = 0;
+    };
+    std::map<long long, Run> runs;
+    long long opcodes[64] = {};
+    std::vector<long long> executions = std::vector<long long>(ADDR_CAP);
+    std::vector<long long> writes = std::vector<long long>(ADDR_CAP);
+    long long records = 0;
+};
+
+const char *const registerNames[] = {"", "A", "I1", "I2", "I3", "I4", "I5", "I6", "X", "J"};
+
+void printStep(std::ostream &os, long long job, long long n, const Step &s)
+{
+    const TraceRecord &first = s.records[0];
+    MIXWord word;
+    word.w = first.instruction;
+    char old_fill = os.fill('0');
+    os << "job " << job << " step " << n << "  " << std::setw(4) << first.location << ": "
+       << std::setfill(' ') << std::left << std::setw(5) << opcodeNames[first.instruction & 63]
+       << std::right << std::setfill('0') << word;
+    for (const TraceRecord &r : s.records) {
+        int what = r.what & ~TRACE_STEP;
+        MIXWord value;
+        value.w = r.value;
+        if (what == TraceMemory) os << " [" << r.address << "] " << value;
+        else if (what != TraceNothing) os << ' ' << registerNames[what] << ' ' << packedValue(r.value);
+    }
+    int ci = (first.indicators & 3) - 1;
+    if (ci) os << (ci < 0 ? " LESS" : " GREATER");
+    if (first.indicators & 4) os << " OV";
+    os << '\n';
+    os.fill(old_fill);
+}
+
+bool passes(const Filter &f, const Stream &st, const Step &s)
+{
+    if (f.job >= 0 && st.job != f.job) return false;
+    if (st.steps < f.from || (f.to >= 0 && st.steps > f.to)) return false;
+    if (f.at >= 0 && s.records[0].location != f.at) return false;
+    if (f.writes >= 0 && !s.writes(f.writes)) return false;
+    return true;
+}
+
+// the step of st is complete
+void finishStep(const Filter &f, Stream &st, bool summary, Summary &sum)
+{
+    Step &s = st.step;
+    if (s.records.empty()) return;
+    st.steps++;
+    if (passes(f, st, s)) {
+        if (!summary) {
+            printStep(std::cout, st.job, st.steps, s);
+        } else {
+            const TraceRecord &first = s.records[0];
+            sum.opcodes[first.instruction & 63]++;
+            if (first.location < ADDR_CAP) sum.executions[first.location]++;
+            for (const TraceRecord &r : s.records) {
+                if ((r.what & ~TRACE_STEP) == TraceMemory && r.address < ADDR_CAP) sum.writes[r.address]++;
+            }
+        }
+    }
+    s.records.clear();
+}
+
+// the (up to) ten largest counts in v, with their index
+void printTop(std::ostream &os, const char *title, const std::vector<long long> &v)
+{
+    std::vector<std::pair<long long, int> > top;
+    for (int i = 0; i < static_cast<int>(v.size()); i++) {
+        if (v[i]) top.push_back(std::make_pair(-v[i], i));
+    }
+    std::sort(top.begin(), top.end());
+    if (top.size() > 10) top.resize(10);
+    os << title << '\n';
+    for (const auto &t : top) os << "  " << std::setfill('0') << std::setw(4) << t.second << std::setfill(' ') << std::setw(14) << -t.first << '\n';
+}
+
+void printSummary(std::ostream &os, const Summary &sum)
+{
+    os << sum.records << " records\n";
+    for (const auto &r : sum.runs) {
+        os << "job " << r.first << ": " << r.second.steps << " steps, " << stopName(r.second.stop)
+           << " at " << r.second.location << '\n';
+    }
+    os << "opcodes\n";
+    for (int c = 0; c < 64; c++) {
+        if (sum.opcodes[c]) os << "  " << std::left << std::setw(5) << opcodeNames[c] << std::right << std::setw(14) << sum.opcodes[c] << '\n';
+    }
+    printTop(os, "locations run most", sum.executions);
+    printTop(os, "words written most", sum.writes);
+}
+
+bool option(const char *arg, const char *name, long long &value)
+{
+    size_t n = std::strlen(name);
+    if (std::strncmp(arg, name, n) != 0) return false;
+    value = std::atoll(arg + n);
+    return true;
+}
+
+} // namespace
+
+int main(int argc, const char *argv[])
+{
+    Filter f;
+    bool summary = false;
+    const char *path = nullptr;
+    for (int i = 1; i < argc; i++) {
+        long long v;
+        if (option(argv[i], "--job=", f.job)) continue;
+        else if (option(argv[i], "--from=", f.from)) continue;
+        else if (option(argv[i], "--to=", f.to)) continue;
+        else if (option(argv[i], "--at=", v)) f.at = static_cast<int>(v);
+        else if (option(argv[i], "--writes=", v)) f.writes = static_cast<int>(v);
+        else if (std::strcmp(argv[i], "--summary") == 0) summary = true;
+        else if (argv[i][0] != '-' && !path) path = argv[i];
+        else {
+            path = nullptr;
+            break;
+        }
+    }
+    if (!path) {
+        std::cerr << "usage: " << argv[0] << " [--job=n] [--from=step] [--to=step] [--at=loc] [--writes=loc] [--summary] trace\n";
+        return 1;
+    }
+    TraceReader reader(path);
+    if (!reader.ok()) {
+        std::cerr << "Cannot read " << path << " as a trace.\n";
+        return 1;
+    }
+
+    std::map<std::uint32_t, Stream> streams;
+    Summary sum;
+    std::uint32_t id;
+    std::vector<TraceRecord> records;
+    while (reader.nextBlock(id, records)) {
+        Stream &st = streams[id];
+        sum.records += records.size();
+        for (const TraceRecord &r : records) {
+            int what = r.what & ~TRACE_STEP;
+            if ((r.what & TRACE_STEP) || what == TraceStart || what == TraceStop) finishStep(f, st, summary, sum);
+            if (what == TraceStart) {
+                st.job = r.value;
+                st.steps = 0;
+            } else if (what == TraceStop) {
+                if (f.job < 0 || st.job == f.job) {
+                    Summary::Run &run = sum.runs[st.job];
+                    run.steps = st.steps;
+                    run.stop = static_cast<Stop>(r.value);
+                    run.location = r.address;
+                    if (!summary) {
+                        std::cout << "job " << st.job << ": " << stopName(run.stop) << " at " << r.address
+                                  << " after " << st.steps << " steps\n";
+                    }
+                }
+            } else {
+                st.step.records.push_back(r);
+            }
+        }
+    }
+    for (auto &st : streams) finishStep(f, st.second, summary, sum);
+    if (summary) printSummary(std::cout, sum);
+    if (reader.error()) {
+        std::cerr << path << " is damaged; it ends early.\n";
+        return 1;
+    }
+    return 0;
+}